@@ -0,0 +1,978 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_B_PLUS_TREE_ON_DISK_H
+#define STRUCTURES_B_PLUS_TREE_ON_DISK_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "./page_cache.h"
+#include "./varint.h"
+
+using namespace std;
+
+namespace structures {
+
+//! Classe BPlusTreeOnDisk
+/*! Árvore B+ em disco, cada node ocupa uma página do PageCache.
+ *  As chaves ficam ordenadas dentro de cada página e os valores só
+ *  existem nas folhas, que são encadeadas da esquerda para a direita
+ *  para permitir percorrer faixas de chaves.
+ *
+ *  As chaves têm tamanho variável e são gravadas com codificação de
+ *  prefixo: cada uma guarda só quantos caracteres tem em comum com a
+ *  anterior e o resto. A cada RESTART chaves uma vem inteira e o fim
+ *  da página tem a posição dessas chaves, onde é feita a busca binária;
+ *  a partir da chave inteira as seguintes são lidas em sequência.
+ *  Chaves maiores que MAX_INLINE guardam na página só o começo e ficam
+ *  inteiras fora dela, no fim do arquivo, sem limite de tamanho.
+ *  Os nodes internos guardam como separador o menor prefixo que separa
+ *  as duas folhas, não a chave inteira.
+ *
+ *  A árvore não é dona do arquivo: as páginas são alocadas no fim do
+ *  PageCache recebido, que pode guardar outros dados entre elas.
+ *
+ *  Uma árvore vazia também pode ser carregada de baixo para cima com
+ *  chaves já ordenadas (bulk_insert() e bulk_finish()): as folhas são
+ *  preenchidas em sequência e os nodes internos montados no final, sem
+ *  nenhuma descida nem divisão.
+ *
+ *  Várias chaves podem ser procuradas de uma vez (find() com vector):
+ *  elas são ordenadas e as que caem na mesma folha são resolvidas sem
+ *  descer de novo. Chaves com um mesmo prefixo são lidas em ordem
+ *  seguindo o encadeamento das folhas (scan()).
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+template<typename V>
+class BPlusTreeOnDisk {
+ public:
+  static const size_t MAX_INLINE = 128u;  //!< Maior chave inteira na página
+
+  explicit BPlusTreeOnDisk(PageCache* file);  // Construtor
+  ~BPlusTreeOnDisk();  // Destrutor
+
+  void restore(const size_t root, const size_t depth, const size_t size);  // Reabre
+  void clear();  // Esvazia árvore
+
+  bool find(const char* key, V* value) const;  // Procura chave
+  size_t find(const vector<string>& keys, vector<V>* values,
+              vector<bool>* found) const;  // Procura várias chaves
+  void scan(const char* prefix,
+            vector<pair<string, V>>* out) const;  // Chaves com prefixo
+  void insert(const char* key, const V& value);  // Insere ou substitui
+  void bulk_insert(const char* key, const V& value);  // Insere em ordem
+  void bulk_finish();  // Monta nodes internos
+
+  bool empty() const;  // Teste de vazio
+  size_t root() const;  // Deslocamento da raiz
+  size_t size() const;  // Quantidade de chaves
+  size_t depth() const;  // Altura da árvore
+
+ private:
+  static const size_t HEADER = 16u;  //!< Cabeçalho da página
+  static const size_t RESTART = 16u;  //!< Chaves entre chaves inteiras
+
+  //! Classe Node
+  /*! Visão sobre uma página fixada no PageCache.
+   *  Cabeçalho, entradas a partir de HEADER e, no fim da página, a
+   *  posição de cada chave inteira, de trás para frente. Cada entrada
+   *  tem o prefixo em comum com a anterior e o tamanho do resto, em
+   *  Varint, o resto, o deslocamento da chave longa se houver e o valor
+   *  (folha) ou o filho à direita da chave (interno). O filho mais à
+   *  esquerda de um node interno fica em next().
+   *
+   *  \author João Vicente Souto.
+   *  \since 20/06/17
+   *  \version 1.0
+   */
+  class Node {
+   public:
+    //! Construtor
+    /*! Com parâmetros, conteúdo da página
+     */
+    explicit Node(char* data) :
+    data_{data}
+    {}
+
+    //! Folha
+    /*! \return uint32_t& se o node é folha */
+    uint32_t& leaf() {
+      return *reinterpret_cast<uint32_t*>(data_);
+    }
+
+    //! Quantidade de chaves
+    /*! \return uint32_t& quantidade */
+    uint32_t& count() {
+      return *reinterpret_cast<uint32_t*>(data_ + sizeof(uint32_t));
+    }
+
+    //! Próxima folha
+    /*! \return uint64_t& folha à direita, ou primeiro filho do interno */
+    uint64_t& next() {
+      return *reinterpret_cast<uint64_t*>(data_ + 2 * sizeof(uint32_t));
+    }
+
+    //! Chave inteira
+    /*! \param size_t índice, a chave inteira de número r é a r*RESTART
+     *  \return uint16_t& posição da entrada na página
+     */
+    uint16_t& restart(const size_t index) {
+      return *reinterpret_cast<uint16_t*>(
+          data_ + PageCache::PAGE_SIZE - (index + 1) * sizeof(uint16_t));
+    }
+
+    char *data_;  //!< Conteúdo da página
+  };
+
+  //! Classe Entry
+  /*! Entrada decodificada de uma página, com a chave inteira.
+   *
+   *  \author João Vicente Souto.
+   *  \since 20/06/17
+   *  \version 1.0
+   */
+  class Entry {
+   public:
+    string key_;  //!< Chave
+    uint64_t blob_{0u};  //!< Chave longa fora da página, 0 se não for
+    V value_{};  //!< Valor, na folha
+    uint64_t child_{0u};  //!< Filho à direita da chave, no interno
+  };
+
+  //! Classe Position
+  /*! Resultado da busca em uma página: a primeira entrada cuja chave não
+   *  vem antes da procurada e o que é preciso para continuar a leitura.
+   *
+   *  \author João Vicente Souto.
+   *  \since 20/06/17
+   *  \version 1.0
+   */
+  class Position {
+   public:
+    size_t index_{0u},  //!< Índice da entrada
+           offset_{0u},  //!< Posição da entrada na página
+           payload_{0u},  //!< Posição do valor ou filho da entrada
+           before_{0u};  //!< Posição do valor ou filho da anterior
+    string key_;  //!< Chave gravada da entrada
+    uint64_t blob_{0u};  //!< Chave longa da entrada
+  };
+
+  void search(char* data, const string& key,
+              Position* at) const;  // Procura na página
+  uint64_t child(char* data, const Position& at) const;  // Filho da busca
+  size_t descend(const string& key,
+                 string* fence = nullptr) const;  // Folha da chave
+  size_t allocate(const bool leaf);  // Nova página
+
+  static size_t read_entry(const char* data, size_t offset, string* key,
+                           uint64_t* blob);  // Lê entrada
+  void decode(char* data, vector<Entry>* entries) const;  // Lê página
+  static size_t measure(const Entry* previous, const Entry& entry,
+                        const bool leaf);  // Tamanho da entrada
+  size_t encode(const vector<Entry>& entries, const size_t begin,
+                const size_t end, const bool leaf, const uint64_t next,
+                char* data) const;  // Grava página
+  size_t split(const vector<Entry>& entries,
+               const bool leaf) const;  // Ponto de divisão
+  static Entry separator(const Entry& left,
+                         const Entry& right);  // Menor separador
+
+  int compare(const string& stored, const uint64_t blob,
+              const string& key) const;  // Compara com chave gravada
+  string load(const uint64_t blob) const;  // Lê chave longa
+  uint64_t store(const string& key);  // Grava chave longa
+
+  PageCache *file_;  //!< Arquivo das páginas
+  size_t root_{0u},  //!< Deslocamento da raiz
+         depth_{0u},  //!< Altura
+         size_{0u},  //!< Quantidade de chaves
+         bulk_leaf_{0u},  //!< Folha sendo preenchida pela carga
+         bulk_bytes_{0u};  //!< Bytes ocupados na folha da carga
+  vector<Entry> bulk_entries_;  //!< Entradas da folha da carga
+  vector<Entry> bulk_;  //!< Separador e deslocamento de cada folha
+};
+
+template<typename V>
+const size_t BPlusTreeOnDisk<V>::MAX_INLINE;
+
+//! Construtor
+/*! Árvore vazia sobre o arquivo recebido.
+ *  \param PageCache* arquivo, continua pertencendo a quem chamou
+ *  \sa ~BPlusTreeOnDisk(), restore()
+ */
+template<typename V>
+BPlusTreeOnDisk<V>::BPlusTreeOnDisk(PageCache* file) :
+file_{file}
+{}
+
+//! Destrutor
+/*! Destrutor padrão, o arquivo pertence a quem criou a árvore.
+ *  \sa BPlusTreeOnDisk()
+ */
+template<typename V>
+BPlusTreeOnDisk<V>::~BPlusTreeOnDisk() {}
+
+//! Reabre
+/*! Recupera uma árvore já gravada no arquivo.
+ *  \param size_t deslocamento da raiz
+ *  \param size_t altura
+ *  \param size_t quantidade de chaves
+ *  \sa clear()
+ */
+template<typename V>
+void BPlusTreeOnDisk<V>::restore(const size_t root, const size_t depth,
+                                 const size_t size) {
+  root_ = root;
+  depth_ = depth;
+  size_ = size;
+}
+
+//! Esvazia árvore
+/*! Esquece a árvore, as páginas continuam no arquivo.
+ *  \sa restore()
+ */
+template<typename V>
+void BPlusTreeOnDisk<V>::clear() {
+  root_ = depth_ = size_ = bulk_leaf_ = bulk_bytes_ = 0u;
+  bulk_entries_.clear();
+  bulk_.clear();
+}
+
+//! Procura chave
+/*! Desce da raiz até a folha, uma página por nível.
+ *  \param char* chave
+ *  \param V* onde copiar o valor encontrado
+ *  \return bool se a chave existe
+ *  \sa insert()
+ */
+template<typename V>
+bool BPlusTreeOnDisk<V>::find(const char* key, V* value) const {
+  if (size_ == 0u)
+    return false;
+
+  string wanted(key);
+  size_t page = descend(wanted) / PageCache::PAGE_SIZE;
+  char *data = file_->pin(page);
+  Position at;
+  search(data, wanted, &at);
+  bool found = at.index_ < Node(data).count() &&
+               compare(at.key_, at.blob_, wanted) == 0;
+  if (found)
+    memcpy(value, data + at.payload_, sizeof(V));
+  file_->unpin(page, false);
+
+  return found;
+}
+
+//! Procura várias chaves
+/*! As chaves são visitadas em ordem crescente. Enquanto a próxima
+ *  chave for menor que o separador à direita da folha atual ela só
+ *  pode estar nessa folha, então a descida da raiz é feita uma vez por
+ *  folha e não uma vez por chave.
+ *  \param vector<string> chaves, em qualquer ordem
+ *  \param vector<V>* valores, na ordem das chaves
+ *  \param vector<bool>* se cada chave existe, na ordem das chaves
+ *  \return size_t quantidade de chaves encontradas
+ *  \sa find(const char* key, V* value)
+ */
+template<typename V>
+size_t BPlusTreeOnDisk<V>::find(const vector<string>& keys, vector<V>* values,
+                                vector<bool>* found) const {
+  values->assign(keys.size(), V());
+  found->assign(keys.size(), false);
+  if (size_ == 0u || keys.empty())
+    return 0u;
+
+  vector<size_t> order(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i)
+    order[i] = i;
+  sort(order.begin(), order.end(), [&keys](size_t a, size_t b) {
+    return keys[a] < keys[b];
+  });
+
+  size_t page = 0u, hits = 0u;
+  char *data = nullptr;
+  string fence;
+  Position at;
+  for (size_t i : order) {
+    const string& current = keys[i];
+    if (data != nullptr && !fence.empty() && current >= fence) {
+      file_->unpin(page, false);
+      data = nullptr;
+    }
+    if (data == nullptr) {
+      page = descend(current, &fence) / PageCache::PAGE_SIZE;
+      data = file_->pin(page);
+    }
+
+    search(data, current, &at);
+    if (at.index_ < Node(data).count() &&
+        compare(at.key_, at.blob_, current) == 0) {
+      memcpy(&(*values)[i], data + at.payload_, sizeof(V));
+      (*found)[i] = true;
+      ++hits;
+    }
+  }
+  file_->unpin(page, false);
+
+  return hits;
+}
+
+//! Chaves com prefixo
+/*! Desce até a primeira chave >= prefixo e segue pelas folhas
+ *  encadeadas enquanto as chaves começarem com ele. O custo é a altura
+ *  da árvore mais as folhas com chaves encontradas, não importa o
+ *  tamanho do dicionário. Prefixo vazio percorre todas as chaves.
+ *  \param char* prefixo
+ *  \param vector<pair<string, V>>* chaves e valores, em ordem crescente
+ *  \sa find()
+ */
+template<typename V>
+void BPlusTreeOnDisk<V>::scan(const char* prefix,
+                              vector<pair<string, V>>* out) const {
+  if (size_ == 0u)
+    return;
+
+  string wanted(prefix), stored, full;
+  size_t offset = descend(wanted);
+  bool first = true;
+
+  while (offset != 0u) {
+    size_t page = offset / PageCache::PAGE_SIZE, index = 0u,
+           position = HEADER;
+    char *data = file_->pin(page);
+    Node node(data);
+    stored.clear();
+    if (first) {
+      Position at;
+      search(data, wanted, &at);
+      index = at.index_;
+      position = at.offset_;
+      stored = at.key_;  // só o prefixo em comum com a anterior é usado
+      first = false;
+    }
+
+    for (; index < node.count(); ++index) {
+      uint64_t blob;
+      position = read_entry(data, position, &stored, &blob);
+      const string& key = blob != 0u? (full = load(blob)) : stored;
+      if (key.compare(0, wanted.size(), wanted) != 0) {
+        file_->unpin(page, false);
+        return;
+      }
+      V value;
+      memcpy(&value, data + position, sizeof(V));
+      position += sizeof(V);
+      out->push_back(make_pair(key, value));
+    }
+
+    offset = node.next();
+    file_->unpin(page, false);
+  }
+}
+
+//! Insere
+/*! Insere a chave na folha, ou substitui o valor se ela já existir.
+ *  A página é decodificada e gravada de novo com a chave no lugar;
+ *  se não couber ela é dividida onde as duas metades ficam com bytes
+ *  parecidos e a divisão sobe pelo caminho percorrido, criando uma
+ *  nova raiz se preciso.
+ *  \param char* chave
+ *  \param V valor
+ *  \sa find()
+ */
+template<typename V>
+void BPlusTreeOnDisk<V>::insert(const char* key, const V& value) {
+  string wanted(key);
+  if (size_ == 0u) {
+    root_ = allocate(true);
+    depth_ = 1u;
+  }
+
+  // Caminho da raiz até a folha, que fica fixada
+  size_t path[64], slot[64], level = 0u, offset = root_, page;
+  char *data;
+  Position at;
+  while (true) {
+    page = offset / PageCache::PAGE_SIZE;
+    data = file_->pin(page);
+    path[level] = offset;
+    search(data, wanted, &at);
+    slot[level] = at.index_;
+    if (Node(data).leaf())
+      break;
+    offset = child(data, at);
+    file_->unpin(page, false);
+    ++level;
+  }
+
+  // Folha
+  Node leaf(data);
+  if (at.index_ < leaf.count() && compare(at.key_, at.blob_, wanted) == 0) {
+    memcpy(data + at.payload_, &value, sizeof(V));
+    file_->unpin(page, true);
+    return;
+  }
+
+  Entry entry;
+  entry.key_ = wanted;
+  entry.value_ = value;
+  if (wanted.size() > MAX_INLINE)
+    entry.blob_ = store(wanted);
+
+  vector<Entry> entries;
+  decode(data, &entries);
+  entries.insert(entries.begin() + at.index_, entry);
+  ++size_;
+
+  uint64_t next = leaf.next();
+  if (encode(entries, 0u, entries.size(), true, next, nullptr) <=
+      PageCache::PAGE_SIZE) {
+    encode(entries, 0u, entries.size(), true, next, data);
+    file_->unpin(page, true);
+    return;
+  }
+
+  // Folha cheia, divide ao meio
+  size_t half = split(entries, true),
+         right = allocate(true), right_page = right / PageCache::PAGE_SIZE;
+  encode(entries, half, entries.size(), true, next, file_->pin(right_page));
+  encode(entries, 0u, half, true, right, data);
+  Entry middle = separator(entries[half - 1], entries[half]);
+  middle.child_ = right;
+  file_->unpin(right_page, true);
+  file_->unpin(page, true);
+
+  // Sobe a divisão
+  while (level > 0) {
+    --level;
+    page = path[level] / PageCache::PAGE_SIZE;
+    data = file_->pin(page);
+    uint64_t first = Node(data).next();
+    decode(data, &entries);
+    entries.insert(entries.begin() + slot[level], middle);
+
+    if (encode(entries, 0u, entries.size(), false, first, nullptr) <=
+        PageCache::PAGE_SIZE) {
+      encode(entries, 0u, entries.size(), false, first, data);
+      file_->unpin(page, true);
+      return;
+    }
+
+    // Node interno cheio, a chave do meio sobe
+    half = split(entries, false);
+    right = allocate(false);
+    right_page = right / PageCache::PAGE_SIZE;
+    encode(entries, half + 1, entries.size(), false, entries[half].child_,
+           file_->pin(right_page));
+    encode(entries, 0u, half, false, first, data);
+    middle = entries[half];
+    middle.child_ = right;
+    file_->unpin(right_page, true);
+    file_->unpin(page, true);
+  }
+
+  // A raiz foi dividida
+  size_t top = allocate(false), top_page = top / PageCache::PAGE_SIZE;
+  entries.assign(1u, middle);
+  encode(entries, 0u, 1u, false, root_, file_->pin(top_page));
+  file_->unpin(top_page, true);
+  root_ = top;
+  ++depth_;
+}
+
+//! Insere em ordem
+/*! Carga de uma árvore vazia: a chave vai para o fim da folha atual,
+ *  guardada em memória até encher, quando é gravada e trocada por uma
+ *  nova. Uma chave igual à anterior substitui o valor, como no insert().
+ *  \param char* chave, maior que todas as anteriores
+ *  \param V valor
+ *  \throw std::out_of_range chave fora de ordem ou árvore não vazia
+ *  \sa bulk_finish()
+ */
+template<typename V>
+void BPlusTreeOnDisk<V>::bulk_insert(const char* key, const V& value) {
+  if (bulk_leaf_ == 0u && size_ != 0u)
+    throw std::out_of_range("Carga em ordem só em árvore vazia.");
+
+  Entry entry;
+  entry.key_ = key;
+  entry.value_ = value;
+
+  if (!bulk_entries_.empty()) {
+    int compare = bulk_entries_.back().key_.compare(entry.key_);
+    if (compare > 0)
+      throw std::out_of_range("Chave fora de ordem na carga.");
+    if (compare == 0) {
+      bulk_entries_.back().value_ = value;
+      return;
+    }
+  }
+  if (entry.key_.size() > MAX_INLINE)
+    entry.blob_ = store(entry.key_);
+
+  if (bulk_leaf_ == 0u) {
+    bulk_leaf_ = allocate(true);
+    bulk_bytes_ = HEADER;
+    bulk_.push_back(entry);
+    bulk_.back().child_ = bulk_leaf_;
+  }
+
+  bool restart = bulk_entries_.size() % RESTART == 0u;
+  size_t bytes = measure(restart? nullptr : &bulk_entries_.back(),
+                         entry, true) + (restart? sizeof(uint16_t) : 0u);
+
+  if (bulk_bytes_ + bytes > PageCache::PAGE_SIZE) {
+    size_t next = allocate(true), page = bulk_leaf_ / PageCache::PAGE_SIZE;
+    encode(bulk_entries_, 0u, bulk_entries_.size(), true, next,
+           file_->pin(page));
+    file_->unpin(page, true);
+
+    bulk_.push_back(separator(bulk_entries_.back(), entry));
+    bulk_.back().child_ = next;
+    bulk_entries_.clear();
+    bulk_leaf_ = next;
+    bulk_bytes_ = HEADER;
+    bytes = measure(nullptr, entry, true) + sizeof(uint16_t);
+  }
+
+  bulk_entries_.push_back(entry);
+  bulk_bytes_ += bytes;
+  ++size_;
+}
+
+//! Monta nodes internos
+/*! Termina a carga: grava a última folha e monta cada nível enchendo
+ *  os nodes com os separadores do nível de baixo, até sobrar um único
+ *  node, a raiz.
+ *  \sa bulk_insert()
+ */
+template<typename V>
+void BPlusTreeOnDisk<V>::bulk_finish() {
+  if (bulk_.empty())
+    return;
+
+  size_t page = bulk_leaf_ / PageCache::PAGE_SIZE;
+  encode(bulk_entries_, 0u, bulk_entries_.size(), true, 0u, file_->pin(page));
+  file_->unpin(page, true);
+  bulk_entries_.clear();
+
+  vector<Entry> level, upper;
+  level.swap(bulk_);
+  depth_ = 1u;
+
+  while (level.size() > 1u) {
+    size_t first = 0u;
+    upper.clear();
+
+    while (first < level.size()) {
+      size_t last = first + 1, bytes = HEADER;
+      for (; last < level.size(); ++last) {
+        bool restart = (last - first - 1) % RESTART == 0u;
+        size_t more = measure(restart? nullptr : &level[last - 1],
+                              level[last], false) +
+                      (restart? sizeof(uint16_t) : 0u);
+        if (bytes + more > PageCache::PAGE_SIZE)
+          break;
+        bytes += more;
+      }
+
+      size_t offset = allocate(false);
+      page = offset / PageCache::PAGE_SIZE;
+      encode(level, first + 1, last, false, level[first].child_,
+             file_->pin(page));
+      file_->unpin(page, true);
+
+      upper.push_back(level[first]);
+      upper.back().child_ = offset;
+      first = last;
+    }
+
+    level.swap(upper);
+    ++depth_;
+  }
+
+  root_ = level[0].child_;
+  bulk_leaf_ = bulk_bytes_ = 0u;
+}
+
+//! Teste de vazio
+/*! \return bool se não há chaves */
+template<typename V>
+bool BPlusTreeOnDisk<V>::empty() const {
+  return size_ == 0u;
+}
+
+//! Deslocamento da raiz
+/*! \return size_t deslocamento da página raiz no arquivo */
+template<typename V>
+size_t BPlusTreeOnDisk<V>::root() const {
+  return root_;
+}
+
+//! Quantidade de chaves
+/*! \return size_t quantidade de chaves */
+template<typename V>
+size_t BPlusTreeOnDisk<V>::size() const {
+  return size_;
+}
+
+//! Altura da árvore
+/*! Quantidade de páginas lidas em uma busca.
+ *  \return size_t altura
+ */
+template<typename V>
+size_t BPlusTreeOnDisk<V>::depth() const {
+  return depth_;
+}
+
+//! Procura na página
+/*! Busca binária entre as chaves inteiras e depois leitura em sequência
+ *  a partir da última que vem antes da procurada. Na folha para na
+ *  primeira chave >= key; no node interno na primeira > key, então o
+ *  filho a seguir é o da entrada anterior.
+ *  \param char* conteúdo da página
+ *  \param string chave procurada
+ *  \param Position* onde a busca parou
+ *  \sa child()
+ */
+template<typename V>
+void BPlusTreeOnDisk<V>::search(char* data, const string& key,
+                                Position* at) const {
+  Node node(data);
+  bool inner = !node.leaf();
+  size_t count = node.count(), restarts = (count + RESTART - 1) / RESTART,
+         payload = inner? sizeof(uint64_t) : sizeof(V);
+  auto before = [this, &key, inner](const string& stored,
+                                    const uint64_t blob) {
+    int result = compare(stored, blob, key);
+    return result < 0 || (inner && result == 0);
+  };
+
+  size_t low = 0u, high = restarts;
+  while (low < high) {
+    size_t middle = (low + high) / 2;
+    at->key_.clear();
+    read_entry(data, node.restart(middle), &at->key_, &at->blob_);
+    if (before(at->key_, at->blob_))
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  size_t start = low > 0u? low - 1 : 0u;
+  at->index_ = start * RESTART;
+  at->offset_ = restarts > 0u? node.restart(start) : HEADER;
+  at->before_ = 0u;
+  at->key_.clear();
+  for (; at->index_ < count; ++at->index_) {
+    at->payload_ = read_entry(data, at->offset_, &at->key_, &at->blob_);
+    if (!before(at->key_, at->blob_))
+      return;
+    at->before_ = at->payload_;
+    at->offset_ = at->payload_ + payload;
+  }
+}
+
+//! Filho da busca
+/*! \param char* conteúdo de um node interno
+ *  \param Position resultado de search() nele
+ *  \return uint64_t deslocamento do filho onde a chave deve estar
+ */
+template<typename V>
+uint64_t BPlusTreeOnDisk<V>::child(char* data, const Position& at) const {
+  uint64_t offset;
+  if (at.index_ == 0u)
+    return Node(data).next();
+  memcpy(&offset, data + at.before_, sizeof(offset));
+  return offset;
+}
+
+//! Folha da chave
+/*! Desce da raiz até a folha onde a chave está ou estaria, uma página
+ *  por nível. O separador à direita do filho escolhido no nível mais
+ *  baixo que tiver um é o limite da folha: todas as chaves dela são
+ *  menores que ele.
+ *  \param string chave
+ *  \param string* limite da folha, vazio se for a última
+ *  \return size_t deslocamento da folha
+ */
+template<typename V>
+size_t BPlusTreeOnDisk<V>::descend(const string& key, string* fence) const {
+  size_t offset = root_;
+  Position at;
+  if (fence != nullptr)
+    fence->clear();
+  while (true) {
+    size_t page = offset / PageCache::PAGE_SIZE;
+    char *data = file_->pin(page);
+    bool leaf = Node(data).leaf();
+    size_t next = offset;
+    if (!leaf) {
+      search(data, key, &at);
+      next = child(data, at);
+      if (fence != nullptr && at.index_ < Node(data).count())
+        *fence = at.blob_ != 0u? load(at.blob_) : at.key_;
+    }
+    file_->unpin(page, false);
+    if (leaf)
+      return offset;
+    offset = next;
+  }
+}
+
+//! Nova página
+/*! Aloca uma página zerada alinhada no fim do arquivo.
+ *  \param bool se a página é folha
+ *  \return size_t deslocamento da página
+ */
+template<typename V>
+size_t BPlusTreeOnDisk<V>::allocate(const bool leaf) {
+  size_t page = (file_->size() + PageCache::PAGE_SIZE - 1) /
+                PageCache::PAGE_SIZE;
+  char *data = file_->pin(page);
+  memset(data, 0, PageCache::PAGE_SIZE);
+  Node(data).leaf() = leaf? 1u : 0u;
+  file_->unpin(page, true);
+  return page * PageCache::PAGE_SIZE;
+}
+
+//! Lê entrada
+/*! \param char* conteúdo da página
+ *  \param size_t posição da entrada
+ *  \param string* chave gravada da entrada anterior, vira a desta
+ *  \param uint64_t* deslocamento da chave longa, 0 se não for
+ *  \return size_t posição do valor ou filho da entrada
+ */
+template<typename V>
+size_t BPlusTreeOnDisk<V>::read_entry(const char* data, size_t offset,
+                                      string* key, uint64_t* blob) {
+  uint64_t shared, suffix;
+  offset += Varint::decode(data + offset, &shared);
+  offset += Varint::decode(data + offset, &suffix);
+  key->resize(shared);
+  key->append(data + offset, suffix >> 1);
+  offset += suffix >> 1;
+
+  *blob = 0u;
+  if (suffix & 1u) {
+    memcpy(blob, data + offset, sizeof(*blob));
+    offset += sizeof(*blob);
+  }
+  return offset;
+}
+
+//! Lê página
+/*! \param char* conteúdo da página
+ *  \param vector<Entry>* entradas em ordem, com as chaves inteiras
+ *  \sa encode()
+ */
+template<typename V>
+void BPlusTreeOnDisk<V>::decode(char* data, vector<Entry>* entries) const {
+  Node node(data);
+  bool leaf = node.leaf();
+  size_t offset = HEADER;
+  string stored;
+  entries->resize(node.count());
+
+  for (Entry& entry : *entries) {
+    offset = read_entry(data, offset, &stored, &entry.blob_);
+    entry.key_ = entry.blob_ != 0u? load(entry.blob_) : stored;
+    if (leaf) {
+      memcpy(&entry.value_, data + offset, sizeof(V));
+      offset += sizeof(V);
+    } else {
+      memcpy(&entry.child_, data + offset, sizeof(uint64_t));
+      offset += sizeof(uint64_t);
+    }
+  }
+}
+
+//! Tamanho da entrada
+/*! \param Entry* entrada anterior, nullptr se esta for chave inteira
+ *  \param Entry entrada
+ *  \param bool se a página é folha
+ *  \return size_t bytes da entrada gravada depois da anterior
+ */
+template<typename V>
+size_t BPlusTreeOnDisk<V>::measure(const Entry* previous, const Entry& entry,
+                                   const bool leaf) {
+  size_t length = min(entry.key_.size(), MAX_INLINE), shared = 0u;
+  if (previous != nullptr) {
+    size_t limit = min(length, previous->key_.size());
+    while (shared < limit && previous->key_[shared] == entry.key_[shared])
+      ++shared;
+  }
+  bool longer = entry.key_.size() > MAX_INLINE;
+  return Varint::size(shared) +
+         Varint::size((length - shared) << 1 | (longer? 1u : 0u)) +
+         length - shared + (longer? sizeof(uint64_t) : 0u) +
+         (leaf? sizeof(V) : sizeof(uint64_t));
+}
+
+//! Grava página
+/*! Codifica as entradas [begin, end) em uma página. Sem página só
+ *  calcula o tamanho, para saber se cabe.
+ *  \param vector<Entry> entradas
+ *  \param size_t primeira entrada
+ *  \param size_t fim das entradas
+ *  \param bool se a página é folha
+ *  \param uint64_t próxima folha, ou primeiro filho do interno
+ *  \param char* conteúdo da página, ou nullptr
+ *  \return size_t bytes ocupados, contando cabeçalho e chaves inteiras
+ *  \sa decode()
+ */
+template<typename V>
+size_t BPlusTreeOnDisk<V>::encode(const vector<Entry>& entries,
+                                  const size_t begin, const size_t end,
+                                  const bool leaf, const uint64_t next,
+                                  char* data) const {
+  size_t offset = HEADER, restarts = (end - begin + RESTART - 1) / RESTART;
+  for (size_t i = begin; i < end; ++i) {
+    const Entry& entry = entries[i];
+    bool restart = (i - begin) % RESTART == 0u;
+    if (data == nullptr) {
+      offset += measure(restart? nullptr : &entries[i - 1], entry, leaf);
+      continue;
+    }
+
+    size_t length = min(entry.key_.size(), MAX_INLINE), shared = 0u;
+    if (restart) {
+      Node(data).restart((i - begin) / RESTART) = offset;
+    } else {
+      const string& previous = entries[i - 1].key_;
+      size_t limit = min(length, previous.size());
+      while (shared < limit && previous[shared] == entry.key_[shared])
+        ++shared;
+    }
+    bool longer = entry.key_.size() > MAX_INLINE;
+
+    offset += Varint::encode(shared, data + offset);
+    offset += Varint::encode((length - shared) << 1 | (longer? 1u : 0u),
+                             data + offset);
+    memcpy(data + offset, entry.key_.data() + shared, length - shared);
+    offset += length - shared;
+    if (longer) {
+      memcpy(data + offset, &entry.blob_, sizeof(uint64_t));
+      offset += sizeof(uint64_t);
+    }
+    if (leaf) {
+      memcpy(data + offset, &entry.value_, sizeof(V));
+      offset += sizeof(V);
+    } else {
+      memcpy(data + offset, &entry.child_, sizeof(uint64_t));
+      offset += sizeof(uint64_t);
+    }
+  }
+
+  if (data != nullptr) {
+    Node node(data);
+    node.leaf() = leaf? 1u : 0u;
+    node.count() = end - begin;
+    node.next() = next;
+    memset(data + offset, 0, PageCache::PAGE_SIZE - offset -
+                             restarts * sizeof(uint16_t));
+  }
+  return offset + restarts * sizeof(uint16_t);
+}
+
+//! Ponto de divisão
+/*! Primeira entrada da metade direita, escolhida para as duas metades
+ *  terem bytes parecidos. No node interno a entrada escolhida sobe e
+ *  a metade direita começa na seguinte.
+ *  \param vector<Entry> entradas de uma página que não coube
+ *  \param bool se a página é folha
+ *  \return size_t índice da divisão
+ */
+template<typename V>
+size_t BPlusTreeOnDisk<V>::split(const vector<Entry>& entries,
+                                 const bool leaf) const {
+  size_t skip = leaf? 0u : 1u, low = 1u, high = entries.size() - 1 - skip;
+  while (low < high) {
+    size_t middle = (low + high) / 2;
+    if (encode(entries, 0u, middle, leaf, 0u, nullptr) <
+        encode(entries, middle + skip, entries.size(), leaf, 0u, nullptr))
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low;
+}
+
+//! Menor separador
+/*! O menor prefixo da chave da direita que ainda é maior que a chave
+ *  da esquerda. Se o prefixo em comum já for maior que MAX_INLINE usa
+ *  a chave da direita inteira, que já está gravada fora da página.
+ *  \param Entry última entrada da folha da esquerda
+ *  \param Entry primeira entrada da folha da direita
+ *  \return Entry separador, sem filho
+ */
+template<typename V>
+typename BPlusTreeOnDisk<V>::Entry BPlusTreeOnDisk<V>::separator(
+    const Entry& left, const Entry& right) {
+  size_t shared = 0u, limit = min(left.key_.size(), right.key_.size());
+  while (shared < limit && left.key_[shared] == right.key_[shared])
+    ++shared;
+
+  Entry middle;
+  middle.key_ = right.key_;
+  middle.blob_ = right.blob_;
+  if (shared < MAX_INLINE) {
+    middle.key_.resize(shared + 1);
+    middle.blob_ = 0u;
+  }
+  return middle;
+}
+
+//! Compara com chave gravada
+/*! \param string chave como está na página
+ *  \param uint64_t deslocamento da chave longa, 0 se não for
+ *  \param string chave procurada
+ *  \return int como string::compare() da chave inteira com a procurada
+ */
+template<typename V>
+int BPlusTreeOnDisk<V>::compare(const string& stored, const uint64_t blob,
+                                const string& key) const {
+  if (blob == 0u)
+    return stored.compare(key);
+  int result = stored.compare(0u, stored.size(), key, 0u, stored.size());
+  return result != 0? result : load(blob).compare(key);
+}
+
+//! Lê chave longa
+/*! \param uint64_t deslocamento da chave no arquivo
+ *  \return string chave inteira
+ *  \sa store()
+ */
+template<typename V>
+string BPlusTreeOnDisk<V>::load(const uint64_t blob) const {
+  uint32_t length;
+  file_->read(blob, &length, sizeof(length));
+  string key(length, '\0');
+  file_->read(blob + sizeof(length), &key[0], length);
+  return key;
+}
+
+//! Grava chave longa
+/*! Acrescenta a chave inteira no fim do arquivo, precedida do tamanho.
+ *  \param string chave
+ *  \return uint64_t deslocamento da chave no arquivo
+ *  \sa load()
+ */
+template<typename V>
+uint64_t BPlusTreeOnDisk<V>::store(const string& key) {
+  uint32_t length = key.size();
+  uint64_t offset = file_->append(&length, sizeof(length));
+  file_->append(key.data(), length);
+  return offset;
+}
+
+}  //  namespace structures
+
+#endif
@@ -0,0 +1,348 @@
+//!  Copyright [2017] <João Vicente Souto>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "./system.h"
+
+using namespace std;
+using namespace structures;
+
+typedef chrono::steady_clock Clock;
+
+//! Classe Zipf
+/*! Sorteia postos de 0 a n-1 com probabilidade proporcional a
+ *  1/(posto+1)^s, como a frequência das palavras em texto real. A
+ *  distribuição acumulada é montada uma vez e cada sorteio é uma busca
+ *  binária.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class Zipf {
+ public:
+  //! Construtor
+  /*! \param size_t quantidade de postos
+   *  \param double expoente s
+   */
+  Zipf(const size_t n, const double s) : cdf_(n) {
+    double total = 0.0;
+    for (size_t i = 0; i < n; ++i)
+      cdf_[i] = total += 1.0 / pow(i + 1.0, s);
+    for (double& value : cdf_)
+      value /= total;
+  }
+
+  //! Sorteia posto
+  /*! \param mt19937_64 gerador
+   *  \return size_t posto, 0 é o mais frequente
+   */
+  size_t operator()(mt19937_64* random) const {
+    double u = uniform_real_distribution<double>(0.0, 1.0)(*random);
+    size_t rank = lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin();
+    return min(rank, cdf_.size() - 1u);
+  }
+
+ private:
+  vector<double> cdf_;  //!< Probabilidade acumulada por posto
+};
+
+//! Classe Latencies
+/*! Latências de uma classe de consultas, em microssegundos, e a
+ *  entrada e saída que elas fizeram.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class Latencies {
+ public:
+  vector<double> samples_;  //!< Uma por consulta
+  size_t errors_{0u},  //!< Consultas com erro
+         results_{0u};  //!< Manpages encontradas, somadas
+  IOStats::Counters io_;  //!< Entrada e saída de todas as consultas
+};
+
+//! Gera vocabulário
+/*! Palavras distintas só de letras minúsculas, de 3 a 10 letras, para
+ *  o WordHandler não partir nenhuma.
+ *  \param size_t quantidade de palavras
+ *  \param mt19937_64* gerador
+ *  \return vector<string> palavras, a posição é o posto na Zipf
+ */
+vector<string> vocabulary(const size_t size, mt19937_64* random) {
+  uniform_int_distribution<int> length(3, 10), letter('a', 'z');
+  set<string> seen;
+  vector<string> words;
+  while (words.size() < size) {
+    string word(length(*random), ' ');
+    for (char& c : word)
+      c = static_cast<char>(letter(*random));
+    if (seen.insert(word).second)
+      words.push_back(word);
+  }
+  return words;
+}
+
+//! Nome de uma manpage sintética
+/*! \param size_t número da manpage
+ *  \return string nome, com zeros à esquerda para ordenar
+ */
+string manpage(const size_t number) {
+  ostringstream name;
+  name << "doc" << setw(6) << setfill('0') << number;
+  return name.str();
+}
+
+//! Gera corpus
+/*! Escreve as manpages em ./ManPages, de 50 a 500 palavras sorteadas
+ *  pela Zipf, 12 por linha, com o nome na primeira linha como nas
+ *  manpages de verdade.
+ *  \param size_t quantidade de manpages
+ *  \param vector<string> vocabulário
+ *  \param Zipf distribuição das palavras
+ *  \param mt19937_64* gerador
+ *  \param size_t* palavras escritas
+ *  \return vector<string> caminhos, no formato que o System espera
+ */
+vector<string> generate(const size_t documents,
+                        const vector<string>& words, const Zipf& zipf,
+                        mt19937_64* random, size_t* total) {
+  uniform_int_distribution<size_t> length(50u, 500u);
+  vector<string> paths;
+  mkdir("./ManPages", 0755);
+  *total = 0u;
+
+  for (size_t i = 0; i < documents; ++i) {
+    string name = manpage(i);
+    paths.push_back("./ManPages/" + name + ".txt");
+    ofstream file(paths.back().c_str(), ios::out | ios::trunc);
+    file << name << " <-> " << words[zipf(random)] << '\n';
+
+    size_t count = length(*random);
+    for (size_t j = 0; j < count; ++j)
+      file << words[zipf(random)] << (j % 12u == 11u? '\n' : ' ');
+    file << '\n';
+    *total += count;
+  }
+  return paths;
+}
+
+//! Apaga índices
+/*! Tira os arquivos de uma execução anterior, para medir a indexação
+ *  completa.
+ */
+void remove_indexes() {
+  const char *files[] = {"primary_tree.dat", "manpages.dat",
+                         "name_index.dat", "documents.dat",
+                         "secondary_tree.dat", "permuterm.dat",
+                         "positions.dat", "manifest.dat"};
+  for (const char *file : files)
+    remove(file);
+}
+
+//! Inicia sistema
+/*! Monta os argumentos como os da linha de comando, com o cache de
+ *  consultas desligado para medir os índices, e mede o init().
+ *  \param System* sistema
+ *  \param vector<string> caminhos das manpages
+ *  \return double milissegundos
+ */
+double start(System* system, const vector<string>& paths) {
+  vector<const char*> argv = {"benchmark", "-c", "0"};
+  for (const string& path : paths)
+    argv.push_back(path.c_str());
+
+  Clock::time_point begin = Clock::now();
+  system->init(argv.size(), argv.data());
+  return chrono::duration<double, milli>(Clock::now() - begin).count();
+}
+
+//! Mede consultas
+/*! Roda as consultas pelo modo em lote e tira de cada registro o tempo
+ *  e a quantidade de resultados. A entrada e saída é a diferença dos
+ *  totais de IOStats.
+ *  \param System* sistema
+ *  \param vector<string> consultas no formato do modo em lote
+ *  \return Latencies latências medidas
+ */
+Latencies measure(System* system, const vector<string>& queries) {
+  ostringstream input, output, summary;
+  for (const string& query : queries)
+    input << query << '\n';
+  istringstream in(input.str());
+  IOStats::Counters before = IOStats::total();
+  system->batch(in, output, summary);
+  IOStats::Counters after = IOStats::total();
+
+  Latencies latencies;
+  latencies.io_.reads_ = after.reads_ - before.reads_;
+  latencies.io_.bytes_read_ = after.bytes_read_ - before.bytes_read_;
+  latencies.io_.pages_ = after.pages_ - before.pages_;
+  istringstream records(output.str());
+  string record, number, text, micros, count;
+  while (getline(records, record)) {
+    istringstream fields(record);
+    getline(fields, number, '\t');
+    getline(fields, text, '\t');
+    getline(fields, micros, '\t');
+    getline(fields, count, '\t');
+    latencies.samples_.push_back(strtod(micros.c_str(), nullptr));
+    if (count == "erro")
+      ++latencies.errors_;
+    else
+      latencies.results_ += strtoul(count.c_str(), nullptr, 10);
+  }
+  return latencies;
+}
+
+//! Percentil
+/*! Pelo posto mais próximo.
+ *  \param vector<double> amostras em ordem crescente
+ *  \param double percentil, de 0 a 100
+ *  \return double amostra, 0 se não houver
+ */
+double percentile(const vector<double>& sorted, const double p) {
+  if (sorted.empty())
+    return 0.0;
+  size_t rank = static_cast<size_t>(ceil(p / 100.0 * sorted.size()));
+  return sorted[min(max<size_t>(rank, 1u), sorted.size()) - 1u];
+}
+
+//! Escreve latências
+/*! Objeto JSON com quantidade, média, percentis e máximo, e leituras,
+ *  bytes lidos e páginas distintas por consulta.
+ *  \param ostream saída
+ *  \param Latencies latências medidas
+ */
+void report(ostream& out, Latencies latencies) {
+  vector<double>& sorted = latencies.samples_;
+  sort(sorted.begin(), sorted.end());
+  double sum = 0.0;
+  for (double sample : sorted)
+    sum += sample;
+  size_t count = sorted.size();
+
+  out << "{\"count\": " << count << ", \"errors\": " << latencies.errors_
+      << ", \"mean_results\": "
+      << (count == 0u? 0.0 : static_cast<double>(latencies.results_) / count)
+      << ", \"mean_us\": " << (count == 0u? 0.0 : sum / count)
+      << ", \"p50_us\": " << percentile(sorted, 50.0)
+      << ", \"p90_us\": " << percentile(sorted, 90.0)
+      << ", \"p99_us\": " << percentile(sorted, 99.0)
+      << ", \"max_us\": " << (count == 0u? 0.0 : sorted.back());
+
+  double queries = count == 0u? 1.0 : count;
+  out << ", \"reads\": " << latencies.io_.reads_ / queries
+      << ", \"bytes_read\": " << latencies.io_.bytes_read_ / queries
+      << ", \"pages\": " << latencies.io_.pages_ / queries << "}";
+}
+
+//! Medição do índice de manpages
+/*! Gera um corpus sintético com vocabulário Zipf em um diretório de
+ *  trabalho, mede a indexação completa e a reabertura, o tamanho de
+ *  cada arquivo de índice e a latência das buscas por chave primária,
+ *  por uma palavra, E e OU, com o cache de consultas desligado, junto
+ *  com a entrada e saída média de cada busca. Escreve
+ *  um objeto JSON na saída padrão, para comparar execuções com diff.
+ *
+ *      benchmark diretório manpages [consultas] [semente] [vocabulário]
+ */
+int main(int argc, char const *argv[]) {
+  if (argc < 3 || argc > 6) {
+    cerr << "Uso: " << argv[0]
+         << " diretório manpages [consultas] [semente] [vocabulário]"
+         << endl;
+    return 1;
+  }
+
+  size_t documents = strtoul(argv[2], nullptr, 10),
+         count = argc > 3? strtoul(argv[3], nullptr, 10) : 200u,
+         seed = argc > 4? strtoul(argv[4], nullptr, 10) : 1u,
+         size = argc > 5? strtoul(argv[5], nullptr, 10) : 50000u;
+  const double exponent = 1.0;
+  if (documents == 0u || count == 0u || size == 0u) {
+    cerr << "Manpages, consultas e vocabulário devem ser positivos." << endl;
+    return 1;
+  }
+
+  mkdir(argv[1], 0755);
+  if (chdir(argv[1]) != 0) {
+    cerr << "Erro ao abrir " << argv[1] << endl;
+    return 1;
+  }
+
+  mt19937_64 random(seed);
+  vector<string> words = vocabulary(size, &random);
+  Zipf zipf(words.size(), exponent);
+
+  Clock::time_point begin = Clock::now();
+  size_t total;
+  vector<string> paths = generate(documents, words, zipf, &random, &total);
+  double generated = chrono::duration<double, milli>(Clock::now() -
+                                                     begin).count();
+
+  remove_indexes();
+  double build, reopen;
+  {
+    System system;
+    build = start(&system, paths);
+  }
+  System system;
+  reopen = start(&system, paths);
+
+  // Consultas sorteadas pela mesma Zipf, como as de usuários
+  vector<string> primary, single, conjunction, disjunction;
+  uniform_int_distribution<size_t> document(0u, documents - 1u);
+  for (size_t i = 0; i < count; ++i) {
+    primary.push_back("0 " + manpage(document(random)));
+    single.push_back("1 " + words[zipf(&random)]);
+    string first = words[zipf(&random)], second = words[zipf(&random)];
+    conjunction.push_back("6 " + first + " AND " + second);
+    disjunction.push_back("6 " + first + " OR " + second);
+  }
+
+  vector<pair<string, Latencies>> classes = {
+      {"primary", measure(&system, primary)},
+      {"term", measure(&system, single)},
+      {"and", measure(&system, conjunction)},
+      {"or", measure(&system, disjunction)}};
+
+  cout << fixed << setprecision(1);
+  cout << "{\n  \"corpus\": {\"documents\": " << documents
+       << ", \"words\": " << total << ", \"vocabulary\": " << words.size()
+       << ", \"zipf\": " << exponent << ", \"seed\": " << seed
+       << ", \"generate_ms\": " << generated << "},\n";
+  cout << "  \"build\": {\"init_ms\": " << build
+       << ", \"reopen_ms\": " << reopen << "},\n";
+
+  cout << "  \"files\": {";
+  size_t bytes = 0u;
+  for (const pair<string, size_t>& file : system.sizes()) {
+    cout << "\"" << file.first << "\": " << file.second << ", ";
+    bytes += file.second;
+  }
+  cout << "\"total\": " << bytes << "},\n";
+
+  cout << "  \"queries\": {";
+  for (size_t i = 0; i < classes.size(); ++i) {
+    cout << (i == 0? "\n" : ",\n") << "    \"" << classes[i].first << "\": ";
+    report(cout, classes[i].second);
+  }
+  cout << "\n  }\n}" << endl;
+  return 0;
+}
@@ -3,22 +3,49 @@
 #define STRUCTURES_BINARY_TREE_OF_LIST_H
 
 #include <cstdint>
+#include <cstring>
 #include <stdexcept>
-#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
 #include <cstdio>
-#include <sys/stat.h>
 
 #include "./structures/linked_list.h"
+#include "./page_cache.h"
+#include "./b_plus_tree_on_disk.h"
+#include "./posting_list_on_disk.h"
+#include "./query_evaluator.h"
+#include "./query_parser.h"
+#include "./permuterm_index.h"
+#include "./kd_tree_on_disk.h"
+#include "./positions_on_disk.h"
+#include "./bm25.h"
+#include "./superblock.h"
 
 using namespace std;
 
 namespace structures {
 
 //! Classe BinaryTreeOfListOnDisk
-/*! Árvore binária de listas encadeadas.
+/*! Árvore de listas.
  *  Ideia: Chave secundária é o discriminante e cada node está
- *  associado a uma lista de todos os deslocamentos na árvore
- *  primária.
+ *  associado a uma lista dos docids de todas as manpages que
+ *  contêm a chave.
+ *  O dicionário de chaves é uma árvore B+ em páginas, assim uma busca
+ *  lê uma página por nível em vez de um node por palavra. As listas
+ *  ficam em blocos contíguos e comprimidos (PostingListOnDisk).
+ *  Chaves com '*' são curingas: "sock*" percorre o dicionário a partir
+ *  do prefixo e os demais usam o PermutermIndex, montado na confirmação.
+ *  O resultado é a união das listas de todas as palavras que casam.
+ *  Cada documento da lista guarda também quantas vezes a palavra
+ *  aparece nele, para a busca ranqueada por BM25, e, com o índice
+ *  posicional, onde estão as posições da palavra no PositionsOnDisk,
+ *  para frases e NEAR.
+ *  Depois de confirmada a árvore ainda aceita manpages novas, no fim
+ *  das listas. As removidas são marcadas só na árvore primária e ficam
+ *  nas listas até a compactação, que reescreve o arquivo sem elas.
  *
  *  \author João Vicente Souto.
  *  \since 20/06/17
@@ -26,328 +53,887 @@ namespace structures {
  */
 class BinaryTreeOfListOnDisk {
 public:
-  BinaryTreeOfListOnDisk();  // Construtor
+  explicit BinaryTreeOfListOnDisk(const bool positional = false);  // Construtor
+  explicit BinaryTreeOfListOnDisk(const uint64_t fingerprint,
+                                  const bool positional = false);  // Reabre índice
   ~BinaryTreeOfListOnDisk();  // Destrutor
 
-  void insert(const char* key, const size_t manpage);  // Inserir
-  //void remove(const char* key, const size_t manpage);
-
+  static const uint64_t MAGIC = 0x3145455254434553ull;  //!< "SECTREE1"
+  static const uint32_t VERSION = 8u;  //!< Versão do formato
+
+  void insert(const char* key, const size_t manpage,
+              const size_t frequency = 1u, const size_t words = 0u,
+              const size_t positions = 0u);  // Inserir
+  void insert(const char* key, const vector<size_t>& manpages,
+              const vector<size_t>& frequencies,
+              const vector<size_t>& words,
+              const vector<size_t>& positions);  // Inserir vários
+  void bulk_insert(const char* key, const vector<size_t>& manpages,
+                   const vector<size_t>& frequencies,
+                   const vector<size_t>& words,
+                   const vector<size_t>& positions);  // Carga em ordem
+  void bulk_finish();  // Termina carga
+  size_t compact(const KDTreeOnDisk* primary);  // Tira os removidos
+
+  void commit(const uint64_t fingerprint);  // Grava superbloco
+  void share();  // Leitura por várias threads
+
+  bool reopened() const;  // Índice reaproveitado
+  PositionsOnDisk* positions() const;  // Índice posicional
   bool empty() const;  // Teste de vazio
   size_t size() const;  // Tamanho da árvore
   size_t depth() const;  // Profundidade da árvore
+  uint64_t generation() const;  // Muda a cada alteração
   size_t file_size() const;  // Tamanho do arquivo da árvore
+  size_t permuterm_size() const;  // Tamanho do índice de curingas
 
-  LinkedList<size_t>* search(const char* wanted) const;  // Busca uma chave
+  LinkedList<size_t>* search(const char* wanted) const;  // Busca uma chave ou curinga
   LinkedList<size_t>* conjunctive_search(const char* w1, const char* w2) const;  // Busca conjunto de duas chaves
   LinkedList<size_t>* disjunctive_search(const char* w1, const char* w2) const;  // Busca disjunto de duas chaves
+  LinkedList<size_t>* query(QueryNode* root) const;  // Busca booleana
+  void top(const vector<string>& words, const size_t k,
+           const KDTreeOnDisk* primary,
+           vector<TopK::Result>* out) const;  // Busca ranqueada
 
 private:
-  //! Classe TreeNode
-  /*! Node da árvore
-   *
-   *  \author João Vicente Souto.
-   *  \since 20/06/17
-   *  \version 1.0
-   */
-  class TreeNode {
-  public:
-    //! Construtor
-    /*! Sem parâmetros
-     *  \sa TreeNode(const char* key), TreeNode(const char* key, const size_t list_head)
-     */
-    TreeNode() {}
-
-    //! Construtor
-    /*! Com parâmetros, só a chave
-     *  \sa TreeNode(), TreeNode(const char* key, const size_t list_head)
-     */
-    explicit TreeNode(const char* key) {
-      strcpy(key_, key);
-    }
-
-    //! Construtor
-    /*! Com parâmetros, chave e cabeça da lista
-     *  \sa TreeNode(const char* key), TreeNode()
-     */
-    TreeNode(const char* key, const size_t list_head) {
-      strcpy(key_, key);
-      list_head_ = list_head;
-    }
+  typedef vector<PostingListOnDisk::Term> Terms;
+  typedef unordered_map<string, Terms> Plan;
+
+  void create();  // Recria arquivo vazio
+  void expand(const string& pattern, Terms* terms) const;  // Palavras da chave
+  void read(const Terms& terms, vector<size_t>* docs) const;  // União das listas
+  void plan(QueryNode* node, Plan* terms) const;  // Ordena a consulta
+  void evaluate(const QueryNode* node, const Plan& terms,
+                const vector<size_t>* candidates,
+                vector<size_t>* out) const;  // Executa a consulta
+  void locate(const QueryNode* node, const Plan& terms,
+              const vector<size_t>* candidates,
+              vector<size_t>* out) const;  // Frase ou NEAR
+  static LinkedList<size_t>* to_list(const vector<size_t>& docs);  // Converte
+
+  PageCache *file_{nullptr};  //!< Arquivo da árvore
+  BPlusTreeOnDisk<PostingListOnDisk::Term> *dictionary_{nullptr};  //!< Chave -> lista
+  PostingListOnDisk *postings_{nullptr};  //!< Listas de documentos
+  PermutermIndex *permuterm_{nullptr};  //!< Rotações, para curingas
+  PositionsOnDisk *positions_{nullptr};  //!< Posições, se posicional
+  uint64_t generation_{0u};  //!< Alterações desde que foi aberta
+  bool reopened_{false},  //!< Índice lido do disco
+       permuterm_built_{false};  //!< Permuterm tem todas as palavras
+};
 
-    //! Destrutor
-    /*! Destrutor padrão, não tem nada alocado dinâmicamente.
-     */
-    ~TreeNode() {}
+//! Construtor
+/*! Com parâmetros, se guarda posições, limpa arquivo da arvore
+ *  \param bool se o índice é posicional
+ *  \sa BinaryTreeOfListOnDisk(const uint64_t fingerprint), ~BinaryTreeOfListOnDisk()
+ */
+BinaryTreeOfListOnDisk::BinaryTreeOfListOnDisk(const bool positional) {
+  file_ = new PageCache("./secondary_tree.dat");
+  dictionary_ = new BPlusTreeOnDisk<PostingListOnDisk::Term>(file_);
+  postings_ = new PostingListOnDisk(file_, positional);
+  permuterm_ = new PermutermIndex();
+  if (positional)
+    positions_ = new PositionsOnDisk();
+  create();
+}
 
-    char key_[60]{"@"};  //!< Chave
-    size_t left_{0u},  //!< Node da esquerda
-           right_{0u},  //!< Node da direita
-           list_head_{0u};  //!< Cabeça da lista
-  };
+//! Construtor
+/*! Reabre a árvore gravada em disco se o superbloco corresponder às
+ *  entradas, senão limpa o arquivo como o construtor padrão. Um índice
+ *  posicional só é reaberto junto com as suas posições.
+ *  \param uint64_t impressão digital das entradas
+ *  \param bool se o índice é posicional
+ *  \sa BinaryTreeOfListOnDisk(), reopened()
+ */
+BinaryTreeOfListOnDisk::BinaryTreeOfListOnDisk(const uint64_t fingerprint,
+                                               const bool positional) {
+  file_ = new PageCache("./secondary_tree.dat");
+  dictionary_ = new BPlusTreeOnDisk<PostingListOnDisk::Term>(file_);
+  postings_ = new PostingListOnDisk(file_, positional);
+  permuterm_ = new PermutermIndex(fingerprint);
+  if (positional)
+    positions_ = new PositionsOnDisk(fingerprint);
+
+  Superblock block;
+  if (block.load(file_) && block.matches(MAGIC, VERSION, fingerprint) &&
+      permuterm_->reopened() && (!positional || positions_->reopened())) {
+    dictionary_->restore(block.root_, block.depth_, block.size_);
+    reopened_ = permuterm_built_ = true;
+  } else {
+    create();
+  }
+}
 
-  //! Classe ListNode
-  /*! Node da lista
-   *
-   *  \author João Vicente Souto.
-   *  \since 20/06/17
-   *  \version 1.0
-   */
-  class ListNode {
-  public:
-    //! Construtor
-    /*! Sem parâmetros
-     *  \sa ListNode(const size_t manpage), ListNode(const size_t manpage, const size_t next)
-     */
-    ListNode() {}
-
-    //! Construtor
-    /*! Com parametros, deslocamento da manpage
-     *  \sa TreeNode(), TreeNode(const char* key, const size_t list_head)
-     */
-    explicit ListNode(const size_t manpage) :
-    manpage_{manpage}
-    {}
-
-    //! Construtor
-    /*! Com parametros, deslocamento e próximo da lista
-     *  \sa TreeNode(const char* key), TreeNode()
-     */
-    ListNode(const size_t manpage, const size_t next) :
-    manpage_{manpage},
-    next_{next}
-    {}
-
-    //! Destrutor
-    /*! Destrutor padrão, não tem nada alocado dinâmicamente.
-     */
-    ~ListNode() {}
-
-    size_t manpage_{0u},  //!< Deslocamento na árvore primária
-           next_{0u};  //!< Próximo da lista
-  };
+//! Recria arquivo
+/*! Esvazia o arquivo da árvore, deixando apenas um superbloco ainda
+ *  não confirmado.
+ *  \sa commit()
+ */
+void BinaryTreeOfListOnDisk::create() {
+  file_->truncate();
+  Superblock(MAGIC, VERSION).store(file_);
+  dictionary_->clear();
+  postings_->reset();
+  if (positions_ != nullptr && positions_->reopened())
+    positions_->clear();
+  reopened_ = permuterm_built_ = false;
+  ++generation_;
+}
 
-  size_t depth_{0u},  //!< Profundidade
-         size_{0u};  //!< Quantidade de nodes
-};
+//! Confirma árvore
+/*! Na primeira confirmação monta o índice permuterm com todas as
+ *  chaves do dicionário, depois ele só recebe as palavras novas. Grava
+ *  o superbloco com a impressão digital das entradas e escreve as
+ *  páginas pendentes, a partir daqui o arquivo pode ser reaberto sem
+ *  reindexar.
+ *  \param uint64_t impressão digital das entradas
+ *  \sa BinaryTreeOfListOnDisk(const uint64_t fingerprint)
+ */
+void BinaryTreeOfListOnDisk::commit(const uint64_t fingerprint) {
+  if (!permuterm_built_) {
+    PermutermIndex::Terms terms;
+    dictionary_->scan("", &terms);
+    permuterm_->build(terms);
+    permuterm_built_ = true;
+  }
+  permuterm_->commit(fingerprint);
+  if (positions_ != nullptr)
+    positions_->commit(fingerprint);
+
+  Superblock block(MAGIC, VERSION);
+  block.fingerprint_ = fingerprint;
+  block.root_ = dictionary_->root();
+  block.size_ = dictionary_->size();
+  block.depth_ = dictionary_->depth();
+  block.store(file_);
+  file_->flush();
+}
 
-//! Construtor
-/*! Sem parâmetros, limpa arquivo da arvore
- *  \sa ~BinaryTreeOfListOnDisk()
+//! Leitura por várias threads
+/*! Depois de confirmada a árvore, dicionário, listas, permuterm e
+ *  posições podem ser lidos por várias threads ao mesmo tempo, cada uma
+ *  com o seu cache de cada arquivo. Nada mais pode ser inserido.
+ *  \sa commit(), PageCache::share()
  */
-BinaryTreeOfListOnDisk::BinaryTreeOfListOnDisk() {
-  // Cria arquivo para a arvore ou sobreescreve um existente
-  fstream tree("./secondary_tree.dat", ios::in | ios::out | ios::binary | ios::trunc);
-  tree.close();
+void BinaryTreeOfListOnDisk::share() {
+  file_->share();
+  permuterm_->share();
+  if (positions_ != nullptr)
+    positions_->share();
 }
 
 //! Destrutor
-/*! Destrutor padrão, não tem nada alocado dinâmicamente.
+/*! Fecha o arquivo, escrevendo o que estiver pendente.
  *  \sa BinaryTreeOfListOnDisk()
  */
-BinaryTreeOfListOnDisk::~BinaryTreeOfListOnDisk() {}
+BinaryTreeOfListOnDisk::~BinaryTreeOfListOnDisk() {
+  delete positions_;
+  delete permuterm_;
+  delete dictionary_;
+  delete postings_;
+  delete file_;
+}
 
 //! Insere
-/*! Recebe chave secundária e deslocamento na árvore primária.
+/*! Recebe chave secundária e docid da manpage.
+ *  Os docids chegam em ordem crescente durante a indexação e
+ *  são acrescentados no fim da lista da chave.
  *  \param char* palavra secundária
- *  \param size_t deslocamento referente a manpage
+ *  \param size_t docid da manpage
+ *  \param size_t vezes que a palavra aparece na manpage
+ *  \param size_t tamanho da manpage em palavras, 0 se desconhecido
+ *  \param size_t deslocamento das posições, 0 se não houver
  */
-void BinaryTreeOfListOnDisk::insert(const char* key, const size_t manpage) {
+void BinaryTreeOfListOnDisk::insert(const char* key, const size_t manpage,
+                                    const size_t frequency,
+                                    const size_t words,
+                                    const size_t positions) {
+  insert(key, vector<size_t>{manpage}, vector<size_t>{frequency},
+         vector<size_t>{words}, vector<size_t>{positions});
+}
 
-  fstream tree("./secondary_tree.dat", ios::in | ios::out | ios::binary);
-  char node_key[60];
-  int compare = 1;
-  size_t aux = 0, offset = 0u, next = 0u, current = 0u, level = 0u,
-         offset_left = sizeof(TreeNode::key_)+4,
-         offset_right = offset_left + sizeof(size_t),
-         offset_list_head = offset_right + sizeof(size_t);
+//! Insere vários
+/*! Acrescenta vários docids, maiores que os que já estão na
+ *  lista, com uma única busca no dicionário. Uma palavra nova também
+ *  entra no índice permuterm, se ele já foi montado.
+ *  \param char* palavra secundária
+ *  \param vector<size_t> docids em ordem crescente
+ *  \param vector<size_t> frequência da palavra em cada manpage
+ *  \param vector<size_t> tamanho de cada manpage, em palavras
+ *  \param vector<size_t> deslocamento das posições em cada manpage
+ *  \sa IndexBuilder::update()
+ */
+void BinaryTreeOfListOnDisk::insert(const char* key,
+                                    const vector<size_t>& manpages,
+                                    const vector<size_t>& frequencies,
+                                    const vector<size_t>& words,
+                                    const vector<size_t>& positions) {
+  PostingListOnDisk::Term term;
+  bool known = dictionary_->find(key, &term);
+  for (size_t i = 0; i < manpages.size(); ++i)
+    postings_->append(&term, manpages[i], frequencies[i], words[i],
+                      positions[i]);
+  dictionary_->insert(key, term);
+  if (!known && permuterm_built_)
+    permuterm_->insert(key, term);
+  ++generation_;
+}
 
-  tree.seekg(0);
-  while (tree.good() && size_ != 0) {
-    offset = tree.tellg();
+//! Carga em ordem
+/*! Recebe cada chave secundária uma única vez, em ordem crescente,
+ *  com a lista completa de docids. A lista e a entrada do
+ *  dicionário são escritas no fim do arquivo, sem buscar nada.
+ *  \param char* palavra secundária
+ *  \param vector<size_t> docids em ordem crescente
+ *  \param vector<size_t> frequência da palavra em cada manpage
+ *  \param vector<size_t> tamanho de cada manpage, em palavras
+ *  \param vector<size_t> deslocamento das posições em cada manpage
+ *  \sa bulk_finish(), IndexBuilder
+ */
+void BinaryTreeOfListOnDisk::bulk_insert(const char* key,
+                                         const vector<size_t>& manpages,
+                                         const vector<size_t>& frequencies,
+                                         const vector<size_t>& words,
+                                         const vector<size_t>& positions) {
+  PostingListOnDisk::Term term;
+  postings_->assign(&term, manpages, frequencies, words, positions);
+  dictionary_->bulk_insert(key, term);
+  ++generation_;
+}
 
-    tree.read(node_key, sizeof(TreeNode::key_));
-    compare = strcmp(key, node_key);
+//! Termina carga
+/*! Monta os nodes internos do dicionário depois da última chave.
+ *  \sa bulk_insert()
+ */
+void BinaryTreeOfListOnDisk::bulk_finish() {
+  dictionary_->bulk_finish();
+}
 
-    if (compare != 0) {  // esquerda ou direita
-      current = compare < 0? offset + offset_left : offset + offset_right;
+//! Tira os removidos
+/*! Reescreve dicionário e listas em um arquivo temporário, com carga
+ *  em ordem, deixando de fora as manpages removidas na árvore primária
+ *  e as palavras que ficaram sem nenhuma. O arquivo novo substitui o
+ *  antigo e só vale de novo depois do commit(). As posições não mudam
+ *  de lugar.
+ *  \param KDTreeOnDisk* árvore primária, diz quem foi removido
+ *  \return size_t bytes recuperados
+ *  \sa KDTreeOnDisk::remove()
+ */
+size_t BinaryTreeOfListOnDisk::compact(const KDTreeOnDisk* primary) {
+  PermutermIndex::Terms terms;
+  dictionary_->scan("", &terms);
+
+  PageCache *file = new PageCache("./secondary_tree.tmp");
+  file->truncate();
+  Superblock(MAGIC, VERSION).store(file);
+  BPlusTreeOnDisk<PostingListOnDisk::Term> *dictionary =
+      new BPlusTreeOnDisk<PostingListOnDisk::Term>(file);
+  PostingListOnDisk *postings = new PostingListOnDisk(file,
+                                                      positions_ != nullptr);
+
+  vector<size_t> docs, frequencies, words, positions;
+  for (const pair<string, PostingListOnDisk::Term>& word : terms) {
+    docs.clear();
+    frequencies.clear();
+    words.clear();
+    positions.clear();
+    for (PostingListOnDisk::Cursor cursor(postings_, word.second);
+         cursor.valid(); cursor.next()) {
+      if (primary->removed(cursor.doc()))
+        continue;
+      docs.push_back(cursor.doc());
+      frequencies.push_back(cursor.frequency());
+      words.push_back(primary->words(cursor.doc()));
+      positions.push_back(cursor.positions());
+    }
+    if (docs.empty())
+      continue;
 
-      tree.seekg(current);
-      tree.read(reinterpret_cast<char*>(&next), sizeof(size_t));
+    PostingListOnDisk::Term term;
+    postings->assign(&term, docs, frequencies, words, positions);
+    dictionary->bulk_insert(word.first.c_str(), term);
+  }
+  dictionary->bulk_finish();
+
+  size_t root = dictionary->root(), depth = dictionary->depth(),
+         size = dictionary->size(), before = file_->size(),
+         after = file->size();
+  delete postings;
+  delete dictionary;
+  delete file;
+
+  delete postings_;
+  delete dictionary_;
+  delete file_;
+  if (rename("./secondary_tree.tmp", "./secondary_tree.dat") != 0)
+    throw std::out_of_range("Erro ao trocar arquivo da árvore.");
+  file_ = new PageCache("./secondary_tree.dat");
+  dictionary_ = new BPlusTreeOnDisk<PostingListOnDisk::Term>(file_);
+  dictionary_->restore(root, depth, size);
+  postings_ = new PostingListOnDisk(file_, positions_ != nullptr);
+  ++generation_;
+  return before - after;
+}
 
-      if (next == 0u) // Cheguei em um node nulo
-        break;
+//! Busca por uma chave secundária
+/*! Busca todas as manpage que tenham esta chave secundária, ou alguma
+ *  das palavras que casam com ela se for um curinga.
+ *  \param char* chave secundária, pode ter '*'
+ *  \return LinkedList<size_t> lista dos docids, em ordem crescente
+ *  \throw std::invalid_argument curinga sem nenhuma letra
+ */
+LinkedList<size_t>* BinaryTreeOfListOnDisk::search(const char* wanted) const {
+  Terms terms;
+  vector<size_t> docs;
 
-      tree.seekg(next);
+  expand(wanted, &terms);
+  read(terms, &docs);
 
-    } else { // igual só inserir na list (no começo)
+  return to_list(docs);
+}
 
-      tree.seekg(offset + offset_list_head);
-      tree.read(reinterpret_cast<char*>(&next), sizeof(size_t));
+//! Palavras da chave
+/*! Uma chave sem '*' é procurada direto no dicionário. Com '*' só no
+ *  fim, ou começando por letras e terminando em '*', o dicionário é
+ *  percorrido a partir do prefixo; os outros curingas vão para o
+ *  índice permuterm. Em todos os casos o custo é proporcional às
+ *  palavras que casam, não ao tamanho do dicionário.
+ *  \param string chave ou curinga
+ *  \param Terms* listas das palavras que casam
+ *  \throw std::invalid_argument curinga sem nenhuma letra
+ */
+void BinaryTreeOfListOnDisk::expand(const string& pattern,
+                                    Terms* terms) const {
+  size_t star = pattern.find('*');
+  PostingListOnDisk::Term term;
+
+  if (star == string::npos) {
+    if (dictionary_->find(pattern.c_str(), &term))
+      terms->push_back(term);
+    return;
+  }
 
-      tree.seekp(0, ios::end);
-      aux = tree.tellp();
+  if (pattern.find_first_not_of('*') == string::npos)
+    throw std::invalid_argument("Curinga precisa de pelo menos uma letra.");
+
+  PermutermIndex::Terms found;
+  if (star != 0u && pattern.back() == '*') {
+    dictionary_->scan(pattern.substr(0, star).c_str(), &found);
+    for (const pair<string, PostingListOnDisk::Term>& word : found)
+      if (PermutermIndex::matches(pattern.c_str(), word.first.c_str()))
+        terms->push_back(word.second);
+  } else {
+    // As listas do permuterm podem ser de antes de uma atualização
+    vector<string> words;
+    vector<PostingListOnDisk::Term> current;
+    vector<bool> exists;
+    permuterm_->find(pattern, &found);
+    for (const pair<string, PostingListOnDisk::Term>& word : found)
+      words.push_back(word.first);
+    dictionary_->find(words, &current, &exists);
+    for (size_t i = 0; i < words.size(); ++i)
+      if (exists[i])
+        terms->push_back(current[i]);
+  }
+}
 
-      tree.seekp(offset + offset_list_head);
-      tree.write(reinterpret_cast<char*>(&aux), sizeof(size_t));
+//! União das listas
+/*! Uma lista é lida inteira, várias são intercaladas pelos cursores.
+ *  \param Terms listas
+ *  \param vector<size_t>* documentos em ordem crescente
+ */
+void BinaryTreeOfListOnDisk::read(const Terms& terms,
+                                  vector<size_t>* docs) const {
+  if (terms.size() == 1u) {
+    postings_->read(terms[0], docs);
+    return;
+  }
 
-      ListNode *lnode = new ListNode(manpage, next);
-      tree.seekp(aux);
-      tree.write(reinterpret_cast<char*>(lnode), sizeof(ListNode));
-      delete lnode;
-      break;
-    }
-    ++level;
+  vector<PostingListOnDisk::Cursor> cursors;
+  vector<PostingListOnDisk::Cursor*> pointers;
+  cursors.reserve(terms.size());
+  for (const PostingListOnDisk::Term& term : terms) {
+    cursors.emplace_back(postings_, term);
+    pointers.push_back(&cursors.back());
   }
-  ++level; // Mais um level pro node nulo
+  QueryEvaluator::unite(pointers, docs);
+}
+
+//! Busca conjuntiva
+/*! Busca todas as manpage que tenham ou das duas, ou ambas.
+ *  As duas listas são intercaladas direto do disco, em tempo linear.
+ *  \param char* primeira chave secundária
+ *  \param char* segunda chave secundária
+ *  \return LinkedList<size_t> lista dos docids
+ */
+LinkedList<size_t>* BinaryTreeOfListOnDisk::conjunctive_search(
+                                const char* w1, const char* w2) const {
+  PostingListOnDisk::Term t1, t2;
+  dictionary_->find(w1, &t1);
+  dictionary_->find(w2, &t2);
 
-  if (next == 0) {
-    tree.seekp(0, ios::end); // fim do arquivo
-    next = tree.tellp();      // pega deslocamento pro filho
+  PostingListOnDisk::Cursor c1(postings_, t1), c2(postings_, t2);
+  vector<PostingListOnDisk::Cursor*> cursors{&c1, &c2};
+  vector<size_t> docs;
+  QueryEvaluator::unite(cursors, &docs);
 
-    TreeNode *tnode = new TreeNode(key, next + sizeof(TreeNode));
-    ListNode *lnode = new ListNode(manpage);
-    if (tnode == nullptr || lnode == nullptr)
-      throw std::out_of_range("Full tree!");
+  return to_list(docs);
+}
 
-    if (size_ != 0) {
-      tree.seekp(current);    // modifica o pai
-      tree.write(reinterpret_cast<char*>(&next), sizeof(size_t));
-    }
+//! Busca disjuntiva
+/*! Busca todas as manpage que tenham ambas as chaves.
+ *  A lista mais curta conduz e a outra só tem lidos os blocos que
+ *  podem conter os documentos procurados.
+ *  \param char* primeira chave secundária
+ *  \param char* segunda chave secundária
+ *  \return LinkedList<size_t> lista dos docids
+ */
+LinkedList<size_t>* BinaryTreeOfListOnDisk::disjunctive_search(
+                                const char* w1, const char* w2) const {
+  PostingListOnDisk::Term t1, t2;
+  if (!dictionary_->find(w1, &t1) || !dictionary_->find(w2, &t2))
+    return new LinkedList<size_t>();
 
-    tree.seekp(next);            // adiciona o node
-    tree.write(reinterpret_cast<char*>(tnode), sizeof(TreeNode));
-    tree.write(reinterpret_cast<char*>(lnode), sizeof(ListNode));
-    ++size_;
-    delete tnode;
-    delete lnode;
-  }
+  PostingListOnDisk::Cursor c1(postings_, t1), c2(postings_, t2);
+  vector<PostingListOnDisk::Cursor*> cursors{&c1, &c2};
+  vector<size_t> docs;
+  QueryEvaluator::intersect(cursors, &docs);
 
-  depth_ = level > depth_? level : depth_;
-  tree.close();
+  return to_list(docs);
 }
 
-//! Busca por uma chave secundária
-/*! Busca todas as manpage que tenham esta chave secundária.
- *  \param char* chave secundária
- *  \return LinkedList<size_t> lista dos deslocamentos
+//! Busca booleana
+/*! Executa uma árvore de consulta do QueryParser com AND, OR e NOT em
+ *  qualquer profundidade. Primeiro o planejador consulta o dicionário
+ *  e anota em cada termo quantos documentos o contêm, depois a árvore
+ *  é avaliada do termo mais raro para o mais comum.
+ *  \param QueryNode* raiz da consulta, recebe frequências e custos
+ *  \return LinkedList<size_t> lista dos docids, em ordem crescente
+ *  \throw std::invalid_argument NOT sem termo positivo para restringir
+ *  \sa plan(), evaluate()
  */
-LinkedList<size_t>* BinaryTreeOfListOnDisk::search(const char* wanted) const {
-  // Guardar o deslocamento e nível em uma pilha quando tiver
-  // que descer por dois caminhos diferentes.
-  fstream tree("./secondary_tree.dat", ios::in | ios::out | ios::binary);
-  LinkedList<size_t> *list = new LinkedList<size_t>();
-  char node_key[60];
-  int compare = 1;
-  size_t man_node = -1, offset = 0u, next = 0u, current = 0u, level = 0u,
-         offset_left = sizeof(TreeNode::key_)+4,
-         offset_right = offset_left + sizeof(size_t),
-         offset_list_head = offset_right + sizeof(size_t);
+LinkedList<size_t>* BinaryTreeOfListOnDisk::query(QueryNode* root) const {
+  Plan terms;
+  vector<size_t> docs;
 
-  tree.seekg(0);
-  while (tree.good() && size_ != 0) {
-    offset = tree.tellg();
+  plan(root, &terms);
+  evaluate(root, terms, nullptr, &docs);
 
-    tree.read(node_key, sizeof(TreeNode::key_));
-    compare = strcmp(wanted, node_key);
+  return to_list(docs);
+}
+
+//! Planeja consulta
+/*! Busca cada termo uma única vez no dicionário, guardando sua
+ *  frequência, e estima o tamanho do resultado de cada node: o menor
+ *  operando positivo num AND, frase ou NEAR, a soma dos operandos num
+ *  OR. Os operandos de um AND ficam em ordem crescente de custo com os
+ *  NOT por último.
+ *  \param QueryNode* node a planejar
+ *  \param Plan* termos já buscados
+ *  \throw std::invalid_argument frase ou NEAR sem índice posicional
+ *  \sa evaluate()
+ */
+void BinaryTreeOfListOnDisk::plan(QueryNode* node, Plan* terms) const {
+  if ((node->type_ == QueryNode::PHRASE || node->type_ == QueryNode::NEAR) &&
+      positions_ == nullptr)
+    throw std::invalid_argument(
+        "Frases e NEAR precisam do índice posicional, rode com -p.");
+
+  if (node->type_ == QueryNode::TERM) {
+    auto it = terms->find(node->term_);
+    if (it == terms->end()) {
+      Terms found;
+      expand(node->term_, &found);
+      it = terms->insert(make_pair(node->term_, found)).first;
+    }
+    node->frequency_ = 0u;
+    for (const PostingListOnDisk::Term& term : it->second)
+      node->frequency_ += term.count_;
+    node->cost_ = node->frequency_;
+    return;
+  }
 
-    if (compare != 0) {  // esquerda ou direita
-      current = compare < 0? offset + offset_left : offset + offset_right;
+  for (QueryNode* child : node->children_)
+    plan(child, terms);
+
+  switch (node->type_) {
+    case QueryNode::AND:
+      stable_sort(node->children_.begin(), node->children_.end(),
+                  [](const QueryNode* a, const QueryNode* b) {
+        bool a_not = a->type_ == QueryNode::NOT,
+             b_not = b->type_ == QueryNode::NOT;
+        return a_not != b_not? b_not : a->cost_ < b->cost_;
+      });
+      node->cost_ = node->children_[0]->cost_;
+      break;
 
-      tree.seekg(current);
-      tree.read(reinterpret_cast<char*>(&next), sizeof(size_t));
+    case QueryNode::OR:
+      node->cost_ = 0u;
+      for (QueryNode* child : node->children_)
+        node->cost_ += child->cost_;
+      break;
 
-      if (next == 0u) // Cheguei em um node nulo
-        break;
+    case QueryNode::PHRASE:
+    case QueryNode::NEAR:
+      node->cost_ = node->children_[0]->cost_;
+      for (QueryNode* child : node->children_)
+        node->cost_ = min(node->cost_, child->cost_);
+      break;
 
-      tree.seekg(next);
+    default:
+      node->cost_ = node->children_[0]->cost_;
+      break;
+  }
+}
 
-    } else { // igual tenho que só percorrer a list
+//! Executa consulta
+/*! Com candidatos o resultado fica restrito a eles, e os termos só
+ *  têm lidos os blocos que podem conter algum candidato. Um AND avalia
+ *  o operando mais barato por inteiro e usa o resultado como candidatos
+ *  dos próximos, parando assim que ficar vazio. Um NOT só existe
+ *  restrito aos candidatos, retirando deles o que o operando encontrar.
+ *  \param QueryNode* node planejado
+ *  \param Plan termos buscados pelo planejador
+ *  \param vector<size_t>* candidatos ou nullptr para todos
+ *  \param vector<size_t>* documentos em ordem crescente
+ *  \throw std::invalid_argument NOT sem candidatos
+ *  \sa plan()
+ */
+void BinaryTreeOfListOnDisk::evaluate(const QueryNode* node, const Plan& terms,
+                                      const vector<size_t>* candidates,
+                                      vector<size_t>* out) const {
+  switch (node->type_) {
+    case QueryNode::TERM: {
+      const Terms& found = terms.at(node->term_);
+      if (candidates == nullptr) {
+        read(found, out);
+      } else if (!found.empty()) {
+        vector<PostingListOnDisk::Cursor> cursors;
+        vector<PostingListOnDisk::Cursor*> pointers;
+        cursors.reserve(found.size());
+        for (const PostingListOnDisk::Term& term : found) {
+          cursors.emplace_back(postings_, term);
+          pointers.push_back(&cursors.back());
+        }
+        QueryEvaluator::filter(*candidates, pointers, out);
+      }
+      break;
+    }
 
-      tree.seekg(offset + offset_list_head);
-      tree.read(reinterpret_cast<char*>(&next), sizeof(size_t));
+    case QueryNode::AND: {
+      vector<size_t> current, next;
+      const vector<size_t>* restriction = candidates;
+
+      for (const QueryNode* child : node->children_) {
+        next.clear();
+        evaluate(child, terms, restriction, &next);
+        current.swap(next);
+        restriction = &current;
+        if (current.empty())
+          break;
+      }
+      out->insert(out->end(), current.begin(), current.end());
+      break;
+    }
 
-      while (next != 0) {
-        current = next;
-        tree.seekg(current);
-        tree.read(reinterpret_cast<char*>(&man_node), sizeof(size_t));
-        list->push_front(man_node);
+    case QueryNode::OR: {
+      vector<PostingListOnDisk::Cursor> cursors;
+      vector<size_t> current, partial, next;
+
+      if (candidates == nullptr) {
+        size_t total = 0u;
+        for (const QueryNode* child : node->children_)
+          if (child->type_ == QueryNode::TERM)
+            total += terms.at(child->term_).size();
+        cursors.reserve(total);
+        for (const QueryNode* child : node->children_)
+          if (child->type_ == QueryNode::TERM)
+            for (const PostingListOnDisk::Term& term : terms.at(child->term_))
+              cursors.emplace_back(postings_, term);
+        vector<PostingListOnDisk::Cursor*> pointers;
+        for (PostingListOnDisk::Cursor& cursor : cursors)
+          pointers.push_back(&cursor);
+        QueryEvaluator::unite(pointers, &current);
+      }
 
-        tree.read(reinterpret_cast<char*>(&next), sizeof(size_t));
+      for (const QueryNode* child : node->children_) {
+        if (candidates == nullptr && child->type_ == QueryNode::TERM)
+          continue;
+        if (candidates != nullptr && current.size() == candidates->size())
+          break;  // todos os candidatos já estão no resultado
+
+        partial.clear();
+        next.clear();
+        evaluate(child, terms, candidates, &partial);
+        QueryEvaluator::merge(current, partial, &next);
+        current.swap(next);
       }
+      out->insert(out->end(), current.begin(), current.end());
+      break;
+    }
 
+    case QueryNode::NOT: {
+      if (candidates == nullptr)
+        throw std::invalid_argument(
+            "NOT precisa de um termo positivo junto, ex: a NOT b.");
+
+      vector<size_t> removed;
+      evaluate(node->children_[0], terms, candidates, &removed);
+      QueryEvaluator::subtract(*candidates, removed, out);
       break;
     }
-    ++level;
-  }
 
-  tree.close();
-  return list;
+    case QueryNode::PHRASE:
+    case QueryNode::NEAR:
+      locate(node, terms, candidates, out);
+      break;
+  }
 }
 
-//! Busca conjuntiva
-/*! Busca todas as manpage que tenham ou das duas, ou ambas.
- *  \param char* primeira chave secundária
- *  \param char* segunda chave secundária
- *  \return LinkedList<size_t> lista dos deslocamentos
+//! Frase ou NEAR
+/*! Primeiro a interseção das listas das palavras, só com documentos,
+ *  restrita aos candidatos se houver. Depois as listas são percorridas
+ *  de novo só nos documentos que sobraram e apenas deles as posições
+ *  são lidas e intercaladas.
+ *  \param QueryNode* frase ou NEAR planejado
+ *  \param Plan termos buscados pelo planejador
+ *  \param vector<size_t>* candidatos ou nullptr para todos
+ *  \param vector<size_t>* documentos em ordem crescente
+ *  \sa QueryEvaluator::phrase(), QueryEvaluator::near()
  */
-LinkedList<size_t>* BinaryTreeOfListOnDisk::conjunctive_search(
-                                const char* w1, const char* w2) const {
-  LinkedList<size_t> *s1 = this->search(w1);
-  LinkedList<size_t> *s2 = this->search(w2);
+void BinaryTreeOfListOnDisk::locate(const QueryNode* node, const Plan& terms,
+                                    const vector<size_t>* candidates,
+                                    vector<size_t>* out) const {
+  Terms lists;
+  vector<size_t> offsets, docs, next;
+  for (const QueryNode* child : node->children_) {
+    const Terms& found = terms.at(child->term_);
+    if (found.empty())
+      return;
+    lists.push_back(found[0]);
+    offsets.push_back(child->position_);
+  }
 
-  while (!s2->empty())
-    s1->insert_sorted(s2->pop_front());
+  vector<PostingListOnDisk::Cursor> cursors;
+  vector<PostingListOnDisk::Cursor*> pointers;
+  cursors.reserve(lists.size());
+  for (const PostingListOnDisk::Term& term : lists) {
+    cursors.emplace_back(postings_, term);
+    pointers.push_back(&cursors.back());
+  }
+  if (candidates == nullptr) {
+    QueryEvaluator::intersect(pointers, &docs);
+  } else {
+    docs = *candidates;
+    for (PostingListOnDisk::Cursor* cursor : pointers) {
+      next.clear();
+      QueryEvaluator::filter(docs, cursor, &next);
+      docs.swap(next);
+    }
+  }
+  if (docs.empty())
+    return;
+
+  cursors.clear();
+  for (const PostingListOnDisk::Term& term : lists)
+    cursors.emplace_back(postings_, term);
+
+  vector<vector<uint32_t>> positions(lists.size());
+  for (size_t doc : docs) {
+    for (size_t i = 0; i < cursors.size(); ++i) {
+      cursors[i].seek(doc);
+      positions_->read(cursors[i].positions(), cursors[i].frequency(),
+                       &positions[i]);
+    }
 
-  delete s2;
-  return s1;
+    if (node->type_ == QueryNode::PHRASE?
+        QueryEvaluator::phrase(positions, offsets) :
+        QueryEvaluator::near(positions[0], positions[1], node->distance_))
+      out->push_back(doc);
+  }
 }
 
-//! Busca disjuntiva
-/*! Busca todas as manpage que tenham ambas as chaves.
- *  \param char* primeira chave secundária
- *  \param char* segunda chave secundária
- *  \return LinkedList<size_t> lista dos deslocamentos
+//! Busca ranqueada
+/*! As k manpages de maior pontuação BM25 para as palavras, sem exigir
+ *  que tenham todas. As listas são percorridas juntas, documento a
+ *  documento, e cada documento pontuado é oferecido a um TopK que guarda
+ *  só os k melhores. Curingas entram com cada palavra que casa como um
+ *  termo separado.
+ *  Com o TopK cheio entra a poda do WAND com limites por bloco: com os
+ *  cursores em ordem de documento, o pivô é o primeiro documento em que
+ *  a soma dos limites das listas até ali passa do pior dos k. Os
+ *  documentos antes dele não têm como entrar e são pulados por seek().
+ *  No pivô os limites dos blocos atuais, lidos só dos cabeçalhos, são
+ *  conferidos antes de ler qualquer conteúdo; se não bastarem, os
+ *  cursores saltam para depois do primeiro desses blocos a acabar.
+ *  Só os documentos que ainda podem entrar têm o tamanho lido da
+ *  árvore primária e a pontuação calculada; os removidos são pulados.
+ *  \param vector<string> palavras ou curingas, repetidas contam uma vez
+ *  \param size_t quantidade de resultados
+ *  \param KDTreeOnDisk* árvore primária, tamanhos das manpages
+ *  \param vector<TopK::Result>* manpages, da maior pontuação para a menor
+ *  \throw std::invalid_argument curinga sem nenhuma letra
+ *  \sa Bm25, TopK
  */
-LinkedList<size_t>* BinaryTreeOfListOnDisk::disjunctive_search(
-                                const char* w1, const char* w2) const {
-  LinkedList<size_t> *s1 = search(w1);
-  LinkedList<size_t> *s2 = search(w2);
-  LinkedList<size_t> *list = new LinkedList<size_t>();
+void BinaryTreeOfListOnDisk::top(const vector<string>& words, const size_t k,
+                                 const KDTreeOnDisk* primary,
+                                 vector<TopK::Result>* out) const {
+  Terms terms;
+  unordered_set<string> seen;
+  for (const string& word : words)
+    if (seen.insert(word).second)
+      expand(word, &terms);
+
+  Bm25 scorer(primary->size(), primary->average_words());
+  vector<PostingListOnDisk::Cursor> cursors;
+  vector<double> idfs, bounds;
+  cursors.reserve(terms.size());
+  for (const PostingListOnDisk::Term& term : terms) {
+    cursors.emplace_back(postings_, term);
+    idfs.push_back(scorer.idf(term.count_));
+    bounds.push_back(scorer.bound(term.frequency_, term.ratio_, idfs.back()));
+  }
+
+  // Cursores válidos em ordem de documento, empate pela ordem dos termos
+  auto earlier = [&cursors](size_t a, size_t b) {
+    return cursors[a].doc() != cursors[b].doc()?
+           cursors[a].doc() < cursors[b].doc() : a < b;
+  };
+  auto drop = [&cursors](vector<size_t>* order) {
+    order->erase(remove_if(order->begin(), order->end(), [&cursors](size_t i) {
+      return !cursors[i].valid();
+    }), order->end());
+  };
+
+  vector<size_t> order;
+  for (size_t i = 0; i < cursors.size(); ++i)
+    if (cursors[i].valid())
+      order.push_back(i);
+
+  TopK best(k);
+  while (!order.empty() && k != 0u) {
+    sort(order.begin(), order.end(), earlier);
+    double threshold = best.threshold();
+
+    size_t pivot = 0u;
+    if (best.full()) {
+      double upper = 0.0;
+      for (; pivot < order.size(); ++pivot) {
+        upper += bounds[order[pivot]];
+        if (upper > threshold)
+          break;
+      }
+      if (pivot == order.size())
+        break;  // nem todas as listas juntas passam do pior dos k
+    }
+
+    size_t doc = cursors[order[pivot]].doc();
+    if (cursors[order[0]].doc() < doc) {
+      for (size_t i = 0; i < pivot; ++i)
+        cursors[order[i]].seek(doc);
+      drop(&order);
+      continue;
+    }
+
+    size_t end = pivot + 1;
+    while (end < order.size() && cursors[order[end]].doc() == doc)
+      ++end;
+
+    if (best.full()) {
+      double upper = 0.0;
+      size_t target = end < order.size()? cursors[order[end]].doc() : SIZE_MAX;
+      for (size_t i = 0; i < end; ++i) {
+        const PostingListOnDisk::Cursor& cursor = cursors[order[i]];
+        upper += scorer.bound(cursor.block_frequency(), cursor.block_ratio(),
+                              idfs[order[i]]);
+        target = min(target, cursor.block_last() + 1);
+      }
+      if (upper <= threshold) {
+        for (size_t i = 0; i < end; ++i)
+          cursors[order[i]].seek(target);
+        drop(&order);
+        continue;
+      }
+    }
+
+    if (primary->removed(doc)) {
+      for (size_t i = 0; i < end; ++i)
+        cursors[order[i]].next();
+      drop(&order);
+      continue;
+    }
 
-  size_t aux;
-  while (!s2->empty()) {
-    aux = s2->pop_front();
-    if (s1->contains(aux))
-      list->insert_sorted(aux);
+    size_t length = primary->words(doc);
+    double score = 0.0;
+    for (size_t i = 0; i < end; ++i) {
+      PostingListOnDisk::Cursor& cursor = cursors[order[i]];
+      score += scorer.score(cursor.frequency(), length, idfs[order[i]]);
+      cursor.next();
+    }
+    best.push(doc, score);
+    drop(&order);
   }
+  best.results(out);
+}
 
-  delete s1;
-  delete s2;
+//! Converte para lista
+/*! Monta a LinkedList de retorno a partir do fim, inserindo sempre no
+ *  começo para não percorrer a lista a cada inserção.
+ *  \param vector<size_t> documentos
+ *  \return LinkedList<size_t> lista na mesma ordem
+ */
+LinkedList<size_t>* BinaryTreeOfListOnDisk::to_list(const vector<size_t>& docs) {
+  LinkedList<size_t> *list = new LinkedList<size_t>();
+  for (auto it = docs.rbegin(); it != docs.rend(); ++it)
+    list->push_front(*it);
   return list;
 }
 
+//! Índice reaproveitado
+/*! Retorna se a árvore foi reaberta do disco em vez de recriada.
+ *  \return bool teste
+ */
+bool BinaryTreeOfListOnDisk::reopened() const {
+  return reopened_;
+}
+
+//! Índice posicional
+/*! \return PositionsOnDisk* posições, nullptr se o índice não é posicional
+ */
+PositionsOnDisk* BinaryTreeOfListOnDisk::positions() const {
+  return positions_;
+}
+
 //! Teste de vazio
 /*! Retorna o teste se a árvore da lista
  *  \return  bool teste
  */
 bool BinaryTreeOfListOnDisk::empty() const {
-  return size_ == 0u;
+  return dictionary_->empty();
 }
 
 //! Tamanho da árvore
-/*! Retorna a quantidade de nodes na árvore
+/*! Retorna a quantidade de chaves na árvore
  *  \return size_t tamanho
  */
 size_t BinaryTreeOfListOnDisk::size() const {
-  return size_;
+  return dictionary_->size();
 }
 
 //! Profundidade da árvore
-/*! Retorna a profundidade de nodes na árvore
+/*! Retorna a profundidade da árvore, páginas lidas por busca
  *  \return size_t profundidade
  */
 size_t BinaryTreeOfListOnDisk::depth() const {
-  return depth_;
+  return dictionary_->depth();
+}
+
+//! Geração
+/*! Contador que muda a cada inserção ou compactação, para quem guarda
+ *  resultados de buscas saber que eles não valem mais.
+ *  \return uint64_t geração atual
+ */
+uint64_t BinaryTreeOfListOnDisk::generation() const {
+  return generation_;
 }
 
 //! Tamanho do arquivo da árvore
@@ -355,10 +941,17 @@ size_t BinaryTreeOfListOnDisk::depth() const {
  *  \return Tamanho
  */
 size_t BinaryTreeOfListOnDisk::file_size() const {
-  struct stat st;
-  if (stat("./secondary_tree.dat", &st) != 0)
-    throw std::out_of_range("Erro ao verificar tamanho do arquivo.");
-  return st.st_size;
+  return file_->size();
+}
+
+//! Tamanho do índice de curingas
+/*! Retorna o tamanho do permuterm.dat, montado no primeiro commit()
+ *  e mantido por insert() depois disso.
+ *  \return Tamanho
+ *  \sa commit(), insert()
+ */
+size_t BinaryTreeOfListOnDisk::permuterm_size() const {
+  return permuterm_->file_size();
 }
 
 }  //  namespace structures
@@ -0,0 +1,217 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_BM25_H
+#define STRUCTURES_BM25_H
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+namespace structures {
+
+//! Classe Bm25
+/*! Pontuação BM25 de uma palavra em um documento. Palavras raras valem
+ *  mais (idf), repetir a palavra ajuda cada vez menos (k1) e documentos
+ *  maiores que a média são penalizados (b).
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class Bm25 {
+ public:
+  static constexpr double K1 = 1.2;  //!< Saturação da frequência
+  static constexpr double B = 0.75;  //!< Peso do tamanho do documento
+
+  Bm25(const size_t documents, const double average);  // Construtor
+  ~Bm25();  // Destrutor
+
+  double idf(const size_t frequency) const;  // Peso da palavra
+  double score(const size_t frequency, const size_t length,
+               const double idf) const;  // Pontuação no documento
+  double bound(const size_t frequency, const size_t ratio,
+               const double idf) const;  // Limite da pontuação
+
+ private:
+  size_t documents_;  //!< Documentos indexados
+  double average_;  //!< Tamanho médio, em palavras
+};
+
+//! Classe TopK
+/*! Os k melhores documentos vistos até agora, em um heap de mínimo
+ *  limitado a k: o pior dos k fica no topo e só sai quando chega um
+ *  melhor. O resultado completo nunca é montado nem ordenado.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class TopK {
+ public:
+  //! Classe Result
+  /*! Documento e pontuação.
+   *
+   *  \author João Vicente Souto.
+   *  \since 20/06/17
+   *  \version 1.0
+   */
+  class Result {
+   public:
+    size_t doc_{0u};  //!< Documento
+    double score_{0.0};  //!< Pontuação
+  };
+
+  explicit TopK(const size_t k);  // Construtor
+  ~TopK();  // Destrutor
+
+  void push(const size_t doc, const double score);  // Oferece documento
+  bool full() const;  // Já tem k documentos
+  double threshold() const;  // Pontuação do pior dos k
+  void results(vector<Result>* out);  // Melhores primeiro
+
+ private:
+  static bool better(const Result& a, const Result& b);  // Ordem
+
+  size_t k_;  //!< Quantidade de documentos
+  vector<Result> heap_;  //!< Pior no topo
+};
+
+//! Construtor
+/*! Com parâmetros, estatísticas da coleção.
+ *  \param size_t quantidade de documentos
+ *  \param double tamanho médio dos documentos, em palavras
+ *  \sa ~Bm25()
+ */
+Bm25::Bm25(const size_t documents, const double average) :
+documents_{documents},
+average_{average > 0.0? average : 1.0}
+{}
+
+//! Destrutor
+/*! Destrutor padrão.
+ *  \sa Bm25()
+ */
+Bm25::~Bm25() {}
+
+//! Peso da palavra
+/*! Variante sempre positiva: ln(1 + (N - n + 0.5) / (n + 0.5)).
+ *  \param size_t documentos que têm a palavra
+ *  \return double idf
+ */
+double Bm25::idf(const size_t frequency) const {
+  double n = static_cast<double>(frequency),
+         total = static_cast<double>(documents_ > frequency?
+                                     documents_ : frequency);
+  return log(1.0 + (total - n + 0.5) / (n + 0.5));
+}
+
+//! Pontuação no documento
+/*! \param size_t vezes que a palavra aparece no documento
+ *  \param size_t tamanho do documento, em palavras
+ *  \param double idf da palavra
+ *  \return double pontuação
+ */
+double Bm25::score(const size_t frequency, const size_t length,
+                   const double idf) const {
+  double tf = static_cast<double>(frequency),
+         norm = K1 * (1.0 - B + B * static_cast<double>(length) / average_);
+  return idf * tf * (K1 + 1.0) / (tf + norm);
+}
+
+//! Limite da pontuação
+/*! Dividindo por tf, a pontuação fica
+ *  idf (k1 + 1) / (1 + k1 (1 - b) / tf + k1 b (tamanho / tf) / média),
+ *  que cresce com a frequência e cai com a razão tamanho / frequência.
+ *  A maior frequência e a menor razão de um grupo de documentos limitam
+ *  a pontuação de todos eles, mesmo vindo de documentos diferentes.
+ *  Uma folga relativa cobre o arredondamento de somas feitas em outra
+ *  ordem.
+ *  \param size_t maior frequência do grupo
+ *  \param size_t menor tamanho / frequência do grupo
+ *  \param double idf da palavra
+ *  \return double pontuação que nenhum documento do grupo passa
+ */
+double Bm25::bound(const size_t frequency, const size_t ratio,
+                   const double idf) const {
+  double tf = static_cast<double>(frequency != 0u? frequency : 1u),
+         norm = 1.0 + K1 * (1.0 - B) / tf +
+                K1 * B * static_cast<double>(ratio) / average_;
+  return idf * (K1 + 1.0) / norm * (1.0 + 1e-9);
+}
+
+//! Construtor
+/*! Com parâmetros, quantos documentos guardar.
+ *  \param size_t k
+ *  \sa ~TopK()
+ */
+TopK::TopK(const size_t k) :
+k_{k}
+{
+  heap_.reserve(k);
+}
+
+//! Destrutor
+/*! Destrutor padrão.
+ *  \sa TopK()
+ */
+TopK::~TopK() {}
+
+//! Ordem
+/*! Maior pontuação primeiro, empate pelo menor documento.
+ *  \param Result a
+ *  \param Result b
+ *  \return bool se a é melhor que b
+ */
+bool TopK::better(const Result& a, const Result& b) {
+  return a.score_ != b.score_? a.score_ > b.score_ : a.doc_ < b.doc_;
+}
+
+//! Oferece documento
+/*! Entra se ainda há lugar ou se é melhor que o pior guardado.
+ *  \param size_t documento
+ *  \param double pontuação
+ */
+void TopK::push(const size_t doc, const double score) {
+  Result result;
+  result.doc_ = doc;
+  result.score_ = score;
+
+  if (heap_.size() < k_) {
+    heap_.push_back(result);
+    push_heap(heap_.begin(), heap_.end(), better);
+  } else if (k_ != 0u && better(result, heap_.front())) {
+    pop_heap(heap_.begin(), heap_.end(), better);
+    heap_.back() = result;
+    push_heap(heap_.begin(), heap_.end(), better);
+  }
+}
+
+//! Já tem k documentos
+/*! \return bool se um documento novo precisa passar de threshold()
+ */
+bool TopK::full() const {
+  return heap_.size() >= k_;
+}
+
+//! Pontuação do pior dos k
+/*! \return double pontuação mínima para entrar, 0 se ainda há lugar
+ */
+double TopK::threshold() const {
+  return full() && !heap_.empty()? heap_.front().score_ : 0.0;
+}
+
+//! Melhores primeiro
+/*! Esvazia o heap.
+ *  \param vector<Result>* documentos, do melhor para o pior
+ */
+void TopK::results(vector<Result>* out) {
+  sort_heap(heap_.begin(), heap_.end(), better);
+  out->insert(out->end(), heap_.begin(), heap_.end());
+  heap_.clear();
+}
+
+}  //  namespace structures
+
+#endif
@@ -0,0 +1,114 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_BOUNDED_QUEUE_H
+#define STRUCTURES_BOUNDED_QUEUE_H
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+namespace structures {
+
+//! Classe BoundedQueue
+/*! Fila de capacidade limitada para ligar threads de estágios
+ *  diferentes. Quem insere espera enquanto a fila está cheia, quem
+ *  retira espera enquanto está vazia. Depois de close() as inserções
+ *  são descartadas e pop() devolve false quando a fila esvazia.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+template<typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(const size_t capacity);  // Construtor
+  ~BoundedQueue();  // Destrutor
+
+  bool push(T&& data);  // Insere, esperando espaço
+  bool pop(T* data);  // Retira, esperando dado
+  void close();  // Fecha a fila
+
+ private:
+  deque<T> contents_;  //!< Dados
+  size_t capacity_;  //!< Tamanho máximo
+  bool closed_{false};  //!< Fila fechada
+  mutex mutex_;  //!< Exclusão mútua
+  condition_variable not_full_,  //!< Há espaço
+                     not_empty_;  //!< Há dado ou a fila fechou
+};
+
+//! Construtor
+/*! Com parâmetros, capacidade máxima.
+ *  \param size_t capacidade
+ *  \sa ~BoundedQueue()
+ */
+template<typename T>
+BoundedQueue<T>::BoundedQueue(const size_t capacity) :
+capacity_{capacity == 0u? 1u : capacity}
+{}
+
+//! Destrutor
+/*! Destrutor padrão.
+ *  \sa BoundedQueue()
+ */
+template<typename T>
+BoundedQueue<T>::~BoundedQueue() {}
+
+//! Insere
+/*! Espera haver espaço e insere no fim.
+ *  \param T dado, movido para a fila
+ *  \return bool false se a fila foi fechada
+ *  \sa pop()
+ */
+template<typename T>
+bool BoundedQueue<T>::push(T&& data) {
+  unique_lock<mutex> lock(mutex_);
+  not_full_.wait(lock, [this] {
+    return closed_ || contents_.size() < capacity_;
+  });
+  if (closed_)
+    return false;
+
+  contents_.push_back(std::move(data));
+  not_empty_.notify_one();
+  return true;
+}
+
+//! Retira
+/*! Espera haver dado e retira do início.
+ *  \param T* destino
+ *  \return bool false se a fila foi fechada e está vazia
+ *  \sa push()
+ */
+template<typename T>
+bool BoundedQueue<T>::pop(T* data) {
+  unique_lock<mutex> lock(mutex_);
+  not_empty_.wait(lock, [this] {
+    return closed_ || !contents_.empty();
+  });
+  if (contents_.empty())
+    return false;
+
+  *data = std::move(contents_.front());
+  contents_.pop_front();
+  not_full_.notify_one();
+  return true;
+}
+
+//! Fecha a fila
+/*! Acorda todos que estão esperando.
+ */
+template<typename T>
+void BoundedQueue<T>::close() {
+  lock_guard<mutex> lock(mutex_);
+  closed_ = true;
+  not_full_.notify_all();
+  not_empty_.notify_all();
+}
+
+}  //  namespace structures
+
+#endif
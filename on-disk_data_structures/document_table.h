@@ -0,0 +1,306 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_DOCUMENT_TABLE_H
+#define STRUCTURES_DOCUMENT_TABLE_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "./page_cache.h"
+#include "./mapped_file.h"
+#include "./superblock.h"
+
+using namespace std;
+
+namespace structures {
+
+//! Classe DocumentTable
+/*! Tabela de documentos, documents.dat. Cada manpage indexada recebe
+ *  um docid, 1, 2, 3... na ordem de inserção, e ocupa uma entrada de
+ *  tamanho fixo na posição do seu docid, então achar um documento é
+ *  uma conta e não uma busca. As listas das chaves secundárias guardam
+ *  docids, pequenos e densos, em vez de deslocamentos em arquivo.
+ *  O docid 0 não existe e serve de "nenhum documento".
+ *
+ *  A entrada aponta para o registro no arquivo de dados e guarda os
+ *  tamanhos do nome e do conteúdo, o tamanho em palavras usado pelo
+ *  ranking e se a manpage foi removida. Depois de confirmada a tabela
+ *  é lida pelo mapeamento; vários docids em ordem crescente são lidos
+ *  em uma passada só pelo arquivo (read() com vector).
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class DocumentTable {
+ public:
+  DocumentTable();  // Construtor
+  explicit DocumentTable(const uint64_t fingerprint);  // Reabre tabela
+  ~DocumentTable();  // Destrutor
+
+  static const uint64_t MAGIC = 0x31424154434f444dull;  //!< "MDOCTAB1"
+  static const uint32_t VERSION = 1u;  //!< Versão do formato
+
+  //! Classe Document
+  /*! Entrada da tabela.
+   *
+   *  \author João Vicente Souto.
+   *  \since 20/06/17
+   *  \version 1.0
+   */
+  class Document {
+   public:
+    uint64_t record_{0u},  //!< Registro no arquivo de dados
+             length_{0u};  //!< Tamanho do conteúdo
+    uint32_t name_{0u},  //!< Tamanho do nome
+             words_{0u},  //!< Tamanho em palavras indexadas
+             removed_{0u},  //!< Manpage removida
+             reserved_{0u};  //!< Alinhamento
+  };
+
+  size_t append(const Document& document);  // Acrescenta documento
+  Document at(const size_t doc) const;  // Lê documento
+  void read(const vector<size_t>& docs,
+            vector<Document>* out) const;  // Lê vários documentos
+  void write(const size_t doc, const Document& document);  // Regrava
+
+  void commit(const uint64_t fingerprint);  // Grava superbloco
+  void share();  // Leitura por várias threads
+
+  bool reopened() const;  // Tabela reaproveitada
+  bool contains(const size_t doc) const;  // Docid existe
+  size_t size() const;  // Quantidade de documentos
+  size_t file_size() const;  // Tamanho do arquivo
+
+ private:
+  static const size_t CACHE_PAGES = 64u;  //!< Páginas em memória
+
+  void create();  // Recria arquivo vazio
+  void map();  // Passa para somente leitura
+  void unmap();  // Volta a ler pelo cache
+  static size_t offset(const size_t doc);  // Posição da entrada
+
+  PageCache *file_{nullptr};  //!< Arquivo da tabela
+  MappedFile *map_{nullptr};  //!< Mapeamento, depois de confirmada
+  size_t size_{0u};  //!< Quantidade de documentos
+  bool reopened_{false};  //!< Tabela lida do disco
+};
+
+//! Construtor
+/*! Sem parâmetros, limpa o arquivo da tabela.
+ *  \sa DocumentTable(const uint64_t fingerprint), ~DocumentTable()
+ */
+DocumentTable::DocumentTable() {
+  file_ = new PageCache("./documents.dat", CACHE_PAGES);
+  create();
+}
+
+//! Construtor
+/*! Reabre a tabela gravada em disco se o superbloco corresponder às
+ *  entradas, senão limpa o arquivo como o construtor padrão.
+ *  \param uint64_t impressão digital das entradas
+ *  \sa DocumentTable(), reopened()
+ */
+DocumentTable::DocumentTable(const uint64_t fingerprint) {
+  file_ = new PageCache("./documents.dat", CACHE_PAGES);
+
+  Superblock block;
+  if (block.load(file_) && block.matches(MAGIC, VERSION, fingerprint)) {
+    size_ = block.size_;
+    reopened_ = true;
+    map();
+  } else {
+    create();
+  }
+}
+
+//! Destrutor
+/*! Fecha o arquivo, escrevendo o que estiver pendente.
+ *  \sa DocumentTable()
+ */
+DocumentTable::~DocumentTable() {
+  delete map_;
+  delete file_;
+}
+
+//! Recria arquivo
+/*! Esvazia o arquivo, deixando apenas um superbloco ainda não
+ *  confirmado.
+ *  \sa commit()
+ */
+void DocumentTable::create() {
+  unmap();
+  file_->truncate();
+  Superblock(MAGIC, VERSION).store(file_);
+  size_ = 0u;
+  reopened_ = false;
+}
+
+//! Confirma tabela
+/*! Grava o superbloco com a impressão digital das entradas, escreve
+ *  as páginas pendentes e mapeia o arquivo.
+ *  \param uint64_t impressão digital das entradas
+ *  \sa DocumentTable(const uint64_t fingerprint)
+ */
+void DocumentTable::commit(const uint64_t fingerprint) {
+  Superblock block(MAGIC, VERSION);
+  block.fingerprint_ = fingerprint;
+  block.size_ = size_;
+  block.store(file_);
+  file_->flush();
+  map();
+}
+
+//! Leitura por várias threads
+/*! Depois de confirmada a tabela é lida pelo mapeamento, sem estado
+ *  compartilhado; o cache só é usado se a tabela mudar.
+ *  \sa commit(), PageCache::share()
+ */
+void DocumentTable::share() {
+  file_->share();
+}
+
+//! Acrescenta documento
+/*! \param Document entrada do documento novo
+ *  \return size_t docid do documento
+ *  \throw std::out_of_range docids de 32 bits esgotados
+ */
+size_t DocumentTable::append(const Document& document) {
+  if (size_ >= INT32_MAX)
+    throw std::out_of_range("Documentos demais para a tabela.");
+
+  unmap();
+  ++size_;
+  file_->write(offset(size_), &document, sizeof(Document));
+  return size_;
+}
+
+//! Lê documento
+/*! \param size_t docid
+ *  \return Document entrada do documento
+ *  \throw std::out_of_range docid que não está na tabela
+ */
+DocumentTable::Document DocumentTable::at(const size_t doc) const {
+  if (!contains(doc))
+    throw std::out_of_range("Documento fora da tabela.");
+
+  Document out;
+  if (map_ != nullptr)
+    memcpy(&out, map_->at(offset(doc), sizeof(Document)), sizeof(Document));
+  else
+    file_->read(offset(doc), &out, sizeof(Document));
+  return out;
+}
+
+//! Lê vários documentos
+/*! Com os docids em ordem crescente as entradas são lidas em uma
+ *  passada pelo arquivo, cada página uma vez.
+ *  \param vector<size_t> docids em ordem crescente
+ *  \param vector<Document>* entradas, na ordem dos docids
+ *  \throw std::out_of_range docid que não está na tabela
+ *  \sa at()
+ */
+void DocumentTable::read(const vector<size_t>& docs,
+                         vector<Document>* out) const {
+  out->resize(docs.size());
+  if (docs.empty())
+    return;
+  if (!contains(docs.front()) || !contains(docs.back()))
+    throw std::out_of_range("Documento fora da tabela.");
+
+  if (map_ != nullptr) {
+    for (size_t i = 0; i < docs.size(); ++i)
+      memcpy(&(*out)[i], map_->at(offset(docs[i]), sizeof(Document)),
+             sizeof(Document));
+    return;
+  }
+
+  // Sem mapeamento, lê o trecho de uma vez se ele for denso
+  size_t span = docs.back() - docs.front() + 1;
+  if (span > 4u * docs.size()) {
+    for (size_t i = 0; i < docs.size(); ++i)
+      (*out)[i] = at(docs[i]);
+    return;
+  }
+  vector<Document> all(span);
+  file_->read(offset(docs.front()), all.data(), span * sizeof(Document));
+  for (size_t i = 0; i < docs.size(); ++i)
+    (*out)[i] = all[docs[i] - docs.front()];
+}
+
+//! Regrava documento
+/*! \param size_t docid
+ *  \param Document nova entrada
+ *  \throw std::out_of_range docid que não está na tabela
+ */
+void DocumentTable::write(const size_t doc, const Document& document) {
+  if (!contains(doc))
+    throw std::out_of_range("Documento fora da tabela.");
+
+  unmap();
+  file_->write(offset(doc), &document, sizeof(Document));
+}
+
+//! Somente leitura
+/*! Mapeia o arquivo já escrito no disco.
+ *  \sa unmap()
+ */
+void DocumentTable::map() {
+  delete map_;
+  map_ = new MappedFile("./documents.dat");
+}
+
+//! Volta a ler pelo cache
+/*! Depois de uma mudança o mapeamento não vê o que ainda está no
+ *  cache de páginas, então as leituras voltam para o cache até o
+ *  próximo commit().
+ *  \sa map()
+ */
+void DocumentTable::unmap() {
+  delete map_;
+  map_ = nullptr;
+}
+
+//! Posição da entrada
+/*! \param size_t docid
+ *  \return size_t deslocamento da entrada no arquivo
+ */
+size_t DocumentTable::offset(const size_t doc) {
+  return sizeof(Superblock) + (doc - 1) * sizeof(Document);
+}
+
+//! Tabela reaproveitada
+/*! Retorna se a tabela foi reaberta do disco em vez de recriada.
+ *  \return bool teste
+ */
+bool DocumentTable::reopened() const {
+  return reopened_;
+}
+
+//! Docid existe
+/*! \param size_t docid
+ *  \return bool se o docid está na tabela
+ */
+bool DocumentTable::contains(const size_t doc) const {
+  return doc != 0u && doc <= size_;
+}
+
+//! Quantidade de documentos
+/*! Conta também os removidos, cujos docids continuam ocupados.
+ *  \return size_t maior docid
+ */
+size_t DocumentTable::size() const {
+  return size_;
+}
+
+//! Tamanho do arquivo
+/*! \return size_t tamanho em bytes
+ */
+size_t DocumentTable::file_size() const {
+  return file_->size();
+}
+
+}  //  namespace structures
+
+#endif
@@ -0,0 +1,374 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_INDEX_BUILDER_H
+#define STRUCTURES_INDEX_BUILDER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+
+#include "./binary_tree_of_lists_on_disk.h"
+
+using namespace std;
+
+namespace structures {
+
+//! Classe IndexBuilder
+/*! Construção do arquivo invertido em memória externa.
+ *  Os pares (palavra, manpage), com a frequência da palavra e o tamanho
+ *  da manpage, são juntados em um buffer de tamanho limitado. Quando o
+ *  buffer enche ele é ordenado e gravado em sequência em um arquivo
+ *  temporário (uma corrida). No final as corridas são intercaladas
+ *  (k-way merge) e cada palavra sai uma única vez, com todas as suas
+ *  manpages, direto para a carga em ordem da árvore secundária. Todo o
+ *  acesso a disco é sequencial. Com o índice posicional cada par leva
+ *  também onde ficaram as suas posições.
+ *  Numa atualização (update()) a árvore já existe e as manpages novas
+ *  são acrescentadas no fim das listas de cada palavra.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class IndexBuilder {
+ public:
+  static const size_t DEFAULT_MEMORY = 64u << 20;  //!< Tamanho do buffer
+
+  explicit IndexBuilder(const size_t memory = DEFAULT_MEMORY);  // Construtor
+  ~IndexBuilder();  // Destrutor
+
+  void add(const char* key, const size_t manpage,
+           const size_t frequency = 1u, const size_t words = 0u,
+           const size_t positions = 0u);  // Acrescenta par
+  void finish(BinaryTreeOfListOnDisk* tree);  // Grava árvore secundária
+  void update(BinaryTreeOfListOnDisk* tree);  // Acrescenta na árvore
+
+ private:
+  //! Classe Pair
+  /*! Par do buffer, a palavra fica no texto do buffer.
+   *
+   *  \author João Vicente Souto.
+   *  \since 20/06/17
+   *  \version 1.0
+   */
+  class Pair {
+   public:
+    uint32_t key_,  //!< Início da palavra em text_
+             frequency_,  //!< Vezes que a palavra aparece
+             words_;  //!< Tamanho da manpage, em palavras
+    uint64_t doc_,  //!< Docid da manpage
+             positions_;  //!< Deslocamento das posições, 0 se não houver
+  };
+
+  //! Classe Run
+  /*! Leitor sequencial de uma corrida gravada.
+   *
+   *  \author João Vicente Souto.
+   *  \since 20/06/17
+   *  \version 1.0
+   */
+  class Run {
+   public:
+    explicit Run(const string& path);  // Abre corrida
+    bool next();  // Lê próximo par
+
+    ifstream file_;  //!< Arquivo da corrida
+    string key_;  //!< Palavra atual
+    uint64_t doc_{0u},  //!< Docid da manpage atual
+             positions_{0u};  //!< Posições atuais
+    uint32_t frequency_{0u},  //!< Frequência atual
+             words_{0u};  //!< Tamanho da manpage atual
+  };
+
+  void sort_buffer();  // Ordena buffer
+  void spill();  // Grava corrida
+  void drain(BinaryTreeOfListOnDisk* tree);  // Intercala tudo
+  void emit(BinaryTreeOfListOnDisk* tree, const char* key,
+            const size_t manpage, const size_t frequency,
+            const size_t words,
+            const size_t positions);  // Junta manpages da palavra
+  void flush(BinaryTreeOfListOnDisk* tree);  // Grava palavra acumulada
+  void reset();  // Esvazia palavra acumulada
+  void discard();  // Descarta pares
+
+  size_t memory_;  //!< Limite do buffer em bytes
+  vector<char> text_;  //!< Palavras do buffer
+  vector<Pair> pairs_;  //!< Pares do buffer
+  vector<string> runs_;  //!< Caminhos das corridas
+  bool merge_{false};  //!< Acrescenta em árvore já confirmada
+  string key_;  //!< Palavra sendo acumulada
+  vector<size_t> docs_,  //!< Manpages da palavra acumulada
+                 frequencies_,  //!< Frequência em cada manpage
+                 words_,  //!< Tamanho de cada manpage
+                 positions_;  //!< Posições em cada manpage
+};
+
+//! Construtor
+/*! Com parâmetros, memória disponível para o buffer.
+ *  \param size_t limite do buffer em bytes
+ *  \sa ~IndexBuilder()
+ */
+IndexBuilder::IndexBuilder(const size_t memory) :
+memory_{memory}
+{}
+
+//! Destrutor
+/*! Apaga as corridas que ainda existirem.
+ *  \sa IndexBuilder()
+ */
+IndexBuilder::~IndexBuilder() {
+  for (const string& path : runs_)
+    remove(path.c_str());
+}
+
+//! Acrescenta par
+/*! Guarda o par no buffer, gravando uma corrida se ele encher.
+ *  \param char* palavra
+ *  \param size_t docid da manpage
+ *  \param size_t vezes que a palavra aparece na manpage
+ *  \param size_t tamanho da manpage em palavras, 0 se desconhecido
+ *  \param size_t deslocamento das posições, 0 se não houver
+ *  \sa finish()
+ */
+void IndexBuilder::add(const char* key, const size_t manpage,
+                       const size_t frequency, const size_t words,
+                       const size_t positions) {
+  size_t length = strlen(key);
+  if (text_.size() + length + 1 > UINT32_MAX ||
+      text_.size() + length + 1 + (pairs_.size() + 1) * sizeof(Pair) > memory_)
+    spill();
+
+  Pair pair;
+  pair.key_ = text_.size();
+  pair.frequency_ = frequency < UINT32_MAX? frequency : UINT32_MAX;
+  pair.words_ = words < UINT32_MAX? words : UINT32_MAX;
+  pair.doc_ = manpage;
+  pair.positions_ = positions;
+  text_.insert(text_.end(), key, key + length);
+  text_.push_back('\0');
+  pairs_.push_back(pair);
+}
+
+//! Ordena buffer
+/*! Ordena os pares por palavra e depois por manpage.
+ */
+void IndexBuilder::sort_buffer() {
+  const char *text = text_.data();
+  sort(pairs_.begin(), pairs_.end(), [text](const Pair& a, const Pair& b) {
+    int compare = strcmp(text + a.key_, text + b.key_);
+    return compare != 0? compare < 0 : a.doc_ < b.doc_;
+  });
+}
+
+//! Grava corrida
+/*! Ordena o buffer e grava os pares em sequência em um arquivo
+ *  temporário, esvaziando o buffer.
+ *  \sa Run
+ */
+void IndexBuilder::spill() {
+  if (pairs_.empty())
+    return;
+
+  sort_buffer();
+  string path = "./secondary_run_" + to_string(runs_.size()) + ".tmp";
+  ofstream file(path.c_str(), ios::out | ios::binary | ios::trunc);
+  if (!file)
+    throw std::out_of_range("Erro ao criar arquivo temporário.");
+  runs_.push_back(path);
+
+  for (const Pair& pair : pairs_) {
+    const char *key = text_.data() + pair.key_;
+    file.write(key, strlen(key) + 1);
+    file.write(reinterpret_cast<const char*>(&pair.doc_),
+               sizeof(pair.doc_));
+    file.write(reinterpret_cast<const char*>(&pair.frequency_),
+               sizeof(pair.frequency_));
+    file.write(reinterpret_cast<const char*>(&pair.words_),
+               sizeof(pair.words_));
+    file.write(reinterpret_cast<const char*>(&pair.positions_),
+               sizeof(pair.positions_));
+  }
+  if (!file)
+    throw std::out_of_range("Erro ao gravar arquivo temporário.");
+
+  text_.clear();
+  pairs_.clear();
+}
+
+//! Grava árvore secundária
+/*! Carga em ordem de todas as palavras na árvore vazia.
+ *  \param BinaryTreeOfListOnDisk* árvore vazia
+ *  \sa add(), update()
+ */
+void IndexBuilder::finish(BinaryTreeOfListOnDisk* tree) {
+  merge_ = false;
+  drain(tree);
+  tree->bulk_finish();
+}
+
+//! Acrescenta na árvore
+/*! Cada palavra é buscada uma vez e recebe todas as suas manpages
+ *  novas, que devem ter docids maiores que os já indexados.
+ *  \param BinaryTreeOfListOnDisk* árvore já confirmada
+ *  \sa finish()
+ */
+void IndexBuilder::update(BinaryTreeOfListOnDisk* tree) {
+  merge_ = true;
+  drain(tree);
+}
+
+//! Intercala tudo
+/*! Sem corridas o buffer ordenado vai direto para a árvore, senão o
+ *  resto do buffer vira mais uma corrida e todas são intercaladas com
+ *  um heap, lendo cada uma do início ao fim uma única vez. Se der erro
+ *  no meio os pares que faltavam são descartados e o construtor volta
+ *  vazio.
+ *  \param BinaryTreeOfListOnDisk* árvore
+ *  \sa finish(), update()
+ */
+void IndexBuilder::drain(BinaryTreeOfListOnDisk* tree) {
+  reset();
+
+  try {
+    if (runs_.empty()) {
+      sort_buffer();
+      for (const Pair& pair : pairs_)
+        emit(tree, text_.data() + pair.key_, pair.doc_, pair.frequency_,
+             pair.words_, pair.positions_);
+    } else {
+      spill();
+
+      vector<unique_ptr<Run>> readers;
+      for (const string& path : runs_)
+        readers.emplace_back(new Run(path));
+
+      auto later = [](const Run* a, const Run* b) {
+        int compare = a->key_.compare(b->key_);
+        return compare != 0? compare > 0 : a->doc_ > b->doc_;
+      };
+
+      vector<Run*> heap;
+      for (const unique_ptr<Run>& run : readers)
+        if (run->next())
+          heap.push_back(run.get());
+      make_heap(heap.begin(), heap.end(), later);
+
+      while (!heap.empty()) {
+        pop_heap(heap.begin(), heap.end(), later);
+        Run *run = heap.back();
+        emit(tree, run->key_.c_str(), run->doc_, run->frequency_,
+             run->words_, run->positions_);
+
+        if (run->next())
+          push_heap(heap.begin(), heap.end(), later);
+        else
+          heap.pop_back();
+      }
+    }
+
+    flush(tree);
+  } catch (...) {
+    reset();
+    discard();
+    throw;
+  }
+
+  discard();
+}
+
+//! Esvazia palavra acumulada
+/*! \sa emit(), flush()
+ */
+void IndexBuilder::reset() {
+  key_.clear();
+  docs_.clear();
+  frequencies_.clear();
+  words_.clear();
+  positions_.clear();
+}
+
+//! Descarta pares
+/*! Esvazia o buffer e apaga as corridas.
+ *  \sa drain()
+ */
+void IndexBuilder::discard() {
+  text_.clear();
+  pairs_.clear();
+  for (const string& path : runs_)
+    remove(path.c_str());
+  runs_.clear();
+}
+
+//! Junta manpages da palavra
+/*! Os pares chegam ordenados, quando a palavra muda a anterior está
+ *  completa e é gravada.
+ *  \param BinaryTreeOfListOnDisk* árvore
+ *  \param char* palavra
+ *  \param size_t manpage
+ *  \param size_t frequência na manpage
+ *  \param size_t tamanho da manpage
+ *  \param size_t deslocamento das posições
+ *  \throw std::out_of_range mesma palavra duas vezes na mesma manpage
+ */
+void IndexBuilder::emit(BinaryTreeOfListOnDisk* tree, const char* key,
+                        const size_t manpage, const size_t frequency,
+                        const size_t words, const size_t positions) {
+  if (key_ != key) {
+    flush(tree);
+    key_ = key;
+  }
+  if (!docs_.empty() && docs_.back() == manpage)
+    throw std::out_of_range("Palavra repetida na mesma manpage.");
+  docs_.push_back(manpage);
+  frequencies_.push_back(frequency);
+  words_.push_back(words);
+  positions_.push_back(positions);
+}
+
+//! Grava palavra acumulada
+/*! \param BinaryTreeOfListOnDisk* árvore
+ */
+void IndexBuilder::flush(BinaryTreeOfListOnDisk* tree) {
+  if (docs_.empty())
+    return;
+  if (merge_)
+    tree->insert(key_.c_str(), docs_, frequencies_, words_, positions_);
+  else
+    tree->bulk_insert(key_.c_str(), docs_, frequencies_, words_, positions_);
+  docs_.clear();
+  frequencies_.clear();
+  words_.clear();
+  positions_.clear();
+}
+
+//! Abre corrida
+/*! \param string caminho da corrida
+ */
+IndexBuilder::Run::Run(const string& path) :
+file_{path.c_str(), ios::in | ios::binary}
+{
+  if (!file_)
+    throw std::out_of_range("Erro ao abrir arquivo temporário.");
+}
+
+//! Lê próximo par
+/*! \return bool se havia mais um par
+ */
+bool IndexBuilder::Run::next() {
+  if (!getline(file_, key_, '\0'))
+    return false;
+  file_.read(reinterpret_cast<char*>(&doc_), sizeof(doc_));
+  file_.read(reinterpret_cast<char*>(&frequency_), sizeof(frequency_));
+  file_.read(reinterpret_cast<char*>(&words_), sizeof(words_));
+  file_.read(reinterpret_cast<char*>(&positions_), sizeof(positions_));
+  return static_cast<bool>(file_);
+}
+
+}  //  namespace structures
+
+#endif
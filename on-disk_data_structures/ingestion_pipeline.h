@@ -0,0 +1,372 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_INGESTION_PIPELINE_H
+#define STRUCTURES_INGESTION_PIPELINE_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <exception>
+#include <fstream>
+#include <sys/stat.h>
+
+#include "./structures/linked_list.h"
+#include "./bounded_queue.h"
+#include "./kd_tree_on_disk.h"
+#include "./index_builder.h"
+#include "./positions_on_disk.h"
+#include "./word_handler.h"
+
+using namespace std;
+
+namespace structures {
+
+//! Classe IngestionPipeline
+/*! Indexação em estágios ligados por filas limitadas:
+ *  threads leitoras carregam os arquivos, um conjunto de threads
+ *  separa as palavras, cada uma com o seu WordHandler, e uma única
+ *  escritora, a thread que chamou run(), é dona dos arquivos de índice.
+ *  Cada manpage leva um número de sequência e a escritora as reordena,
+ *  então o resultado é o mesmo da indexação em uma thread.
+ *  Com um único núcleo os estágios rodam em sequência na própria
+ *  thread que chamou, sem filas. Com o índice posicional as threads de
+ *  palavras também guardam as posições, que a escritora grava.
+ *  O docid de cada manpage fica guardado na ordem dos caminhos, para
+ *  o manifesto das atualizações.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class IngestionPipeline {
+ public:
+  static const size_t QUEUE_SIZE = 64u;  //!< Manpages em cada fila
+
+  IngestionPipeline(const size_t readers = 0u,
+                    const size_t tokenizers = 0u);  // Construtor
+  ~IngestionPipeline();  // Destrutor
+
+  void run(const vector<string>& paths, KDTreeOnDisk* primary,
+           IndexBuilder* secondary,
+           PositionsOnDisk* positions = nullptr);  // Indexa arquivos
+
+  size_t documents() const;  // Manpages indexadas
+  size_t words() const;  // Palavras indexadas
+  const vector<size_t>& docs() const;  // Docid de cada caminho
+
+ private:
+  //! Classe Document
+  /*! Manpage passando pelos estágios.
+   *
+   *  \author João Vicente Souto.
+   *  \since 20/06/17
+   *  \version 1.0
+   */
+  class Document {
+   public:
+    size_t sequence_{0u};  //!< Posição na entrada
+    string path_;  //!< Caminho do arquivo
+    vector<char> text_;  //!< Conteúdo
+    WordHandler::Words *words_{nullptr};  //!< Palavras e frequências
+  };
+
+  void load(const string& path, Document* document) const;  // Lê arquivo
+  void read(const vector<string>* paths);  // Estágio leitor
+  void tokenize();  // Estágio de palavras
+  void write(const size_t total, KDTreeOnDisk* primary,
+             IndexBuilder* secondary);  // Estágio escritor
+  void store(Document* document, WordHandler* handler, KDTreeOnDisk* primary,
+             IndexBuilder* secondary);  // Indexa uma manpage
+  void fail();  // Guarda erro e para tudo
+
+  size_t readers_,  //!< Threads leitoras
+         tokenizers_;  //!< Threads de palavras
+  bool inline_;  //!< Sem threads, um único núcleo
+  BoundedQueue<Document> *loaded_{nullptr},  //!< Leitura -> palavras
+                         *tokenized_{nullptr};  //!< Palavras -> escrita
+  atomic<size_t> next_{0u},  //!< Próximo arquivo a ler
+                 reading_{0u},  //!< Leitoras ainda ativas
+                 tokenizing_{0u};  //!< Threads de palavras ainda ativas
+  atomic<bool> failed_{false};  //!< Algum estágio falhou
+  PositionsOnDisk *positions_{nullptr};  //!< Índice posicional, se houver
+  exception_ptr error_;  //!< Primeiro erro
+  mutex error_mutex_;  //!< Protege error_
+  size_t documents_{0u},  //!< Manpages indexadas
+         words_{0u};  //!< Palavras indexadas
+  vector<size_t> docs_;  //!< Docid de cada caminho, 0 se repetido
+};
+
+//! Construtor
+/*! Com parâmetros, quantidade de threads de cada estágio. Zero usa
+ *  uma leitora e uma thread de palavras por núcleo, e nenhuma thread
+ *  se só houver um núcleo.
+ *  \param size_t threads leitoras
+ *  \param size_t threads de palavras
+ *  \sa ~IngestionPipeline()
+ */
+IngestionPipeline::IngestionPipeline(const size_t readers,
+                                     const size_t tokenizers) :
+readers_{readers},
+tokenizers_{tokenizers}
+{
+  size_t cores = thread::hardware_concurrency();
+  if (cores == 0u)
+    cores = 1u;
+  inline_ = readers_ == 0u && tokenizers_ == 0u && cores == 1u;
+  if (readers_ == 0u)
+    readers_ = 1u;
+  if (tokenizers_ == 0u)
+    tokenizers_ = cores;
+}
+
+//! Destrutor
+/*! Destrutor padrão, as filas só existem durante run().
+ *  \sa IngestionPipeline()
+ */
+IngestionPipeline::~IngestionPipeline() {}
+
+//! Indexa arquivos
+/*! Dispara os estágios e fica com a escrita. A ordem de inserção na
+ *  árvore primária é a ordem de paths.
+ *  \param vector<string> caminhos dos arquivos, na ordem de inserção
+ *  \param KDTreeOnDisk* árvore primária
+ *  \param IndexBuilder* construtor da árvore secundária
+ *  \param PositionsOnDisk* índice posicional, nulo se não houver
+ *  \throw primeiro erro de qualquer estágio
+ */
+void IngestionPipeline::run(const vector<string>& paths,
+                            KDTreeOnDisk* primary, IndexBuilder* secondary,
+                            PositionsOnDisk* positions) {
+  documents_ = words_ = 0u;
+  positions_ = positions;
+  docs_.assign(paths.size(), 0u);
+  if (inline_) {
+    WordHandler handler;
+    Document document;
+    for (size_t i = 0; i < paths.size(); ++i) {
+      document.sequence_ = i;
+      load(paths[i], &document);
+      document.words_ = handler.treatment(document.text_.data(),
+                                          document.text_.size() - 1,
+                                          positions_ != nullptr);
+      store(&document, &handler, primary, secondary);
+    }
+    return;
+  }
+
+  BoundedQueue<Document> loaded(QUEUE_SIZE), tokenized(QUEUE_SIZE);
+  loaded_ = &loaded;
+  tokenized_ = &tokenized;
+  next_ = 0u;
+  reading_ = readers_;
+  tokenizing_ = tokenizers_;
+  failed_ = false;
+  error_ = nullptr;
+
+  vector<thread> threads;
+  for (size_t i = 0; i < readers_; ++i)
+    threads.emplace_back(&IngestionPipeline::read, this, &paths);
+  for (size_t i = 0; i < tokenizers_; ++i)
+    threads.emplace_back(&IngestionPipeline::tokenize, this);
+
+  try {
+    write(paths.size(), primary, secondary);
+  } catch (...) {
+    fail();
+  }
+
+  for (thread& worker : threads)
+    worker.join();
+
+  // Manpages que ficaram nas filas depois de um erro
+  Document document;
+  while (loaded.pop(&document)) {}
+  while (tokenized.pop(&document))
+    delete document.words_;
+
+  loaded_ = tokenized_ = nullptr;
+  if (error_)
+    rethrow_exception(error_);
+}
+
+//! Lê arquivo
+/*! Carrega o arquivo inteiro, com um '\0' a mais no fim.
+ *  \param string caminho
+ *  \param Document* destino
+ */
+void IngestionPipeline::load(const string& path, Document* document) const {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    throw std::out_of_range("Erro ao verificar tamanho do arquivo.");
+
+  ifstream file(path.c_str(), ios::in | ios::binary);
+  document->path_ = path;
+  document->text_.resize(st.st_size + 1);
+  file.read(document->text_.data(), st.st_size);
+  document->text_[st.st_size] = '\0';
+}
+
+//! Estágio leitor
+/*! Pega o próximo caminho e carrega o arquivo inteiro.
+ *  \param vector<string>* caminhos
+ */
+void IngestionPipeline::read(const vector<string>* paths) {
+  try {
+    size_t index;
+    while (!failed_ && (index = next_++) < paths->size()) {
+      Document document;
+      document.sequence_ = index;
+      load((*paths)[index], &document);
+
+      if (!loaded_->push(std::move(document)))
+        break;
+    }
+  } catch (...) {
+    fail();
+  }
+
+  if (--reading_ == 0u)
+    loaded_->close();
+}
+
+//! Estágio de palavras
+/*! Separa as palavras de cada manpage com um WordHandler próprio.
+ */
+void IngestionPipeline::tokenize() {
+  try {
+    WordHandler handler;
+    Document document;
+
+    while (loaded_->pop(&document)) {
+      document.words_ = handler.treatment(document.text_.data(),
+                                          document.text_.size() - 1,
+                                          positions_ != nullptr);
+      if (!tokenized_->push(std::move(document))) {
+        delete document.words_;
+        break;
+      }
+    }
+  } catch (...) {
+    fail();
+  }
+
+  if (--tokenizing_ == 0u)
+    tokenized_->close();
+}
+
+//! Estágio escritor
+/*! Recebe as manpages fora de ordem e guarda as adiantadas até chegar
+ *  a vez delas. Insere cada uma na árvore primária e entrega as
+ *  palavras para o construtor da árvore secundária.
+ *  \param size_t quantidade de arquivos
+ *  \param KDTreeOnDisk* árvore primária
+ *  \param IndexBuilder* construtor da árvore secundária
+ */
+void IngestionPipeline::write(const size_t total, KDTreeOnDisk* primary,
+                              IndexBuilder* secondary) {
+  WordHandler handler;
+  map<size_t, Document> waiting;
+  Document document;
+  size_t expected = 0u;
+
+  while (expected < total && tokenized_->pop(&document)) {
+    size_t sequence = document.sequence_;
+    waiting[sequence] = std::move(document);
+
+    for (auto it = waiting.begin();
+         it != waiting.end() && it->first == expected;
+         it = waiting.erase(it), ++expected)
+      store(&it->second, &handler, primary, secondary);
+  }
+
+  for (auto& entry : waiting)
+    delete entry.second.words_;
+  if (expected < total && !failed_)
+    throw std::out_of_range("Manpage perdida na indexação.");
+}
+
+//! Indexa uma manpage
+/*! Insere o texto na árvore primária, com a quantidade de palavras
+ *  indexadas para o BM25, e entrega as palavras e frequências para o
+ *  construtor da árvore secundária, com onde ficaram as posições se o
+ *  índice for posicional. Uma manpage que já estava na árvore não vai
+ *  para as listas. O último byte do texto vira '\0', como sempre foi
+ *  gravado.
+ *  \param Document* manpage já separada em palavras, perde as palavras
+ *  \param WordHandler* tratador, para a chave primária
+ *  \param KDTreeOnDisk* árvore primária
+ *  \param IndexBuilder* construtor da árvore secundária
+ */
+void IngestionPipeline::store(Document* document, WordHandler* handler,
+                              KDTreeOnDisk* primary, IndexBuilder* secondary) {
+  size_t size = document->text_.size() - 1;
+  if (size != 0u)
+    document->text_[size - 1] = '\0';
+
+  vector<WordHandler::Word> words;
+  size_t length = 0u;
+  while (!document->words_->empty()) {
+    words.push_back(document->words_->pop_front());
+    length += words.back().frequency_;
+  }
+
+  string name = handler->clean_primary_key(document->path_);
+  int doc = primary->insert(name.c_str(), size, document->text_.data(),
+                            length);
+  delete document->words_;
+  document->words_ = nullptr;
+  if (doc < 0)
+    return;
+  docs_[document->sequence_] = doc;
+  ++documents_;
+  words_ += words.size();
+
+  for (const WordHandler::Word& word : words) {
+    size_t where = positions_? positions_->write(word.positions_) : 0u;
+    secondary->add(word.text_.c_str(), doc, word.frequency_, length, where);
+  }
+}
+
+//! Guarda erro
+/*! O primeiro erro é guardado para run() e as filas são fechadas para
+ *  que todos os estágios terminem.
+ */
+void IngestionPipeline::fail() {
+  {
+    lock_guard<mutex> lock(error_mutex_);
+    if (!error_)
+      error_ = current_exception();
+  }
+  failed_ = true;
+  loaded_->close();
+  tokenized_->close();
+}
+
+//! Manpages indexadas
+/*! \return size_t manpages da última execução
+ */
+size_t IngestionPipeline::documents() const {
+  return documents_;
+}
+
+//! Palavras indexadas
+/*! \return size_t soma das palavras distintas de cada manpage
+ */
+size_t IngestionPipeline::words() const {
+  return words_;
+}
+
+//! Docid de cada caminho
+/*! \return vector<size_t> docid de cada caminho da última execução, na
+ *          ordem de paths, 0 se a manpage já estava na árvore
+ */
+const vector<size_t>& IngestionPipeline::docs() const {
+  return docs_;
+}
+
+}  //  namespace structures
+
+#endif
@@ -0,0 +1,223 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_IO_STATS_H
+#define STRUCTURES_IO_STATS_H
+
+#include <cstdint>
+#include <atomic>
+#include <unordered_set>
+
+using namespace std;
+
+namespace structures {
+
+//! Classe IOStats
+/*! Contadores de entrada e saída dos arquivos de índice. O PageCache
+ *  conta as aberturas, as chamadas de leitura e escrita e seus bytes e
+ *  cada página acessada, do quadro ou do disco; o MappedFile conta as
+ *  páginas acessadas pelo mapeamento, que não fazem chamada de sistema.
+ *
+ *  Os totais valem para o processo inteiro, somando todas as threads.
+ *  Para medir uma operação, como uma busca ou uma inserção, basta criar
+ *  um Scope antes dela: ele conta só o que a sua thread fizer enquanto
+ *  existir, inclusive quantas páginas distintas foram tocadas. Fora de
+ *  um Scope páginas distintas não são contadas; no total, pages_ é a
+ *  soma das páginas distintas de cada operação medida.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class IOStats {
+ public:
+  //! Classe Counters
+  /*! Valores dos contadores.
+   *
+   *  \author João Vicente Souto.
+   *  \since 20/06/17
+   *  \version 1.0
+   */
+  class Counters {
+   public:
+    uint64_t opens_{0u},  //!< Arquivos abertos
+             reads_{0u},  //!< Chamadas pread() e preadv()
+             writes_{0u},  //!< Chamadas pwrite()
+             bytes_read_{0u},  //!< Bytes lidos do disco
+             bytes_written_{0u},  //!< Bytes escritos no disco
+             accesses_{0u},  //!< Páginas acessadas, com repetição
+             pages_{0u};  //!< Páginas distintas por operação
+  };
+
+  //! Classe Scope
+  /*! Mede uma operação da thread atual, do construtor ao destrutor.
+   *  Pode ser aninhado: o que o interno mede também entra no externo.
+   *
+   *  \author João Vicente Souto.
+   *  \since 20/06/17
+   *  \version 1.0
+   */
+  class Scope {
+   public:
+    Scope();  // Construtor
+    ~Scope();  // Destrutor
+
+    Counters counters() const;  // Contado até agora
+
+   private:
+    friend class IOStats;
+
+    Scope *parent_;  //!< Scope externo da thread, se houver
+    Counters counters_;  //!< Contadores da operação
+    unordered_set<uint64_t> pages_;  //!< Arquivo e página tocados
+  };
+
+  static uint64_t identify();  // Número de um arquivo novo
+  static void open();  // Conta abertura
+  static void read(const size_t bytes);  // Conta leitura
+  static void write(const size_t bytes);  // Conta escrita
+  static void touch(const uint64_t file, const size_t page);  // Conta página
+  static Counters total();  // Totais do processo
+
+ private:
+  static Scope*& current();  // Scope da thread atual
+
+  static atomic<uint64_t> files_,  //!< Arquivos numerados
+                          opens_,  //!< Total de aberturas
+                          reads_,  //!< Total de leituras
+                          writes_,  //!< Total de escritas
+                          bytes_read_,  //!< Total de bytes lidos
+                          bytes_written_,  //!< Total de bytes escritos
+                          accesses_,  //!< Total de acessos a páginas
+                          pages_;  //!< Soma das páginas distintas
+};
+
+atomic<uint64_t> IOStats::files_{0u};
+atomic<uint64_t> IOStats::opens_{0u};
+atomic<uint64_t> IOStats::reads_{0u};
+atomic<uint64_t> IOStats::writes_{0u};
+atomic<uint64_t> IOStats::bytes_read_{0u};
+atomic<uint64_t> IOStats::bytes_written_{0u};
+atomic<uint64_t> IOStats::accesses_{0u};
+atomic<uint64_t> IOStats::pages_{0u};
+
+//! Construtor
+/*! Começa a medir na thread atual.
+ *  \sa ~Scope()
+ */
+IOStats::Scope::Scope() :
+parent_{current()}
+{
+  current() = this;
+}
+
+//! Destrutor
+/*! Para de medir e passa o que foi medido para o Scope externo, ou
+ *  soma as páginas distintas no total se este for o externo.
+ *  \sa Scope()
+ */
+IOStats::Scope::~Scope() {
+  current() = parent_;
+  if (parent_ == nullptr) {
+    IOStats::pages_ += pages_.size();
+    return;
+  }
+
+  Counters& outer = parent_->counters_;
+  outer.opens_ += counters_.opens_;
+  outer.reads_ += counters_.reads_;
+  outer.writes_ += counters_.writes_;
+  outer.bytes_read_ += counters_.bytes_read_;
+  outer.bytes_written_ += counters_.bytes_written_;
+  outer.accesses_ += counters_.accesses_;
+  parent_->pages_.insert(pages_.begin(), pages_.end());
+  outer.pages_ = parent_->pages_.size();
+}
+
+//! Contado até agora
+/*! \return Counters da operação, pages_ são as páginas distintas
+ */
+IOStats::Counters IOStats::Scope::counters() const {
+  return counters_;
+}
+
+//! Número de um arquivo novo
+/*! Cada PageCache e MappedFile recebe o seu, para as páginas de
+ *  arquivos diferentes não se confundirem.
+ *  \return uint64_t número
+ */
+uint64_t IOStats::identify() {
+  return files_++;
+}
+
+//! Conta abertura
+/*! Um open() de arquivo de índice.
+ */
+void IOStats::open() {
+  opens_.fetch_add(1u, memory_order_relaxed);
+  if (Scope *scope = current())
+    ++scope->counters_.opens_;
+}
+
+//! Conta leitura
+/*! \param size_t bytes lidos pela chamada
+ */
+void IOStats::read(const size_t bytes) {
+  reads_.fetch_add(1u, memory_order_relaxed);
+  bytes_read_.fetch_add(bytes, memory_order_relaxed);
+  if (Scope *scope = current()) {
+    ++scope->counters_.reads_;
+    scope->counters_.bytes_read_ += bytes;
+  }
+}
+
+//! Conta escrita
+/*! \param size_t bytes escritos pela chamada
+ */
+void IOStats::write(const size_t bytes) {
+  writes_.fetch_add(1u, memory_order_relaxed);
+  bytes_written_.fetch_add(bytes, memory_order_relaxed);
+  if (Scope *scope = current()) {
+    ++scope->counters_.writes_;
+    scope->counters_.bytes_written_ += bytes;
+  }
+}
+
+//! Conta página
+/*! Acesso a uma página, esteja ela na memória ou não.
+ *  \param uint64_t número do arquivo, de identify()
+ *  \param size_t número da página no arquivo
+ */
+void IOStats::touch(const uint64_t file, const size_t page) {
+  accesses_.fetch_add(1u, memory_order_relaxed);
+  if (Scope *scope = current()) {
+    ++scope->counters_.accesses_;
+    if (scope->pages_.insert(file << 40 | page).second)
+      ++scope->counters_.pages_;
+  }
+}
+
+//! Totais do processo
+/*! \return Counters somando todas as threads
+ */
+IOStats::Counters IOStats::total() {
+  Counters out;
+  out.opens_ = opens_;
+  out.reads_ = reads_;
+  out.writes_ = writes_;
+  out.bytes_read_ = bytes_read_;
+  out.bytes_written_ = bytes_written_;
+  out.accesses_ = accesses_;
+  out.pages_ = pages_;
+  return out;
+}
+
+//! Scope da thread atual
+/*! \return Scope*& o mais interno, nullptr se nenhum
+ */
+IOStats::Scope*& IOStats::current() {
+  thread_local Scope *scope = nullptr;
+  return scope;
+}
+
+}  //  namespace structures
+
+#endif
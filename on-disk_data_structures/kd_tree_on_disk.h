@@ -2,14 +2,20 @@
 #ifndef STRUCTURES_KD_TREE_H
 #define STRUCTURES_KD_TREE_H
 
+#include <algorithm>
 #include <cstdint>
+#include <cstddef>
+#include <cstring>
 #include <stdexcept>
-#include <fstream>
-#include <cstdio>
-#include <sys/stat.h>
+#include <string>
+#include <vector>
 
-#include "./structures/linked_list.h"
-#include "./structures/linked_stack.h"
+#include "./page_cache.h"
+#include "./superblock.h"
+#include "./manpage_heap.h"
+#include "./mapped_file.h"
+#include "./name_index.h"
+#include "./document_table.h"
 
 using namespace std;
 
@@ -18,6 +24,21 @@ namespace structures {
 //! Classe KDTreeOnDisk
 /*! Árvore KD sendo a chave primária o nome do arquivo e a chave
  *  secundária o tamanho do árquivo para melhorar a distribuição.
+ *  O texto das manpages fica no arquivo de dados (ManpageHeap), cada
+ *  node guarda só o começo do nome e o tamanho, assim vários nodes
+ *  cabem em uma página. O n-ésimo node é a manpage de docid n, cuja
+ *  entrada na tabela de documentos (DocumentTable) aponta o registro;
+ *  o nome inteiro fica no registro e só é lido quando o começo não
+ *  basta: nomes menores que PREFIX cabem inteiros no node.
+ *  Depois de confirmada a árvore é somente leitura: o arquivo da árvore
+ *  e o de dados ficam mapeados em memória e as buscas não fazem
+ *  chamadas de sistema nem cópias do texto.
+ *  A busca só pelo nome não usa a árvore, que nos níveis de tamanho
+ *  teria que descer pelos dois lados, e sim o NameIndex mantido junto.
+ *  Manpages podem ser acrescentadas e removidas depois da confirmação:
+ *  a remoção só marca o documento, o node continua guiando a descida,
+ *  e as buscas deixam os marcados de fora. A compactação recupera o
+ *  espaço dos textos removidos no arquivo de dados.
  *
  *  \author João Vicente Souto.
  *  \since 20/06/17
@@ -26,23 +47,46 @@ namespace structures {
 class KDTreeOnDisk {
 public:
   KDTreeOnDisk();  // Construtor
+  explicit KDTreeOnDisk(const uint64_t fingerprint);  // Reabre índice
   ~KDTreeOnDisk();  // Destrutor
 
-  int insert(const char* primary, const size_t secondary, char* manpage);  // Inserir
-  //void remove(const char* primary, const size_t secondary, char* manpage);
+  static const uint64_t MAGIC = 0x3145455254444b4dull;  //!< "MKDTREE1"
+  static const uint32_t VERSION = 6u;  //!< Versão do formato
 
+  int insert(const char* primary, const size_t secondary, char* manpage,
+             const size_t words = 0u);  // Inserir
+  void remove(const size_t doc);  // Marca manpage removida
+  bool removed(const size_t doc) const;  // Manpage removida
+  size_t garbage() const;  // Percentual de textos removidos
+  size_t compact();  // Recupera espaço dos removidos
+
+  void commit(const uint64_t fingerprint);  // Grava superbloco
+  void share();  // Leitura por várias threads
+
+  bool reopened() const;  // Índice reaproveitado
   bool empty() const;  // Teste de vazio
-  size_t size() const;  // Tamanho da árvore
+  size_t size() const;  // Manpages na árvore
   size_t depth() const;  // Profundidade da árvore
+  uint64_t generation() const;  // Muda a cada alteração
   size_t file_size() const;  // Tamanho do arquivo da árvore
-
-  char* search_primary_key(const char* wanted);  // Procura manpage
-  string return_primary_key(const size_t wanted);  // Procura nome da mapage
-  LinkedList<string>* return_primary_key(LinkedList<size_t> *wanted_list);  // Procura nomes das mapages
+  size_t data_size() const;  // Tamanho do arquivo de dados
+  size_t names_size() const;  // Tamanho do índice de nomes
+  size_t names_depth() const;  // Páginas por busca de nome
+  size_t documents_size() const;  // Tamanho da tabela de documentos
+  size_t words(const size_t doc) const;  // Tamanho de uma manpage
+  double average_words() const;  // Tamanho médio das manpages
+
+  ManpageHeap::View search_primary_key(const char* wanted) const;  // Procura manpage
+  vector<ManpageHeap::View> search_primary_key(
+      const vector<string>& wanted) const;  // Procura várias manpages
+  string return_primary_key(const size_t wanted) const;  // Procura nome da mapage
+  vector<string> return_primary_key(const vector<size_t>& wanted) const;  // Procura nomes das mapages
   //LinkedList<string>* search_secondary_key(const size_t wanted) const;
 
 
 private:
+  static const size_t PREFIX = 16u;  //!< Começo do nome guardado no node
+
   //! Classe Node
   /*! Node da árvore
    *
@@ -53,8 +97,8 @@ private:
   class Node {
   public:
     //! Construtor
-    /*! Sem parâmetros, carrega palavras ignoradas de arquivo em disco.
-     *  \sa Node(const char* primary, const size_t secondary, char* manpage), ~Node()
+    /*! Sem parâmetros.
+     *  \sa Node(const char* primary, const size_t secondary), ~Node()
      */
     Node() {}
 
@@ -62,304 +106,481 @@ private:
     /*! Com parâmetros, dados basicos de um node
      *  \sa Node(), ~Node()
      */
-    Node(const char* primary, const size_t secondary, char* manpage) {
-      strcpy(primary_, primary);
+    Node(const char* primary, const size_t secondary) {
+      size_t length = strlen(primary);
+      memcpy(prefix_, primary, length < PREFIX? length : PREFIX);
       secondary_ = secondary;
-      strcpy(manpage_, manpage);
     }
 
     //! Destrutor
     /*! Destrutor padrão, não tem nada alocado dinâmicamente.
-     *  \sa Node(const char* primary, const size_t secondary, char* manpage), Node()
+     *  \sa Node(const char* primary, const size_t secondary), Node()
      */
     ~Node() {}
 
-    //! Tamanho do node
-    /*! Tamanho real do node que será escrito no arquivo
-     * \return size_t tamanho real do node
-     */
-    size_t size() {
-      size_t aux = sizeof(primary_) + sizeof(secondary_)
-                   + sizeof(left_) + sizeof(right_) + secondary_ + 10;
-      return aux;
-    }
-
-    char primary_[50]{"@"};  //!< Chave primária
+    char prefix_[PREFIX]{};  //!< Começo da chave primária, sem '\0' se cheio
     size_t secondary_{0u},  //!< Chave secundária
            left_{0u},  //!< Node da esquerda
            right_{0u};  //!< Node da direita
-    char manpage_[139718]{"&"};  //!< Manpage
-  };
-
-  //! Classe Route
-  /*! Objeto auxiliar para percorrer a árvore
-   *
-   *  \author João Vicente Souto.
-   *  \since 20/06/17
-   *  \version 1.0
-   */
-  class Route {
-  public:
-    //! Construtor
-    /*! Sem parâmetros.
-     *  \sa Route(const size_t offset, const size_t level), ~Route()
-     */
-    Route() {}
-
-    //! Construtor
-    /*! Com parâmetros, dados basicos da route
-     *  \sa Route(), ~Route()
-     */
-    Route(const size_t offset, const size_t level) :
-    offset_tree_{offset},
-    level_{level}
-    {}
-
-    //! Destrutor
-    /*! Destrutor padrão, não tem nada alocado dinâmicamente.
-     *  \sa Node(const char* primary, const size_t secondary, char* manpage), Node()
-     */
-    ~Route() {}
-
-    //! Sobreescrita do operador =
-    /*! Recebe um Route para copiar
-     *  \param Route copiado
-     *  \return Route this
-     */
-    Route& operator=(const Route& other) {
-        if (this != &other) {
-            this->offset_tree_ = other.offset_tree_;
-            this->level_ = other.level_;
-        }
-        return *this;
-    }
-
-    size_t offset_tree_{0u},  //!< Deslocamento na árvore
-           level_{0u};  //!< Level do deslocamento
   };
 
+  void create();  // Recria arquivo vazio
+  void map();  // Passa para somente leitura
+  void unmap();  // Volta a ler pelo cache
+  void read(const size_t offset, void* data, const size_t length) const;  // Lê trecho
+  int compare_primary(const char* primary, const Node& node,
+                      const size_t doc) const;  // Compara nome
+  string primary(const size_t doc,
+                 const DocumentTable::Document& document) const;  // Nome
+  static size_t node_of(const size_t doc);  // Node do docid
+  static size_t doc_of(const size_t offset);  // Docid do node
+
+  PageCache *file_{nullptr};  //!< Arquivo da árvore
+  MappedFile *map_{nullptr};  //!< Mapeamento, depois de confirmada
+  ManpageHeap *data_{nullptr};  //!< Arquivo de dados
+  NameIndex *names_{nullptr};  //!< Nome -> docid
+  DocumentTable *docs_{nullptr};  //!< Docid -> registro e tamanhos
   size_t depth_{0u},  //!< Profundidade
-         size_{0u};  //!< Quantidade de nodes
+         size_{0u},  //!< Quantidade de nodes
+         removed_{0u},  //!< Nodes de manpages removidas
+         root_{0u},  //!< Deslocamento da raiz
+         words_{0u};  //!< Soma dos tamanhos das manpages vivas
+  uint64_t generation_{0u};  //!< Alterações desde que foi aberta
+  bool reopened_{false};  //!< Índice lido do disco
 };
 
 //! Construtor
 /*! Sem parâmetros, limpa arquivo da arvore
- *  \sa ~KDTreeOnDisk()
+ *  \sa KDTreeOnDisk(const uint64_t fingerprint), ~KDTreeOnDisk()
  */
 KDTreeOnDisk::KDTreeOnDisk() {
-  // Cria arquivo para a arvore ou sobreescreve um existente
-  fstream tree("./primary_tree.dat", ios::in | ios::out | ios::binary | ios::trunc);
-  tree.close();
+  file_ = new PageCache("./primary_tree.dat");
+  data_ = new ManpageHeap();
+  names_ = new NameIndex();
+  docs_ = new DocumentTable();
+  create();
+}
+
+//! Construtor
+/*! Reabre a árvore gravada em disco se o superbloco corresponder às
+ *  entradas, senão limpa o arquivo como o construtor padrão.
+ *  \param uint64_t impressão digital das entradas
+ *  \sa KDTreeOnDisk(), reopened()
+ */
+KDTreeOnDisk::KDTreeOnDisk(const uint64_t fingerprint) {
+  file_ = new PageCache("./primary_tree.dat");
+  data_ = new ManpageHeap(fingerprint);
+  names_ = new NameIndex(fingerprint);
+  docs_ = new DocumentTable(fingerprint);
+
+  Superblock block;
+  if (block.load(file_) && block.matches(MAGIC, VERSION, fingerprint) &&
+      data_->reopened() && names_->reopened() && docs_->reopened()) {
+    root_ = block.root_;
+    size_ = block.size_;
+    removed_ = block.removed_;
+    depth_ = block.depth_;
+    words_ = block.total_;
+    reopened_ = true;
+    map();
+  } else {
+    delete data_;
+    delete names_;
+    delete docs_;
+    data_ = new ManpageHeap();
+    names_ = new NameIndex();
+    docs_ = new DocumentTable();
+    create();
+  }
+}
+
+//! Recria arquivo
+/*! Esvazia o arquivo da árvore, deixando apenas um superbloco ainda
+ *  não confirmado.
+ *  \sa commit()
+ */
+void KDTreeOnDisk::create() {
+  delete map_;
+  map_ = nullptr;
+  file_->truncate();
+  Superblock(MAGIC, VERSION).store(file_);
+  root_ = size_ = removed_ = depth_ = words_ = 0u;
+  reopened_ = false;
+  ++generation_;
+}
+
+//! Confirma árvore
+/*! Grava o superbloco com a impressão digital das entradas e escreve
+ *  as páginas pendentes, a partir daqui o arquivo pode ser reaberto
+ *  sem reindexar.
+ *  \param uint64_t impressão digital das entradas
+ *  \sa KDTreeOnDisk(const uint64_t fingerprint)
+ */
+void KDTreeOnDisk::commit(const uint64_t fingerprint) {
+  Superblock block(MAGIC, VERSION);
+  block.fingerprint_ = fingerprint;
+  block.root_ = root_;
+  block.size_ = size_;
+  block.removed_ = removed_;
+  block.depth_ = depth_;
+  block.total_ = words_;
+  block.store(file_);
+  file_->flush();
+  data_->commit(fingerprint);
+  names_->commit(fingerprint);
+  docs_->commit(fingerprint);
+  map();
+}
+
+//! Leitura por várias threads
+/*! Depois de confirmada a árvore é lida pelo mapeamento; o arquivo de
+ *  dados, o índice de nomes e a tabela de documentos passam a aceitar
+ *  várias threads lendo.
+ *  \sa commit(), PageCache::share()
+ */
+void KDTreeOnDisk::share() {
+  file_->share();
+  data_->share();
+  names_->share();
+  docs_->share();
+}
+
+//! Somente leitura
+/*! Mapeia o arquivo da árvore já escrito no disco. A descida visita
+ *  nodes espalhados, então a leitura antecipada do sistema só atrapalha.
+ *  \sa read()
+ */
+void KDTreeOnDisk::map() {
+  delete map_;
+  map_ = new MappedFile("./primary_tree.dat");
+  map_->advise(0u, map_->size(), MADV_RANDOM);
+}
+
+//! Volta a ler pelo cache
+/*! Depois de uma mudança o mapeamento não vê o que ainda está no
+ *  cache de páginas, então as leituras voltam para o cache até o
+ *  próximo commit().
+ *  \sa map()
+ */
+void KDTreeOnDisk::unmap() {
+  delete map_;
+  map_ = nullptr;
+}
+
+//! Lê trecho
+/*! Lê do mapeamento quando a árvore está confirmada, senão do cache
+ *  de páginas.
+ *  \param size_t deslocamento no arquivo
+ *  \param void* destino
+ *  \param size_t quantidade de bytes
+ */
+void KDTreeOnDisk::read(const size_t offset, void* data,
+                        const size_t length) const {
+  if (map_ == nullptr)
+    file_->read(offset, data, length);
+  else if (offset + length <= map_->size())
+    memcpy(data, map_->at(offset, length), length);
+  else
+    throw std::out_of_range("Leitura fora do arquivo da árvore.");
+}
+
+//! Compara nome
+/*! Compara pelo começo guardado no node; só se ele estiver cheio e
+ *  for igual lê o nome inteiro do registro.
+ *  \param char* nome procurado
+ *  \param Node node
+ *  \param size_t docid do node
+ *  \return int como strcmp() do nome procurado com o do node
+ */
+int KDTreeOnDisk::compare_primary(const char* primary, const Node& node,
+                                  const size_t doc) const {
+  int compare = strncmp(primary, node.prefix_, PREFIX);
+  if (compare != 0 || node.prefix_[PREFIX - 1] == '\0')
+    return compare;
+  return strcmp(primary, this->primary(doc, docs_->at(doc)).c_str());
+}
+
+//! Nome do documento
+/*! Nomes menores que PREFIX são lidos do node, que fica no arquivo da
+ *  árvore na mesma ordem dos docids; os outros, do registro.
+ *  \param size_t docid
+ *  \param Document entrada do docid na tabela de documentos
+ *  \return string nome inteiro
+ */
+string KDTreeOnDisk::primary(const size_t doc,
+                             const DocumentTable::Document& document) const {
+  if (document.name_ >= PREFIX)
+    return data_->name(document.record_, document.name_);
+  char prefix[PREFIX];
+  read(node_of(doc) + offsetof(Node, prefix_), prefix, PREFIX);
+  return string(prefix, document.name_);
+}
+
+//! Node do docid
+/*! Nodes e documentos são acrescentados juntos, o n-ésimo node é o
+ *  docid n.
+ *  \param size_t docid
+ *  \return size_t deslocamento do node no arquivo da árvore
+ *  \sa doc_of()
+ */
+size_t KDTreeOnDisk::node_of(const size_t doc) {
+  return sizeof(Superblock) + (doc - 1) * sizeof(Node);
+}
+
+//! Docid do node
+/*! \param size_t deslocamento do node no arquivo da árvore
+ *  \return size_t docid
+ *  \sa node_of()
+ */
+size_t KDTreeOnDisk::doc_of(const size_t offset) {
+  return (offset - sizeof(Superblock)) / sizeof(Node) + 1;
 }
 
 //! Destrutor
-/*! Destrutor padrão, não tem nada alocado dinâmicamente.
+/*! Fecha o arquivo, escrevendo o que estiver pendente.
  *  \sa KDTreeOnDisk()
  */
-KDTreeOnDisk::~KDTreeOnDisk() {}
+KDTreeOnDisk::~KDTreeOnDisk() {
+  delete map_;
+  delete docs_;
+  delete names_;
+  delete data_;
+  delete file_;
+}
 
 //! Insere
-/*! Recebe manpage para inserção
+/*! Recebe manpage para inserção, o texto vai para o arquivo de dados
+ *  e o endereço do registro para a tabela de documentos; a manpage
+ *  recebe o próximo docid, que também entra no índice de nomes.
  *  \param char* nome da manpage
  *  \param size_t tamanho do arquivo
  *  \param char* manpage
- *  \return int deslocamento na árvore
+ *  \param size_t tamanho em palavras indexadas
+ *  \return int docid, -1 se a manpage já existe
+ *  \throw std::out_of_range docids de 32 bits esgotados
  */
-int KDTreeOnDisk::insert(const char* key_1,
-                          const size_t key_2, char* manpage) {
-  fstream tree("./primary_tree.dat", ios::in | ios::out | ios::binary);
+int KDTreeOnDisk::insert(const char* key_1, const size_t key_2,
+                         char* manpage, const size_t words) {
+  if (size_ >= INT32_MAX)
+    throw std::out_of_range("Manpages demais para a árvore.");
 
-  char node_key_1[50];
-  size_t node_key_2;
+  Node node;
   int compare = 1;
-  size_t offset = 0u, son = 0u, level = 0u, father_son = 0u,
-         offset_secondary = sizeof(Node::primary_)+6,
-         offset_left = offset_secondary + sizeof(size_t),
-         offset_right = offset_left + sizeof(size_t);
-
-  tree.seekg(0);
-  while (tree.good() && size_ != 0) {
-    offset = tree.tellg();
-
-    if (level % 2 == 0) {
-      tree.read(node_key_1, sizeof(Node::primary_));
-      compare = strcmp(key_1, node_key_1);
-    } else {
-      tree.seekg(offset + offset_secondary);
-      tree.read(reinterpret_cast<char*>(&node_key_2), sizeof(size_t));
-      compare = key_2 - node_key_2;
-    }
-
-    if (compare != 0) {  // esquerda ou direita
-      father_son = compare < 0? offset + offset_left : offset + offset_right;
-
-      tree.seekg(father_son);
-      tree.read(reinterpret_cast<char*>(&son), sizeof(size_t));
-
-      if (son == 0u) // Cheguei em um node nulo
-        break;
-
-      tree.seekg(son);
-
-    } else { // igual
+  size_t offset = root_, son = 0u, level = 0u, father_son = 0u, doc = 0u,
+         offset_left = offsetof(Node, left_),
+         offset_right = offsetof(Node, right_);
+
+  unmap();
+  while (size_ != 0) {
+    file_->read(offset, &node, sizeof(Node));
+    if (level % 2 == 0)
+      compare = compare_primary(key_1, node, doc_of(offset));
+    else
+      compare = key_2 < node.secondary_? -1 : key_2 > node.secondary_;
+
+    if (compare == 0) {  // igual, desempata pela outra dimensão
+      if (level % 2 == 0)
+        compare = key_2 < node.secondary_? -1 : key_2 > node.secondary_;
+      else
+        compare = compare_primary(key_1, node, doc_of(offset));
 
-      if (level % 2 == 0) {
-        tree.seekg(offset + offset_secondary);
-        tree.read(reinterpret_cast<char*>(&node_key_2), sizeof(size_t));
-        compare = key_2 - node_key_2;
-      } else {
-        tree.seekg(offset);
-        tree.read(node_key_1, sizeof(Node::primary_));
-        compare = strcmp(key_1, node_key_1);
+      if (compare == 0) {  // node ja existe, se removido vale a direita
+        if (!removed(doc_of(offset)))
+          break;
+        compare = 1;
       }
+    }
 
-      if (compare == 0) // node ja existe
-        break;
-
-      father_son = compare < 0? offset + offset_left : offset + offset_right;
-      tree.seekg(father_son);
-      tree.read(reinterpret_cast<char*>(&son), sizeof(size_t));
+    // esquerda ou direita
+    father_son = compare < 0? offset + offset_left : offset + offset_right;
+    son = compare < 0? node.left_ : node.right_;
 
-      if (son == 0u) // cheguei num node nulo
-        break;
+    if (son == 0u) // Cheguei em um node nulo
+      break;
 
-      tree.seekg(son);
-    }
+    offset = son;
     ++level;
   }
   ++level; // Mais um level pro node nulo
 
   if (compare != 0) {
-    Node *tnode = new Node(key_1, key_2, manpage);
-    if (tnode == nullptr)
-      throw std::out_of_range("Full tree!");
+    DocumentTable::Document document;
+    document.record_ = data_->append(key_1, manpage, key_2);
+    document.length_ = key_2;
+    document.name_ = strlen(key_1);
+    document.words_ = words < UINT32_MAX? words : UINT32_MAX;
+    doc = docs_->append(document);
+
+    Node tnode(key_1, key_2);
+    son = file_->append(&tnode, sizeof(Node));  // adiciona o node
+    names_->insert(key_1, doc);
+    words_ += document.words_;
+
+    if (size_ != 0)
+      file_->write(father_son, &son, sizeof(size_t));  // modifica o pai
+    else
+      root_ = son;
 
-    tree.seekp(0, ios::end); // fim do arquivo
-    son = tree.tellp();      // pega deslocamento pro filho
-
-    if (size_ != 0) {
-      tree.seekp(father_son);    // modifica o pai
-      tree.write(reinterpret_cast<char*>(&son), sizeof(size_t));
-    }
-
-    tree.seekp(son);            // adiciona o node
-    tree.write(reinterpret_cast<char*>(tnode), tnode->size());
     ++size_;
-    delete tnode;
+    ++generation_;
   }
 
   depth_ = level > depth_? level : depth_;
-  tree.close();
-  // retorna o descolocamento onde esta o node inserido
-  return compare == 0u? -1 : son;
+  // retorna o docid do node inserido
+  return compare == 0? -1 : static_cast<int>(doc);
 }
 
-//! Procura manpage
-/*! Recebe nome da manpage e retorna texto do arquivo da manpage.
- *  \param char* nome da manpage
- *  \return char* manpage
- */
-char* KDTreeOnDisk::search_primary_key(const char* wanted) {
-  // Guardar o deslocamento e nível em uma pilha quando tiver
-  // que descer por dois caminhos diferentes.
-  LinkedStack<Route> routes; // desvios
-  char node_key_1[50];
-  size_t node_key_2;
-  int compare = 1;
-  size_t offset = 0u, son = 0u, level = 0u,
-         offset_secondary = sizeof(Node::primary_)+6,
-         offset_left = offset_secondary + sizeof(size_t),
-         offset_right = offset_left + sizeof(size_t),
-         offset_manpage = offset_right + sizeof(size_t);
-
-  ifstream tree("./primary_tree.dat", std::ios_base::app | ios::binary);
-  tree.seekg(0); // inicio do arquivo
-
-  while (tree.good()) {
-    offset = tree.tellg();
-
-    tree.read(node_key_1, sizeof(Node::primary_));
-    compare = strcmp(wanted, node_key_1);
-
-    if (compare == 0) {  // achei
-      // le offset da manpage
-      tree.seekg(offset + offset_secondary);
-      tree.read(reinterpret_cast<char*>(&node_key_2), sizeof(size_t));
-
-      char *manpage = new char[node_key_2];
-      tree.seekg(offset + offset_manpage);
-      tree.read(manpage, node_key_2);
-      return manpage;
-    }
-
-    if (level % 2 == 0) {  // dimensao x, divide árvore
-      if (compare < 0)
-        son = offset + offset_left;
-      else
-        son = offset + offset_right;
+//! Marca manpage removida
+/*! O node continua na árvore guiando a descida, só o documento é
+ *  marcado e deixa de aparecer nos resultados; o nome sai do índice de
+ *  nomes e o texto fica no arquivo de dados até a próxima compactação.
+ *  \param size_t docid, o documento das listas
+ *  \throw std::out_of_range docid que não está na árvore
+ *  \sa removed(), compact()
+ */
+void KDTreeOnDisk::remove(const size_t doc) {
+  if (!docs_->contains(doc))
+    throw std::out_of_range("Manpage fora da árvore.");
+
+  DocumentTable::Document document = docs_->at(doc);
+  if (document.removed_)
+    return;
+
+  document.removed_ = 1u;
+  docs_->write(doc, document);
+  names_->replace(primary(doc, document).c_str(), doc, 0u);
+  data_->release(document.record_);
+  words_ -= document.words_;
+  ++removed_;
+  ++generation_;
+}
 
-      tree.seekg(son);
-      tree.read(reinterpret_cast<char*>(&son), sizeof(size_t));
+//! Manpage removida
+/*! \param size_t docid
+ *  \return bool se a manpage foi removida
+ */
+bool KDTreeOnDisk::removed(const size_t doc) const {
+  if (removed_ == 0u)
+    return false;
+  return docs_->at(doc).removed_ != 0u;
+}
 
-    } else {               // dimensao y, vai pros dois lados
-      tree.seekg(offset + offset_right);
-      tree.read(reinterpret_cast<char*>(&son), sizeof(size_t));
-      if (son != 0) {
-        Route way(son, level+1);
-        routes.push(way);
-      }
+//! Percentual de textos removidos
+/*! \return size_t textos removidos, em percentual do arquivo de dados
+ *  \sa compact()
+ */
+size_t KDTreeOnDisk::garbage() const {
+  size_t records = data_->size();
+  return records == 0u? 0u : data_->removed() * 100u / records;
+}
 
-      tree.seekg(offset + offset_left);
-      tree.read(reinterpret_cast<char*>(&son), sizeof(size_t));
-    }
+//! Recupera espaço dos removidos
+/*! A tabela de documentos é percorrida em sequência e os textos das
+ *  manpages vivas vão para um arquivo de dados novo. Só as entradas da
+ *  tabela passam a apontar para os novos registros; os docids não
+ *  mudam, então a árvore, o índice de nomes e as listas das chaves
+ *  secundárias continuam valendo.
+ *  \return size_t bytes recuperados no arquivo de dados
+ *  \sa remove(), ManpageHeap::compact()
+ */
+size_t KDTreeOnDisk::compact() {
+  vector<size_t> docs, live, records, moved;
+  vector<DocumentTable::Document> documents;
+
+  for (size_t doc = 1; doc <= docs_->size(); ++doc)
+    docs.push_back(doc);
+  docs_->read(docs, &documents);
+  for (size_t i = 0; i < docs.size(); ++i) {
+    if (documents[i].removed_)
+      continue;
+    live.push_back(docs[i]);
+    records.push_back(documents[i].record_);
+  }
 
-    if (son != 0) { // próximo node nao é nulo
-      tree.seekg(son);  // próxima posição
-      ++level;
-    } else {
-      try {
-        Route way = routes.pop();
-        tree.seekg(way.offset_tree_);
-        level = way.level_;
-      } catch(std::out_of_range error) {
-        break;  // pilha vazia
-      }
-    }
+  size_t before = data_->file_size();
+  data_->compact(records, &moved);
+  for (size_t i = 0; i < live.size(); ++i) {
+    DocumentTable::Document& document = documents[live[i] - 1];
+    document.record_ = moved[i];
+    docs_->write(live[i], document);
   }
+  ++generation_;
+  return before - data_->file_size();
+}
 
-  return nullptr; // não achou
+//! Procura manpage
+/*! Recebe nome da manpage e retorna texto do arquivo da manpage.
+ *  O nome é procurado no índice de nomes, uma página por nível.
+ *  \param char* nome da manpage
+ *  \return View texto no mapeamento, data_ nulo se não achou
+ */
+ManpageHeap::View KDTreeOnDisk::search_primary_key(const char* wanted) const {
+  size_t doc;
+  if (!names_->find(wanted, &doc))
+    return ManpageHeap::View();  // não achou
+  return data_->view(docs_->at(doc).record_);
+}
+
+//! Procura várias manpages
+/*! Busca em lote no índice de nomes, os nomes que caem na mesma
+ *  folha custam uma única descida.
+ *  \param vector<string> nomes das manpages
+ *  \return vector<View> textos na ordem dos nomes, data_ nulo se não achou
+ */
+vector<ManpageHeap::View> KDTreeOnDisk::search_primary_key(
+                                const vector<string>& wanted) const {
+  vector<size_t> docs;
+  vector<bool> found;
+  vector<ManpageHeap::View> out(wanted.size());
+
+  names_->find(wanted, &docs, &found);
+  for (size_t i = 0; i < wanted.size(); ++i)
+    if (found[i])
+      out[i] = data_->view(docs_->at(docs[i]).record_);
+
+  return out;
 }
 
 //! Procura nome da manpage
-/*! Recebe o deslocamento na árvore da manpage
- *  \param size_t deslocamento
+/*! Recebe o docid da manpage
+ *  \param size_t docid
  *  \return string nome da manpage
  */
-string KDTreeOnDisk::return_primary_key(const size_t wanted) {
-  char node_key[50];
-  ifstream tree("./primary_tree.dat", std::ios_base::app | ios::binary);
-  tree.seekg(wanted);
-  tree.read(node_key, sizeof(node_key));
-  return string(node_key);
+string KDTreeOnDisk::return_primary_key(const size_t wanted) const {
+  return primary(wanted, docs_->at(wanted));
 }
 
-//! Procura todos os nomes das manpages passadas na lista.
-/*! Recebe lista com todos os deslocamentos
- *  \param LinkedList<size_t> lista de deslocamento
- *  \return LinkedList<string> lista com os nomes da lista
+//! Procura todos os nomes das manpages passadas
+/*! Os docids são ordenados e a tabela de documentos é lida em uma
+ *  passada; os nomes curtos vêm dos nodes, na mesma ordem. As manpages
+ *  removidas ficam de fora e os nomes saem em ordem, sem repetidos.
+ *  \param vector<size_t> docids, em qualquer ordem
+ *  \return vector<string> nomes em ordem alfabética
  */
-LinkedList<string>* KDTreeOnDisk::return_primary_key(LinkedList<size_t> *wanted_list) {
-  LinkedList<string> *list = new LinkedList<string>();
-
-  char node_key[50];
-  ifstream tree("./primary_tree.dat", std::ios_base::app | ios::binary);
-  while (!wanted_list->empty()) {
-    tree.seekg(wanted_list->pop_front());
-    tree.read(node_key, sizeof(node_key));
-    list->insert_sorted(node_key);
-  }
+vector<string> KDTreeOnDisk::return_primary_key(
+                                const vector<size_t>& wanted) const {
+  vector<size_t> docs(wanted);
+  vector<DocumentTable::Document> documents;
+  vector<string> out;
+
+  sort(docs.begin(), docs.end());
+  docs_->read(docs, &documents);
+  out.reserve(docs.size());
+  for (size_t i = 0; i < docs.size(); ++i)
+    if (!documents[i].removed_)
+      out.push_back(primary(docs[i], documents[i]));
+
+  sort(out.begin(), out.end());
+  out.erase(unique(out.begin(), out.end()), out.end());
+  return out;
+}
 
-  return list;
+//! Índice reaproveitado
+/*! Retorna se a árvore foi reaberta do disco em vez de recriada.
+ *  \return bool teste
+ */
+bool KDTreeOnDisk::reopened() const {
+  return reopened_;
 }
 
 //! Teste de vazio
@@ -367,15 +588,15 @@ LinkedList<string>* KDTreeOnDisk::return_primary_key(LinkedList<size_t> *wanted_
  *  \return  bool teste
  */
 bool KDTreeOnDisk::empty() const {
-  return size_ == 0u;
+  return size() == 0u;
 }
 
 //! Tamanho da árvore
-/*! Retorna a quantidade de nodes na árvore
+/*! Retorna a quantidade de manpages na árvore, sem as removidas
  *  \return size_t tamanho
  */
 size_t KDTreeOnDisk::size() const {
-  return size_;
+  return size_ - removed_;
 }
 
 //! Profundidade da árvore
@@ -386,15 +607,70 @@ size_t KDTreeOnDisk::depth() const {
   return depth_;
 }
 
+//! Geração
+/*! Contador que muda a cada inserção, remoção ou compactação, para
+ *  quem guarda resultados de buscas saber que eles não valem mais.
+ *  \return uint64_t geração atual
+ */
+uint64_t KDTreeOnDisk::generation() const {
+  return generation_;
+}
+
 //! Tamanho do arquivo da árvore
 /*! Retorna o tamanho do arquivo
  *  \return Tamanho
  */
 size_t KDTreeOnDisk::file_size() const {
-  struct stat st;
-  if (stat("./primary_tree.dat", &st) != 0)
-    throw std::out_of_range("Erro ao verificar tamanho do arquivo.");
-  return st.st_size;
+  return file_->size();
+}
+
+//! Páginas por busca de nome
+/*! Retorna a altura do índice de nomes
+ *  \return size_t páginas lidas por search_primary_key()
+ */
+size_t KDTreeOnDisk::names_depth() const {
+  return names_->depth();
+}
+
+//! Tamanho da tabela de documentos
+/*! Retorna o tamanho do documents.dat
+ *  \return Tamanho
+ */
+size_t KDTreeOnDisk::documents_size() const {
+  return docs_->file_size();
+}
+
+//! Tamanho de uma manpage
+/*! Retorna o tamanho em palavras indexadas guardado na tabela de
+ *  documentos.
+ *  \param size_t docid, o documento das listas
+ *  \return size_t palavras
+ */
+size_t KDTreeOnDisk::words(const size_t doc) const {
+  return docs_->at(doc).words_;
+}
+
+//! Tamanho médio das manpages
+/*! \return double palavras indexadas por manpage
+ */
+double KDTreeOnDisk::average_words() const {
+  return size() == 0u? 0.0 : static_cast<double>(words_) / size();
+}
+
+//! Tamanho do arquivo de dados
+/*! Retorna o tamanho do manpages.dat
+ *  \return Tamanho
+ */
+size_t KDTreeOnDisk::data_size() const {
+  return data_->file_size();
+}
+
+//! Tamanho do índice de nomes
+/*! Retorna o tamanho do name_index.dat
+ *  \return Tamanho
+ */
+size_t KDTreeOnDisk::names_size() const {
+  return names_->file_size();
 }
 
 }  //  namespace structures
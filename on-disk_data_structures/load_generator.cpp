@@ -0,0 +1,274 @@
+//!  Copyright [2017] <João Vicente Souto>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+//! Classe Connection
+/*! Uma conexão com o servidor e o que foi medido nela. O envio guarda
+ *  o horário agendado de cada consulta; a recepção tira na mesma ordem,
+ *  já que o servidor responde as linhas em ordem.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class Connection {
+ public:
+  int socket_{-1};  //!< Socket conectado
+  mutex mutex_;  //!< Protege scheduled_ e sending_
+  deque<Clock::time_point> scheduled_;  //!< Consultas sem resposta
+  bool sending_{true};  //!< Envio ainda não terminou
+  size_t sent_{0u},  //!< Consultas enviadas
+         errors_{0u};  //!< Respostas de erro
+  vector<double> latencies_;  //!< Microssegundos desde o agendamento
+};
+
+//! Conecta
+/*! \param string caminho do socket do servidor
+ *  \return int socket conectado, -1 se falhar
+ */
+int connect_to(const string& path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path))
+    return -1;
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+  int client = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (client < 0)
+    return -1;
+  if (connect(client, reinterpret_cast<struct sockaddr*>(&address),
+              sizeof(address)) != 0) {
+    close(client);
+    return -1;
+  }
+  return client;
+}
+
+//! Envia consultas
+/*! Carga em laço aberto: a i-ésima consulta tem horário fixo, começo
+ *  mais i intervalos, e sai nele mesmo que respostas anteriores
+ *  estejam atrasadas. A latência é medida a partir do horário agendado,
+ *  então a espera de um servidor lento entra na conta.
+ *  \param Connection* conexão
+ *  \param vector<string> consultas, usadas em rodízio
+ *  \param size_t primeira consulta desta conexão
+ *  \param Clock::time_point início do envio
+ *  \param double intervalo entre consultas, em segundos
+ *  \param Clock::time_point fim do envio
+ */
+void send_queries(Connection* connection, const vector<string>& queries,
+                  size_t next, const Clock::time_point begin,
+                  const double interval, const Clock::time_point end) {
+  for (size_t i = 0; ; ++i) {
+    Clock::time_point when = begin +
+        chrono::duration_cast<Clock::duration>(
+            chrono::duration<double>(interval * i));
+    if (when >= end)
+      break;
+    this_thread::sleep_until(when);
+
+    const string& line = queries[next++ % queries.size()];
+    {
+      lock_guard<mutex> lock(connection->mutex_);
+      connection->scheduled_.push_back(when);
+    }
+    size_t done = 0u;
+    while (done < line.size()) {
+      ssize_t count = send(connection->socket_, line.data() + done,
+                           line.size() - done, MSG_NOSIGNAL);
+      if (count <= 0)
+        break;
+      done += count;
+    }
+    if (done < line.size())
+      break;  // servidor fechou
+    ++connection->sent_;
+  }
+
+  lock_guard<mutex> lock(connection->mutex_);
+  connection->sending_ = false;
+}
+
+//! Recebe respostas
+/*! Cada linha recebida fecha a consulta mais antiga sem resposta.
+ *  Termina quando o envio acabou e nada mais falta, quando o servidor
+ *  fecha ou depois de esperar o tempo limite sem resposta nenhuma.
+ *  \param Connection* conexão
+ *  \param int tempo limite em milissegundos
+ */
+void receive_answers(Connection* connection, const int timeout) {
+  vector<char> buffer(64u << 10);
+  string head;
+  struct pollfd waiting;
+  waiting.fd = connection->socket_;
+  waiting.events = POLLIN;
+
+  while (true) {
+    {
+      lock_guard<mutex> lock(connection->mutex_);
+      if (!connection->sending_ && connection->scheduled_.empty())
+        return;
+    }
+    int ready = poll(&waiting, 1, 100);
+    if (ready == 0) {
+      lock_guard<mutex> lock(connection->mutex_);
+      if (!connection->sending_ && !connection->scheduled_.empty() &&
+          Clock::now() - connection->scheduled_.back() >
+              chrono::milliseconds(timeout))
+        return;  // respostas perdidas
+      continue;
+    }
+    ssize_t count = recv(connection->socket_, buffer.data(),
+                         buffer.size(), 0);
+    if (count <= 0)
+      return;
+    Clock::time_point now = Clock::now();
+
+    for (ssize_t i = 0; i < count; ++i) {
+      if (buffer[i] != '\n') {
+        if (head.size() < 5u)
+          head += buffer[i];  // o começo da linha já diz se é erro
+        continue;
+      }
+      if (head == "erro\t")
+        ++connection->errors_;
+      head.clear();
+      lock_guard<mutex> lock(connection->mutex_);
+      if (connection->scheduled_.empty())
+        continue;
+      connection->latencies_.push_back(chrono::duration<double, micro>(
+          now - connection->scheduled_.front()).count());
+      connection->scheduled_.pop_front();
+    }
+  }
+}
+
+//! Percentil
+/*! Pelo posto mais próximo.
+ *  \param vector<double> amostras em ordem crescente
+ *  \param double percentil, de 0 a 100
+ *  \return double amostra, 0 se não houver
+ */
+double percentile(const vector<double>& sorted, const double p) {
+  if (sorted.empty())
+    return 0.0;
+  size_t rank = static_cast<size_t>(p / 100.0 * sorted.size() + 0.999999);
+  return sorted[min(max<size_t>(rank, 1u), sorted.size()) - 1u];
+}
+
+//! Gerador de carga do servidor de consultas
+/*! Manda consultas de um arquivo, no formato do modo em lote, a uma
+ *  taxa fixa dividida entre as conexões e informa a taxa atingida e as
+ *  latências.
+ *
+ *      load_generator socket consultas.txt taxa segundos [conexões]
+ */
+int main(int argc, char const *argv[]) {
+  if (argc < 5 || argc > 6) {
+    cerr << "Uso: " << argv[0]
+         << " socket consultas.txt consultas/s segundos [conexões]" << endl;
+    return 1;
+  }
+
+  string path(argv[1]);
+  double rate = strtod(argv[3], nullptr),
+         seconds = strtod(argv[4], nullptr);
+  size_t connections = argc == 6? strtoul(argv[5], nullptr, 10) : 4u;
+  if (rate <= 0.0 || seconds <= 0.0 || connections == 0u) {
+    cerr << "Taxa, duração e conexões devem ser positivas." << endl;
+    return 1;
+  }
+
+  ifstream file(argv[2], ios::in);
+  if (!file) {
+    cerr << "Erro ao abrir " << argv[2] << endl;
+    return 1;
+  }
+  vector<string> queries;
+  string line;
+  while (getline(file, line)) {
+    size_t first = line.find_first_not_of(" \t\r");
+    if (first == string::npos || line[first] == '#')
+      continue;
+    queries.push_back(line.substr(first) + '\n');
+  }
+  if (queries.empty()) {
+    cerr << "Nenhuma consulta em " << argv[2] << endl;
+    return 1;
+  }
+
+  vector<Connection> pool(connections);
+  for (Connection& connection : pool) {
+    connection.socket_ = connect_to(path);
+    if (connection.socket_ < 0) {
+      cerr << "Erro ao conectar em " << path << endl;
+      return 1;
+    }
+  }
+
+  // Conexões defasadas dentro do intervalo, para a chegada ser uniforme
+  double interval = connections / rate;
+  Clock::time_point begin = Clock::now() + chrono::milliseconds(10),
+                    end = begin + chrono::duration_cast<Clock::duration>(
+                        chrono::duration<double>(seconds));
+  vector<thread> threads;
+  for (size_t i = 0; i < connections; ++i) {
+    Clock::time_point start = begin + chrono::duration_cast<Clock::duration>(
+        chrono::duration<double>(interval * i / connections));
+    threads.emplace_back(send_queries, &pool[i], cref(queries),
+                         i * queries.size() / connections, start,
+                         interval, end);
+    threads.emplace_back(receive_answers, &pool[i], 5000);
+  }
+  for (thread& worker : threads)
+    worker.join();
+  double elapsed = chrono::duration<double>(Clock::now() - begin).count();
+
+  size_t sent = 0u, errors = 0u;
+  vector<double> latencies;
+  for (Connection& connection : pool) {
+    close(connection.socket_);
+    sent += connection.sent_;
+    errors += connection.errors_;
+    latencies.insert(latencies.end(), connection.latencies_.begin(),
+                     connection.latencies_.end());
+  }
+  sort(latencies.begin(), latencies.end());
+
+  cout << fixed << setprecision(1);
+  cout << "Taxa pedida: " << rate << " consultas/s em " << connections
+       << " conexões" << endl;
+  cout << "Enviadas: " << sent << endl;
+  cout << "Respondidas: " << latencies.size() << " (" << errors
+       << " com erro, " << sent - latencies.size() << " sem resposta)"
+       << endl;
+  cout << "Taxa atingida: " << latencies.size() / elapsed
+       << " consultas/s" << endl;
+  cout << "Latência p50: " << percentile(latencies, 50.0) << " us" << endl;
+  cout << "Latência p90: " << percentile(latencies, 90.0) << " us" << endl;
+  cout << "Latência p99: " << percentile(latencies, 99.0) << " us" << endl;
+  cout << "Latência p99.9: " << percentile(latencies, 99.9) << " us" << endl;
+  cout << "Latência máxima: "
+       << (latencies.empty()? 0.0 : latencies.back()) << " us" << endl;
+  return 0;
+}
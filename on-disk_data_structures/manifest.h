@@ -0,0 +1,216 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_MANIFEST_H
+#define STRUCTURES_MANIFEST_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include "./page_cache.h"
+#include "./superblock.h"
+
+using namespace std;
+
+namespace structures {
+
+//! Classe Manifest
+/*! Arquivo manifest.dat, a lista dos arquivos que estão no índice.
+ *  Para cada caminho guarda tamanho e data de modificação, de quando
+ *  foi indexado, e o docid da manpage na árvore primária. Comparando
+ *  com os arquivos passados agora dá para saber quais manpages entram,
+ *  saem ou mudaram, sem reindexar as outras.
+ *
+ *  O superbloco guarda a impressão digital com que os índices foram
+ *  confirmados e, no lugar da soma de tamanhos, o hash das opções que
+ *  mudam a indexação inteira (palavras ignoradas, -p). Enquanto uma
+ *  atualização está no meio a impressão digital gravada é zero.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class Manifest {
+ public:
+  explicit Manifest(const uint64_t settings);  // Construtor
+  ~Manifest();  // Destrutor
+
+  static const uint64_t MAGIC = 0x315346494e414d4dull;  //!< "MMANIFS1"
+  static const uint32_t VERSION = 1u;  //!< Versão do formato
+
+  //! Classe Entry
+  /*! Arquivo indexado.
+   *
+   *  \author João Vicente Souto.
+   *  \since 20/06/17
+   *  \version 1.0
+   */
+  class Entry {
+   public:
+    string path_;  //!< Caminho como foi passado
+    uint64_t size_{0u},  //!< Tamanho em bytes
+             modified_{0u},  //!< Data de modificação
+             doc_{0u};  //!< Docid da manpage, 0 se repetida
+  };
+
+  static Entry stat(const string& path);  // Estado atual de um arquivo
+
+  void invalidate();  // Marca atualização em andamento
+  void commit(const vector<Entry>& entries,
+              const uint64_t fingerprint);  // Grava lista
+
+  bool valid() const;  // Lista confirmada com as mesmas opções
+  uint64_t fingerprint() const;  // Impressão digital dos índices
+  const vector<Entry>& entries() const;  // Arquivos indexados
+
+ private:
+  PageCache *file_{nullptr};  //!< Arquivo da lista
+  uint64_t settings_,  //!< Hash das opções de indexação
+           fingerprint_{0u};  //!< Impressão digital confirmada
+  vector<Entry> entries_;  //!< Arquivos indexados
+};
+
+//! Construtor
+/*! Lê a lista gravada se ela foi confirmada com as mesmas opções,
+ *  senão começa vazia e inválida.
+ *  \param uint64_t hash das opções de indexação
+ *  \sa ~Manifest(), valid()
+ */
+Manifest::Manifest(const uint64_t settings) :
+settings_{settings}
+{
+  file_ = new PageCache("./manifest.dat", 16u);
+
+  Superblock block;
+  if (!block.load(file_) || block.magic_ != MAGIC ||
+      block.version_ != VERSION || block.fingerprint_ == 0u ||
+      block.total_ != settings_)
+    return;
+
+  size_t offset = sizeof(Superblock);
+  entries_.resize(block.size_);
+  for (Entry& entry : entries_) {
+    uint64_t length;
+    if (offset + sizeof(length) > file_->size())
+      break;
+    file_->read(offset, &length, sizeof(length));
+    offset += sizeof(length);
+    if (offset + length + 3u * sizeof(uint64_t) > file_->size())
+      break;
+    entry.path_.resize(length);
+    file_->read(offset, &entry.path_[0], length);
+    offset += length;
+    file_->read(offset, &entry.size_, sizeof(entry.size_));
+    file_->read(offset + sizeof(uint64_t), &entry.modified_,
+                sizeof(entry.modified_));
+    file_->read(offset + 2u * sizeof(uint64_t), &entry.doc_,
+                sizeof(entry.doc_));
+    offset += 3u * sizeof(uint64_t);
+  }
+
+  if (offset == file_->size())
+    fingerprint_ = block.fingerprint_;
+  else
+    entries_.clear();  // lista cortada, não serve
+}
+
+//! Destrutor
+/*! Fecha o arquivo.
+ *  \sa Manifest()
+ */
+Manifest::~Manifest() {
+  delete file_;
+}
+
+//! Estado atual de um arquivo
+/*! \param string caminho
+ *  \return Entry caminho, tamanho e data de modificação, sem node
+ *  \throw std::out_of_range se o arquivo não existe
+ */
+Manifest::Entry Manifest::stat(const string& path) {
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0)
+    throw std::out_of_range("Erro ao verificar tamanho do arquivo.");
+
+  Entry entry;
+  entry.path_ = path;
+  entry.size_ = st.st_size;
+  entry.modified_ = st.st_mtime;
+  return entry;
+}
+
+//! Marca atualização em andamento
+/*! Grava o superbloco com impressão digital zero antes de mexer nos
+ *  índices, assim uma atualização interrompida leva a uma indexação
+ *  completa na próxima execução.
+ *  \sa commit()
+ */
+void Manifest::invalidate() {
+  Superblock block(MAGIC, VERSION);
+  block.size_ = entries_.size();
+  block.total_ = settings_;
+  block.store(file_);
+  file_->flush();
+  fingerprint_ = 0u;
+}
+
+//! Grava lista
+/*! Reescreve a lista inteira e confirma o superbloco por último.
+ *  \param vector<Entry> arquivos indexados
+ *  \param uint64_t impressão digital com que os índices foram confirmados
+ *  \sa invalidate()
+ */
+void Manifest::commit(const vector<Entry>& entries,
+                      const uint64_t fingerprint) {
+  file_->truncate();
+  Superblock(MAGIC, VERSION).store(file_);
+
+  vector<char> buffer;
+  for (const Entry& entry : entries) {
+    uint64_t length = entry.path_.size(),
+             fields[3] = {entry.size_, entry.modified_, entry.doc_};
+    const char *bytes = reinterpret_cast<const char*>(&length);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(length));
+    buffer.insert(buffer.end(), entry.path_.begin(), entry.path_.end());
+    bytes = reinterpret_cast<const char*>(fields);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(fields));
+  }
+  if (!buffer.empty())
+    file_->append(buffer.data(), buffer.size());
+
+  Superblock block(MAGIC, VERSION);
+  block.fingerprint_ = fingerprint;
+  block.size_ = entries.size();
+  block.total_ = settings_;
+  block.store(file_);
+  file_->flush();
+
+  entries_ = entries;
+  fingerprint_ = fingerprint;
+}
+
+//! Lista confirmada
+/*! \return bool se a lista foi lida inteira e é das mesmas opções
+ */
+bool Manifest::valid() const {
+  return fingerprint_ != 0u;
+}
+
+//! Impressão digital dos índices
+/*! \return uint64_t com que os índices foram confirmados, 0 se inválida
+ */
+uint64_t Manifest::fingerprint() const {
+  return fingerprint_;
+}
+
+//! Arquivos indexados
+/*! \return vector<Entry> na ordem em que foram gravados
+ */
+const vector<Manifest::Entry>& Manifest::entries() const {
+  return entries_;
+}
+
+}  //  namespace structures
+
+#endif
@@ -0,0 +1,371 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_MANPAGE_HEAP_H
+#define STRUCTURES_MANPAGE_HEAP_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+#include "./page_cache.h"
+#include "./mapped_file.h"
+#include "./superblock.h"
+
+using namespace std;
+
+namespace structures {
+
+//! Classe ManpageHeap
+/*! Arquivo de dados manpages.dat. Cada manpage é um registro
+ *  acrescentado no fim do arquivo, com cabeçalho de tamanhos seguido do
+ *  comando e do conteúdo. Registros nunca mudam de lugar, então o
+ *  deslocamento de um registro serve de endereço para os índices.
+ *  Um registro removido só é contado; o espaço volta na compactação,
+ *  que copia os registros vivos para um arquivo novo e troca os dois.
+ *
+ *  Depois de confirmado o arquivo fica somente leitura e mapeado em
+ *  memória, o conteúdo é devolvido como uma View direto no mapeamento.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class ManpageHeap {
+ public:
+  ManpageHeap();  // Construtor
+  explicit ManpageHeap(const uint64_t fingerprint);  // Reabre arquivo
+  ~ManpageHeap();  // Destrutor
+
+  static const uint64_t MAGIC = 0x3150414548504d4dull;  //!< "MMPHEAP1"
+  static const uint32_t VERSION = 1u;  //!< Versão do formato
+
+  //! Classe View
+  /*! Trecho do mapeamento, não pertence a quem recebe e vale enquanto
+   *  o arquivo estiver aberto.
+   *
+   *  \author João Vicente Souto.
+   *  \since 20/06/17
+   *  \version 1.0
+   */
+  class View {
+   public:
+    const char *data_{nullptr};  //!< Primeiro byte
+    size_t length_{0u};  //!< Quantidade de bytes
+  };
+
+  size_t append(const char* name, const char* manpage,
+                const size_t length);  // Acrescenta registro
+  View view(const size_t record) const;  // Conteúdo sem cópia
+  string name(const size_t record) const;  // Lê comando
+  string name(const size_t record,
+              const size_t length) const;  // Lê comando de tamanho sabido
+  size_t length(const size_t record) const;  // Tamanho do conteúdo
+  void release(const size_t record);  // Marca registro removido
+  void compact(const vector<size_t>& records,
+               vector<size_t>* moved);  // Copia registros vivos
+
+  void commit(const uint64_t fingerprint);  // Grava superbloco
+  void share();  // Leitura por várias threads
+
+  bool reopened() const;  // Arquivo reaproveitado
+  size_t size() const;  // Quantidade de registros
+  size_t removed() const;  // Registros removidos
+  size_t file_size() const;  // Tamanho do arquivo
+
+ private:
+  static const size_t CACHE_PAGES = 64u;  //!< Páginas em memória
+
+  //! Classe Record
+  /*! Cabeçalho de um registro.
+   *
+   *  \author João Vicente Souto.
+   *  \since 20/06/17
+   *  \version 1.0
+   */
+  class Record {
+   public:
+    uint32_t name_{0u},  //!< Tamanho do comando
+             reserved_{0u};  //!< Alinhamento
+    uint64_t length_{0u};  //!< Tamanho do conteúdo
+  };
+
+  void create();  // Recria arquivo vazio
+  void map();  // Passa para somente leitura
+  Record header(const size_t record) const;  // Lê cabeçalho
+
+  PageCache *file_{nullptr};  //!< Arquivo de dados
+  MappedFile *map_{nullptr};  //!< Mapeamento, depois de confirmado
+  size_t size_{0u},  //!< Quantidade de registros
+         removed_{0u};  //!< Registros removidos, ainda no arquivo
+  bool reopened_{false};  //!< Arquivo lido do disco
+};
+
+//! Construtor
+/*! Sem parâmetros, limpa o arquivo de dados.
+ *  \sa ManpageHeap(const uint64_t fingerprint), ~ManpageHeap()
+ */
+ManpageHeap::ManpageHeap() {
+  file_ = new PageCache("./manpages.dat", CACHE_PAGES);
+  create();
+}
+
+//! Construtor
+/*! Reabre o arquivo gravado em disco se o superbloco corresponder às
+ *  entradas, senão limpa o arquivo como o construtor padrão.
+ *  \param uint64_t impressão digital das entradas
+ *  \sa ManpageHeap(), reopened()
+ */
+ManpageHeap::ManpageHeap(const uint64_t fingerprint) {
+  file_ = new PageCache("./manpages.dat", CACHE_PAGES);
+
+  Superblock block;
+  if (block.load(file_) && block.matches(MAGIC, VERSION, fingerprint)) {
+    size_ = block.size_;
+    removed_ = block.removed_;
+    reopened_ = true;
+    map();
+  } else {
+    create();
+  }
+}
+
+//! Destrutor
+/*! Fecha o arquivo, escrevendo o que estiver pendente.
+ *  \sa ManpageHeap()
+ */
+ManpageHeap::~ManpageHeap() {
+  delete map_;
+  delete file_;
+}
+
+//! Recria arquivo
+/*! Esvazia o arquivo, deixando apenas um superbloco ainda não
+ *  confirmado.
+ *  \sa commit()
+ */
+void ManpageHeap::create() {
+  delete map_;
+  map_ = nullptr;
+  file_->truncate();
+  Superblock(MAGIC, VERSION).store(file_);
+  size_ = removed_ = 0u;
+  reopened_ = false;
+}
+
+//! Confirma arquivo
+/*! Grava o superbloco com a impressão digital das entradas e escreve
+ *  as páginas pendentes.
+ *  \param uint64_t impressão digital das entradas
+ *  \sa ManpageHeap(const uint64_t fingerprint)
+ */
+void ManpageHeap::commit(const uint64_t fingerprint) {
+  Superblock block(MAGIC, VERSION);
+  block.fingerprint_ = fingerprint;
+  block.size_ = size_;
+  block.removed_ = removed_;
+  block.store(file_);
+  file_->flush();
+  map();
+}
+
+//! Leitura por várias threads
+/*! Depois de confirmado o arquivo já é lido pelo mapeamento; os
+ *  cabeçalhos lidos pelo cache passam a usar um cache por thread.
+ *  \sa commit(), PageCache::share()
+ */
+void ManpageHeap::share() {
+  file_->share();
+}
+
+//! Somente leitura
+/*! Mapeia o arquivo já escrito no disco. Os registros são lidos de
+ *  forma aleatória, cada conteúdo é percorrido do início ao fim.
+ *  \sa view()
+ */
+void ManpageHeap::map() {
+  delete map_;
+  map_ = new MappedFile("./manpages.dat");
+  map_->advise(0u, map_->size(), MADV_RANDOM);
+}
+
+//! Lê cabeçalho
+/*! Registros acrescentados depois do mapeamento são lidos pelo cache.
+ *  \param size_t deslocamento do registro
+ *  \return Record cabeçalho
+ */
+ManpageHeap::Record ManpageHeap::header(const size_t record) const {
+  Record out;
+  if (map_ != nullptr && record + sizeof(Record) <= map_->size())
+    memcpy(&out, map_->at(record, sizeof(Record)), sizeof(Record));
+  else if (record + sizeof(Record) <= file_->size())
+    file_->read(record, &out, sizeof(Record));
+  else
+    throw std::out_of_range("Registro fora do arquivo de dados.");
+  return out;
+}
+
+//! Acrescenta registro
+/*! Escreve cabeçalho, comando e conteúdo no fim do arquivo.
+ *  \param char* comando
+ *  \param char* conteúdo da manpage
+ *  \param size_t tamanho do conteúdo
+ *  \return size_t deslocamento do registro
+ */
+size_t ManpageHeap::append(const char* name, const char* manpage,
+                           const size_t length) {
+  Record record;
+  record.name_ = strlen(name);
+  record.length_ = length;
+
+  size_t offset = file_->append(&record, sizeof(Record));
+  file_->append(name, record.name_);
+  file_->append(manpage, length);
+
+  ++size_;
+  return offset;
+}
+
+//! Conteúdo sem cópia
+/*! Aponta o conteúdo de um registro dentro do mapeamento, sem alocar
+ *  nem copiar. O '\0' final gravado na indexação fica de fora.
+ *  \param size_t deslocamento do registro
+ *  \return View conteúdo
+ *  \throw std::out_of_range arquivo ainda não confirmado
+ *  \sa commit()
+ */
+ManpageHeap::View ManpageHeap::view(const size_t record) const {
+  if (map_ == nullptr)
+    throw std::out_of_range("Arquivo de dados ainda não confirmado.");
+
+  Record head = header(record);
+  size_t begin = record + sizeof(Record) + head.name_;
+  if (begin + head.length_ > map_->size())
+    throw std::out_of_range("Registro fora do arquivo de dados.");
+
+  View out;
+  out.data_ = map_->at(begin, head.length_);
+  out.length_ = head.length_;
+  if (out.length_ != 0u && out.data_[out.length_ - 1] == '\0')
+    --out.length_;
+
+  map_->advise(begin, head.length_, MADV_SEQUENTIAL);
+  map_->advise(begin, head.length_, MADV_WILLNEED);
+  return out;
+}
+
+//! Lê comando
+/*! \param size_t deslocamento do registro
+ *  \return string comando do registro
+ */
+string ManpageHeap::name(const size_t record) const {
+  return name(record, header(record).name_);
+}
+
+//! Lê comando de tamanho sabido
+/*! Para quem já guarda o tamanho do comando, como a tabela de
+ *  documentos: não lê o cabeçalho do registro.
+ *  \param size_t deslocamento do registro
+ *  \param size_t tamanho do comando
+ *  \return string comando do registro
+ */
+string ManpageHeap::name(const size_t record, const size_t length) const {
+  size_t begin = record + sizeof(Record);
+  string out(length, '\0');
+  if (map_ != nullptr && begin + length <= map_->size())
+    out.assign(map_->at(begin, length), length);
+  else if (begin + length <= file_->size())
+    file_->read(begin, &out[0], length);
+  else
+    throw std::out_of_range("Registro fora do arquivo de dados.");
+  return out;
+}
+
+//! Tamanho do conteúdo
+/*! \param size_t deslocamento do registro
+ *  \return size_t bytes do conteúdo
+ */
+size_t ManpageHeap::length(const size_t record) const {
+  return header(record).length_;
+}
+
+//! Marca registro removido
+/*! O registro continua no arquivo até a próxima compactação.
+ *  \param size_t deslocamento do registro
+ *  \sa compact()
+ */
+void ManpageHeap::release(const size_t record) {
+  if (record < sizeof(Superblock) || record >= file_->size())
+    throw std::out_of_range("Registro fora do arquivo de dados.");
+  ++removed_;
+}
+
+//! Copia registros vivos
+/*! Copia os registros recebidos, em ordem, para um arquivo temporário
+ *  que depois substitui o manpages.dat. Até a troca o arquivo antigo
+ *  continua inteiro; depois dela o superbloco só vale de novo no
+ *  próximo commit().
+ *  \param vector<size_t> registros que continuam
+ *  \param vector<size_t>* novo deslocamento de cada um, na mesma ordem
+ *  \sa release()
+ */
+void ManpageHeap::compact(const vector<size_t>& records,
+                          vector<size_t>* moved) {
+  delete map_;  // não vê os registros acrescentados depois do commit()
+  map_ = nullptr;
+
+  PageCache *file = new PageCache("./manpages.tmp", CACHE_PAGES);
+  file->truncate();
+  Superblock(MAGIC, VERSION).store(file);
+
+  vector<char> buffer;
+  moved->clear();
+  for (size_t record : records) {
+    Record head = header(record);
+    buffer.resize(sizeof(Record) + head.name_ + head.length_);
+    file_->read(record, buffer.data(), buffer.size());
+    moved->push_back(file->append(buffer.data(), buffer.size()));
+  }
+  delete file;
+
+  delete file_;
+  if (rename("./manpages.tmp", "./manpages.dat") != 0)
+    throw std::out_of_range("Erro ao trocar arquivo de dados.");
+  file_ = new PageCache("./manpages.dat", CACHE_PAGES);
+  size_ = records.size();
+  removed_ = 0u;
+}
+
+//! Arquivo reaproveitado
+/*! Retorna se o arquivo foi reaberto do disco em vez de recriado.
+ *  \return bool teste
+ */
+bool ManpageHeap::reopened() const {
+  return reopened_;
+}
+
+//! Quantidade de registros
+/*! \return size_t registros no arquivo
+ */
+size_t ManpageHeap::size() const {
+  return size_;
+}
+
+//! Registros removidos
+/*! \return size_t registros removidos desde a última compactação
+ */
+size_t ManpageHeap::removed() const {
+  return removed_;
+}
+
+//! Tamanho do arquivo
+/*! \return size_t tamanho em bytes
+ */
+size_t ManpageHeap::file_size() const {
+  return file_->size();
+}
+
+}  //  namespace structures
+
+#endif
@@ -0,0 +1,136 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_MAPPED_FILE_H
+#define STRUCTURES_MAPPED_FILE_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "./io_stats.h"
+
+using namespace std;
+
+namespace structures {
+
+//! Classe MappedFile
+/*! Arquivo inteiro mapeado em memória, somente leitura.
+ *  Usado depois que um índice foi confirmado e não muda mais: as
+ *  leituras viram acesso direto às páginas do sistema, sem chamada de
+ *  sistema nem cópia para um buffer próprio. Os acessos por at() contam
+ *  as páginas tocadas em IOStats.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class MappedFile {
+ public:
+  static const size_t PAGE_SIZE = 4096u;  //!< Página contada em IOStats
+
+  explicit MappedFile(const char* path);  // Construtor
+  ~MappedFile();  // Destrutor
+
+  const char* data() const;  // Início do mapeamento
+  const char* at(const size_t offset,
+                 const size_t length) const;  // Trecho do mapeamento
+  size_t size() const;  // Tamanho mapeado
+  void advise(const size_t offset, const size_t length,
+              const int advice) const;  // Dica de acesso
+
+ private:
+  char *data_{nullptr};  //!< Início do mapeamento
+  size_t size_{0u};  //!< Tamanho mapeado
+  uint64_t id_;  //!< Identifica o arquivo em IOStats
+};
+
+//! Construtor
+/*! Mapeia o arquivo inteiro, o descritor é fechado logo depois.
+ *  \param char* caminho do arquivo
+ *  \sa ~MappedFile()
+ */
+MappedFile::MappedFile(const char* path) :
+id_{IOStats::identify()}
+{
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    throw std::out_of_range("Erro ao abrir arquivo.");
+  IOStats::open();
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw std::out_of_range("Erro ao verificar tamanho do arquivo.");
+  }
+
+  size_ = st.st_size;
+  if (size_ != 0u) {
+    void *map = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      ::close(fd);
+      throw std::out_of_range("Erro ao mapear arquivo.");
+    }
+    data_ = static_cast<char*>(map);
+  }
+  ::close(fd);
+}
+
+//! Destrutor
+/*! Desfaz o mapeamento.
+ *  \sa MappedFile()
+ */
+MappedFile::~MappedFile() {
+  if (data_ != nullptr)
+    munmap(data_, size_);
+}
+
+//! Início do mapeamento
+/*! \return char* primeiro byte do arquivo
+ */
+const char* MappedFile::data() const {
+  return data_;
+}
+
+//! Trecho do mapeamento
+/*! Como data() + offset, contando as páginas do trecho como acessadas.
+ *  \param size_t deslocamento do trecho
+ *  \param size_t tamanho do trecho
+ *  \return char* primeiro byte do trecho
+ */
+const char* MappedFile::at(const size_t offset, const size_t length) const {
+  size_t last = length == 0u? offset : offset + length - 1;
+  for (size_t page = offset / PAGE_SIZE; page <= last / PAGE_SIZE; ++page)
+    IOStats::touch(id_, page);
+  return data_ + offset;
+}
+
+//! Tamanho mapeado
+/*! \return size_t bytes
+ */
+size_t MappedFile::size() const {
+  return size_;
+}
+
+//! Dica de acesso
+/*! Repassa um madvise() para as páginas do trecho, que é estendido
+ *  até o início da página.
+ *  \param size_t deslocamento do trecho
+ *  \param size_t tamanho do trecho
+ *  \param int MADV_SEQUENTIAL, MADV_WILLNEED, MADV_RANDOM...
+ */
+void MappedFile::advise(const size_t offset, const size_t length,
+                        const int advice) const {
+  if (data_ == nullptr || offset >= size_)
+    return;
+
+  size_t page = sysconf(_SC_PAGESIZE),
+         begin = offset - offset % page,
+         end = offset + length < size_? offset + length : size_;
+  madvise(data_ + begin, end - begin, advice);
+}
+
+}  //  namespace structures
+
+#endif
@@ -0,0 +1,234 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_NAME_INDEX_H
+#define STRUCTURES_NAME_INDEX_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "./page_cache.h"
+#include "./superblock.h"
+#include "./b_plus_tree_on_disk.h"
+
+using namespace std;
+
+namespace structures {
+
+//! Classe NameIndex
+/*! Índice só pelo nome do comando, name_index.dat, mantido junto da
+ *  árvore k-d. A árvore k-d alterna nome e tamanho a cada nível, então
+ *  quem só sabe o nome tem que descer pelos dois lados nos níveis de
+ *  tamanho; aqui uma busca lê uma página por nível da árvore B+.
+ *  Cada nome aponta para o docid da manpage na tabela de documentos,
+ *  que não muda na compactação do arquivo de dados; um nome removido
+ *  fica apontando para zero, que nunca é um docid.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class NameIndex {
+ public:
+  NameIndex();  // Construtor
+  explicit NameIndex(const uint64_t fingerprint);  // Reabre índice
+  ~NameIndex();  // Destrutor
+
+  static const uint64_t MAGIC = 0x3158444e4d414e4dull;  //!< "MNAMNDX1"
+  static const uint32_t VERSION = 3u;  //!< Versão do formato
+
+  void insert(const char* name, const size_t doc);  // Inserir
+  void replace(const char* name, const size_t from,
+               const size_t to);  // Troca docid do nome
+  bool find(const char* name, size_t* doc) const;  // Procura nome
+  size_t find(const vector<string>& names, vector<size_t>* docs,
+              vector<bool>* found) const;  // Procura vários nomes
+
+  void commit(const uint64_t fingerprint);  // Grava superbloco
+  void share();  // Leitura por várias threads
+
+  bool reopened() const;  // Índice reaproveitado
+  size_t size() const;  // Quantidade de nomes
+  size_t depth() const;  // Páginas lidas por busca
+  size_t file_size() const;  // Tamanho do arquivo
+
+ private:
+  static const size_t CACHE_PAGES = 64u;  //!< Páginas em memória
+
+  void create();  // Recria arquivo vazio
+
+  PageCache *file_{nullptr};  //!< Arquivo do índice
+  BPlusTreeOnDisk<uint32_t> *names_{nullptr};  //!< Nome -> docid
+  bool reopened_{false};  //!< Índice lido do disco
+};
+
+//! Construtor
+/*! Sem parâmetros, limpa o arquivo do índice.
+ *  \sa NameIndex(const uint64_t fingerprint), ~NameIndex()
+ */
+NameIndex::NameIndex() {
+  file_ = new PageCache("./name_index.dat", CACHE_PAGES);
+  names_ = new BPlusTreeOnDisk<uint32_t>(file_);
+  create();
+}
+
+//! Construtor
+/*! Reabre o índice gravado em disco se o superbloco corresponder às
+ *  entradas, senão limpa o arquivo como o construtor padrão.
+ *  \param uint64_t impressão digital das entradas
+ *  \sa NameIndex(), reopened()
+ */
+NameIndex::NameIndex(const uint64_t fingerprint) {
+  file_ = new PageCache("./name_index.dat", CACHE_PAGES);
+  names_ = new BPlusTreeOnDisk<uint32_t>(file_);
+
+  Superblock block;
+  if (block.load(file_) && block.matches(MAGIC, VERSION, fingerprint)) {
+    names_->restore(block.root_, block.depth_, block.size_);
+    reopened_ = true;
+  } else {
+    create();
+  }
+}
+
+//! Destrutor
+/*! Fecha o arquivo, escrevendo o que estiver pendente.
+ *  \sa NameIndex()
+ */
+NameIndex::~NameIndex() {
+  delete names_;
+  delete file_;
+}
+
+//! Recria arquivo
+/*! Esvazia o arquivo, deixando apenas um superbloco ainda não
+ *  confirmado.
+ *  \sa commit()
+ */
+void NameIndex::create() {
+  file_->truncate();
+  Superblock(MAGIC, VERSION).store(file_);
+  names_->clear();
+  reopened_ = false;
+}
+
+//! Confirma índice
+/*! Grava o superbloco com a impressão digital das entradas e escreve
+ *  as páginas pendentes.
+ *  \param uint64_t impressão digital das entradas
+ *  \sa NameIndex(const uint64_t fingerprint)
+ */
+void NameIndex::commit(const uint64_t fingerprint) {
+  Superblock block(MAGIC, VERSION);
+  block.fingerprint_ = fingerprint;
+  block.root_ = names_->root();
+  block.size_ = names_->size();
+  block.depth_ = names_->depth();
+  block.store(file_);
+  file_->flush();
+}
+
+//! Leitura por várias threads
+/*! Depois de confirmado o índice pode ser lido por várias threads,
+ *  cada uma com o seu cache do arquivo.
+ *  \sa commit(), PageCache::share()
+ */
+void NameIndex::share() {
+  file_->share();
+}
+
+//! Insere
+/*! Um nome repetido continua apontando para o primeiro docid, como
+ *  a primeira manpage com esse nome encontrada na árvore k-d, a menos
+ *  que esse tenha sido removido.
+ *  \param char* nome do comando
+ *  \param size_t docid da manpage
+ */
+void NameIndex::insert(const char* name, const size_t doc) {
+  uint32_t value;
+  if (!names_->find(name, &value) || value == 0u)
+    names_->insert(name, doc);
+}
+
+//! Troca docid do nome
+/*! Só troca se o nome ainda aponta para o docid antigo, assim a
+ *  remoção de uma manpage repetida não apaga o nome da outra.
+ *  \param char* nome do comando
+ *  \param size_t docid atual
+ *  \param size_t novo docid, zero para remover o nome
+ */
+void NameIndex::replace(const char* name, const size_t from,
+                        const size_t to) {
+  uint32_t value;
+  if (names_->find(name, &value) && value == from)
+    names_->insert(name, to);
+}
+
+//! Procura nome
+/*! \param char* nome do comando
+ *  \param size_t* onde copiar o docid
+ *  \return bool se o nome existe
+ */
+bool NameIndex::find(const char* name, size_t* doc) const {
+  uint32_t value;
+  if (!names_->find(name, &value) || value == 0u)
+    return false;
+  *doc = value;
+  return true;
+}
+
+//! Procura vários nomes
+/*! Busca em lote: os nomes são procurados em ordem e os que caem na
+ *  mesma folha custam uma única descida.
+ *  \param vector<string> nomes, em qualquer ordem
+ *  \param vector<size_t>* docids, na ordem dos nomes
+ *  \param vector<bool>* se cada nome existe, na ordem dos nomes
+ *  \return size_t quantidade de nomes encontrados
+ */
+size_t NameIndex::find(const vector<string>& names, vector<size_t>* docs,
+                       vector<bool>* found) const {
+  vector<uint32_t> values;
+  size_t hits = names_->find(names, &values, found);
+
+  docs->assign(values.begin(), values.end());
+  for (size_t i = 0; i < names.size(); ++i) {
+    if ((*found)[i] && values[i] == 0u) {
+      (*found)[i] = false;
+      --hits;
+    }
+  }
+  return hits;
+}
+
+//! Índice reaproveitado
+/*! Retorna se o índice foi reaberto do disco em vez de recriado.
+ *  \return bool teste
+ */
+bool NameIndex::reopened() const {
+  return reopened_;
+}
+
+//! Quantidade de nomes
+/*! \return size_t nomes distintos no índice
+ */
+size_t NameIndex::size() const {
+  return names_->size();
+}
+
+//! Páginas lidas por busca
+/*! \return size_t altura da árvore B+
+ */
+size_t NameIndex::depth() const {
+  return names_->depth();
+}
+
+//! Tamanho do arquivo
+/*! \return size_t tamanho em bytes
+ */
+size_t NameIndex::file_size() const {
+  return file_->size();
+}
+
+}  //  namespace structures
+
+#endif
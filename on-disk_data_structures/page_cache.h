@@ -0,0 +1,474 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_PAGE_CACHE_H
+#define STRUCTURES_PAGE_CACHE_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "./io_stats.h"
+
+using namespace std;
+
+namespace structures {
+
+//! Classe PageCache
+/*! Buffer pool de um arquivo em disco, compartilhado pelas árvores.
+ *  O arquivo fica aberto durante toda a vida do objeto e é lido e
+ *  escrito em páginas de tamanho fixo. As páginas ficam em quadros na
+ *  memória e são substituídas pelo algoritmo do relógio (CLOCK); páginas
+ *  sujas só voltam ao disco quando substituídas ou no flush().
+ *
+ *  Uma página pode ser fixada (pin) para ser usada diretamente pelo
+ *  ponteiro do quadro, enquanto fixada ela nunca é substituída.
+ *
+ *  Leituras que atravessam várias páginas ausentes trazem todas elas
+ *  com uma única chamada preadv().
+ *
+ *  Os quadros não são protegidos contra várias threads. Depois de
+ *  share() o arquivo fica somente leitura e cada thread que lê ganha o
+ *  seu próprio PageCache sobre o mesmo caminho, com descritor e quadros
+ *  próprios, então as leituras com pread() rodam em paralelo.
+ *
+ *  Aberturas, chamadas de leitura e escrita e acessos a páginas são
+ *  contados em IOStats.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class PageCache {
+ public:
+  static const size_t PAGE_SIZE = 4096u;  //!< Tamanho da página
+
+  explicit PageCache(const char* path, const size_t capacity = 1024u);  // Construtor
+  ~PageCache();  // Destrutor
+
+  void read(const size_t offset, void* data, const size_t length);  // Lê
+  void write(const size_t offset, const void* data, const size_t length);  // Escreve
+  size_t append(const void* data, const size_t length);  // Escreve no fim
+
+  char* pin(const size_t page);  // Fixa página
+  void unpin(const size_t page, const bool dirty);  // Libera página
+  void flush();  // Escreve páginas sujas
+  void truncate();  // Esvazia arquivo
+  void share();  // Passa para leitura concorrente
+
+  size_t size() const;  // Tamanho do arquivo
+
+ private:
+  //! Classe Frame
+  /*! Quadro da memória que guarda uma página.
+   *
+   *  \author João Vicente Souto.
+   *  \since 20/06/17
+   *  \version 1.0
+   */
+  class Frame {
+   public:
+    size_t page_{0u},  //!< Página guardada
+           pins_{0u};  //!< Quantidade de fixações
+    bool used_{false},  //!< Quadro ocupado
+         dirty_{false},  //!< Página modificada
+         referenced_{false};  //!< Bit do relógio
+    char *data_{nullptr};  //!< Conteúdo da página
+  };
+
+  static const size_t READAHEAD = 32u;  //!< Páginas por preadv()
+  static const size_t LOCAL_PAGES = 256u;  //!< Páginas de cada thread
+
+  PageCache* local();  // Cache da thread atual
+
+  size_t fetch(const size_t page);  // Traz página para um quadro
+  void prefetch(const size_t first, const size_t last);  // Traz várias páginas
+  size_t claim(const size_t page);  // Reserva quadro para a página
+  size_t victim();  // Escolhe quadro para substituir
+  void write_back(Frame& frame);  // Escreve quadro no disco
+
+  string path_;  //!< Caminho do arquivo
+  uint64_t id_;  //!< Identifica o arquivo nos caches das threads
+  bool shared_{false};  //!< Somente leitura, um cache por thread
+  int fd_{-1};  //!< Descritor do arquivo
+  size_t size_{0u},  //!< Tamanho lógico do arquivo
+         capacity_{0u},  //!< Quantidade de quadros
+         hand_{0u};  //!< Ponteiro do relógio
+  Frame *frames_{nullptr};  //!< Quadros
+  char *memory_{nullptr};  //!< Memória dos quadros
+  unordered_map<size_t, size_t> table_;  //!< Página -> quadro
+};
+
+//! Construtor
+/*! Abre, ou cria, o arquivo e reserva os quadros.
+ *  \param char* caminho do arquivo
+ *  \param size_t quantidade de páginas mantidas em memória
+ *  \sa ~PageCache()
+ */
+PageCache::PageCache(const char* path, const size_t capacity) :
+path_{path},
+capacity_{capacity == 0u? 1u : capacity}
+{
+  id_ = IOStats::identify();
+
+  fd_ = ::open(path, O_RDWR | O_CREAT, 0644);
+  if (fd_ < 0)
+    throw std::out_of_range("Erro ao abrir arquivo.");
+  IOStats::open();
+
+  struct stat st;
+  if (fstat(fd_, &st) != 0)
+    throw std::out_of_range("Erro ao verificar tamanho do arquivo.");
+  size_ = st.st_size;
+
+  frames_ = new Frame[capacity_];
+  memory_ = new char[capacity_ * PAGE_SIZE];
+  for (size_t i = 0; i < capacity_; ++i)
+    frames_[i].data_ = memory_ + i * PAGE_SIZE;
+  table_.reserve(capacity_);
+}
+
+//! Destrutor
+/*! Escreve as páginas sujas e fecha o arquivo.
+ *  \sa PageCache()
+ */
+PageCache::~PageCache() {
+  flush();
+  ::close(fd_);
+  delete[] frames_;
+  delete[] memory_;
+}
+
+//! Lê
+/*! Copia um trecho do arquivo, que pode atravessar várias páginas.
+ *  Trechos além do fim do arquivo são lidos como zero.
+ *  \param size_t deslocamento no arquivo
+ *  \param void* destino
+ *  \param size_t quantidade de bytes
+ *  \sa write()
+ */
+void PageCache::read(const size_t offset, void* data, const size_t length) {
+  if (shared_) {
+    local()->read(offset, data, length);
+    return;
+  }
+
+  char *out = static_cast<char*>(data);
+  size_t done = 0u;
+
+  if (length > 0u && offset / PAGE_SIZE != (offset + length - 1) / PAGE_SIZE)
+    prefetch(offset / PAGE_SIZE, (offset + length - 1) / PAGE_SIZE);
+
+  while (done < length) {
+    size_t position = offset + done,
+           page = position / PAGE_SIZE,
+           begin = position % PAGE_SIZE,
+           count = PAGE_SIZE - begin < length - done?
+                   PAGE_SIZE - begin : length - done;
+
+    Frame& frame = frames_[fetch(page)];
+    memcpy(out + done, frame.data_ + begin, count);
+    done += count;
+  }
+}
+
+//! Escreve
+/*! Copia um trecho para as páginas em memória e as marca como sujas.
+ *  \param size_t deslocamento no arquivo
+ *  \param void* origem
+ *  \param size_t quantidade de bytes
+ *  \sa read(), append()
+ */
+void PageCache::write(const size_t offset, const void* data,
+                      const size_t length) {
+  if (shared_)
+    throw std::out_of_range("Arquivo compartilhado é somente leitura.");
+
+  const char *in = static_cast<const char*>(data);
+  size_t done = 0u;
+
+  while (done < length) {
+    size_t position = offset + done,
+           page = position / PAGE_SIZE,
+           begin = position % PAGE_SIZE,
+           count = PAGE_SIZE - begin < length - done?
+                   PAGE_SIZE - begin : length - done;
+
+    Frame& frame = frames_[fetch(page)];
+    memcpy(frame.data_ + begin, in + done, count);
+    frame.dirty_ = true;
+    done += count;
+
+    // A cada página, para uma página desta escrita que sair do cache
+    // antes do fim ser gravada inteira por write_back()
+    if (offset + done > size_)
+      size_ = offset + done;
+  }
+}
+
+//! Escreve no fim
+/*! Acrescenta um trecho no fim do arquivo.
+ *  \param void* origem
+ *  \param size_t quantidade de bytes
+ *  \return size_t deslocamento onde o trecho foi escrito
+ *  \sa write()
+ */
+size_t PageCache::append(const void* data, const size_t length) {
+  size_t offset = size_;
+  write(offset, data, length);
+  return offset;
+}
+
+//! Fixa página
+/*! Traz a página para a memória e impede que seja substituída até o
+ *  unpin() correspondente.
+ *  \param size_t número da página
+ *  \return char* conteúdo da página, PAGE_SIZE bytes
+ *  \sa unpin()
+ */
+char* PageCache::pin(const size_t page) {
+  if (shared_)
+    return local()->pin(page);
+
+  Frame& frame = frames_[fetch(page)];
+  ++frame.pins_;
+  return frame.data_;
+}
+
+//! Libera página
+/*! Desfaz um pin(), informando se a página foi modificada.
+ *  \param size_t número da página
+ *  \param bool página modificada
+ *  \sa pin()
+ */
+void PageCache::unpin(const size_t page, const bool dirty) {
+  if (shared_) {
+    if (dirty)
+      throw std::out_of_range("Arquivo compartilhado é somente leitura.");
+    local()->unpin(page, false);
+    return;
+  }
+
+  auto it = table_.find(page);
+  if (it == table_.end() || frames_[it->second].pins_ == 0u)
+    throw std::out_of_range("Página não fixada.");
+
+  Frame& frame = frames_[it->second];
+  --frame.pins_;
+  if (dirty) {
+    frame.dirty_ = true;
+    if ((page + 1) * PAGE_SIZE > size_)
+      size_ = (page + 1) * PAGE_SIZE;
+  }
+}
+
+//! Escreve páginas sujas
+/*! Escreve no disco todas as páginas modificadas.
+ *  \sa truncate()
+ */
+void PageCache::flush() {
+  for (size_t i = 0; i < capacity_; ++i)
+    if (frames_[i].used_ && frames_[i].dirty_)
+      write_back(frames_[i]);
+}
+
+//! Esvazia arquivo
+/*! Descarta todas as páginas e trunca o arquivo para zero bytes.
+ *  \sa flush()
+ */
+void PageCache::truncate() {
+  if (shared_)
+    throw std::out_of_range("Arquivo compartilhado é somente leitura.");
+
+  for (size_t i = 0; i < capacity_; ++i) {
+    if (frames_[i].pins_ != 0u)
+      throw std::out_of_range("Página fixada durante truncate.");
+    frames_[i].used_ = frames_[i].dirty_ = frames_[i].referenced_ = false;
+  }
+  table_.clear();
+
+  if (ftruncate(fd_, 0) != 0)
+    throw std::out_of_range("Erro ao truncar arquivo.");
+  size_ = 0u;
+}
+
+//! Leitura concorrente
+/*! Escreve as páginas sujas e a partir daqui o arquivo só é lido, por
+ *  qualquer thread, cada uma pelo seu cache (local()). Escritas passam
+ *  a ser erro.
+ *  \sa local()
+ */
+void PageCache::share() {
+  flush();
+  shared_ = true;
+}
+
+//! Cache da thread atual
+/*! Na primeira leitura de cada thread abre o arquivo de novo, com
+ *  quadros só dela; o cache dura até a thread terminar.
+ *  \return PageCache* cache desta thread para este arquivo
+ *  \sa share()
+ */
+PageCache* PageCache::local() {
+  thread_local unordered_map<uint64_t, unique_ptr<PageCache>> handles;
+  unique_ptr<PageCache>& handle = handles[id_];
+  if (!handle)
+    handle.reset(new PageCache(path_.c_str(), LOCAL_PAGES));
+  return handle.get();
+}
+
+//! Tamanho do arquivo
+/*! Tamanho lógico, já contando o que ainda não foi escrito no disco.
+ *  \return size_t tamanho em bytes
+ */
+size_t PageCache::size() const {
+  return size_;
+}
+
+//! Traz página
+/*! Procura a página nos quadros, se não estiver lê do disco para o
+ *  quadro escolhido pelo relógio.
+ *  \param size_t número da página
+ *  \return size_t índice do quadro
+ *  \sa claim(), prefetch()
+ */
+size_t PageCache::fetch(const size_t page) {
+  IOStats::touch(id_, page);
+  auto it = table_.find(page);
+  if (it != table_.end()) {
+    frames_[it->second].referenced_ = true;
+    return it->second;
+  }
+
+  size_t index = claim(page);
+  Frame& frame = frames_[index];
+  ssize_t count = pread(fd_, frame.data_, PAGE_SIZE, page * PAGE_SIZE);
+  if (count < 0)
+    throw std::out_of_range("Erro ao ler página.");
+  IOStats::read(count);
+  memset(frame.data_ + count, 0, PAGE_SIZE - count);
+  return index;
+}
+
+//! Traz várias páginas
+/*! Cada sequência de páginas ausentes no intervalo é lida do disco
+ *  com um só preadv(), direto para os quadros.
+ *  \param size_t primeira página
+ *  \param size_t última página
+ *  \sa fetch()
+ */
+void PageCache::prefetch(const size_t first, const size_t last) {
+  size_t limit = capacity_ / 2 < READAHEAD? capacity_ / 2 : READAHEAD;
+  size_t page = first;
+
+  while (page <= last) {
+    if (table_.count(page) != 0u) {
+      ++page;
+      continue;
+    }
+
+    struct iovec io[READAHEAD];
+    size_t frames[READAHEAD], run = 0u;
+    while (page + run <= last && run < limit &&
+           table_.count(page + run) == 0u) {
+      frames[run] = claim(page + run);
+      ++frames_[frames[run]].pins_;  // não pode ser escolhido de novo
+      io[run].iov_base = frames_[frames[run]].data_;
+      io[run].iov_len = PAGE_SIZE;
+      ++run;
+    }
+
+    if (run == 0u) {  // cache pequeno demais, lê uma por vez
+      fetch(page++);
+      continue;
+    }
+
+    ssize_t count = preadv(fd_, io, run, page * PAGE_SIZE);
+    if (count < 0)
+      throw std::out_of_range("Erro ao ler página.");
+    IOStats::read(count);
+
+    for (size_t i = 0; i < run; ++i) {
+      Frame& frame = frames_[frames[i]];
+      ssize_t valid = count - static_cast<ssize_t>(i * PAGE_SIZE);
+      valid = valid < 0? 0 : (valid > static_cast<ssize_t>(PAGE_SIZE)?
+                              PAGE_SIZE : valid);
+      memset(frame.data_ + valid, 0, PAGE_SIZE - valid);
+      --frame.pins_;
+    }
+    page += run;
+  }
+}
+
+//! Reserva quadro
+/*! Libera o quadro escolhido pelo relógio e o associa à página, sem
+ *  ler o conteúdo.
+ *  \param size_t número da página
+ *  \return size_t índice do quadro
+ *  \sa victim()
+ */
+size_t PageCache::claim(const size_t page) {
+  size_t index = victim();
+  Frame& frame = frames_[index];
+  if (frame.used_) {
+    if (frame.dirty_)
+      write_back(frame);
+    table_.erase(frame.page_);
+  }
+
+  frame.page_ = page;
+  frame.used_ = frame.referenced_ = true;
+  frame.dirty_ = false;
+  table_[page] = index;
+  return index;
+}
+
+//! Escolhe quadro
+/*! Algoritmo do relógio: quadros livres primeiro, senão o primeiro
+ *  quadro não fixado com o bit de referência desligado.
+ *  \return size_t índice do quadro
+ *  \sa fetch()
+ */
+size_t PageCache::victim() {
+  for (size_t turns = 0; turns < 2 * capacity_ + 1; ++turns) {
+    Frame& frame = frames_[hand_];
+    size_t index = hand_;
+    hand_ = (hand_ + 1) % capacity_;
+
+    if (!frame.used_)
+      return index;
+    if (frame.pins_ != 0u)
+      continue;
+    if (!frame.referenced_)
+      return index;
+    frame.referenced_ = false;
+  }
+
+  throw std::out_of_range("Todas as páginas estão fixadas.");
+}
+
+//! Escreve quadro
+/*! Escreve a parte válida da página no disco.
+ *  \param Frame& quadro sujo
+ *  \sa flush()
+ */
+void PageCache::write_back(Frame& frame) {
+  size_t begin = frame.page_ * PAGE_SIZE;
+  if (begin < size_) {
+    size_t count = size_ - begin < PAGE_SIZE? size_ - begin : PAGE_SIZE;
+    if (pwrite(fd_, frame.data_, count, begin) != static_cast<ssize_t>(count))
+      throw std::out_of_range("Erro ao escrever página.");
+    IOStats::write(count);
+  }
+  frame.dirty_ = false;
+}
+
+}  //  namespace structures
+
+#endif
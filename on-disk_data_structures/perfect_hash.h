@@ -0,0 +1,69 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_PERFECT_HASH_H
+#define STRUCTURES_PERFECT_HASH_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace structures {
+
+//! Classe PerfectHash
+/*! Funções do hash perfeito das palavras ignoradas, compartilhadas
+ *  pelo gerador (stop_words_generator.cpp) e pela tabela gerada
+ *  (stop_words.h). Um único hash de 64 bits escolhe o balde e dá as
+ *  duas metades usadas no deslocamento: posição = (h1 + d * h2) mod
+ *  tamanho, onde d é o deslocamento do balde encontrado pelo gerador.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class PerfectHash {
+ public:
+  static uint64_t hash(const char* data, const size_t length);  // FNV-1a
+  static size_t bucket(const uint64_t hash, const size_t buckets);  // Balde
+  static size_t slot(const uint64_t hash, const uint32_t displacement,
+                     const size_t size);  // Posição na tabela
+};
+
+//! Hash FNV-1a
+/*! \param char* palavra
+ *  \param size_t tamanho da palavra
+ *  \return uint64_t hash
+ */
+uint64_t PerfectHash::hash(const char* data, const size_t length) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+//! Balde
+/*! \param uint64_t hash da palavra
+ *  \param size_t quantidade de baldes
+ *  \return size_t balde da palavra
+ */
+size_t PerfectHash::bucket(const uint64_t hash, const size_t buckets) {
+  return (hash >> 40) % buckets;
+}
+
+//! Posição na tabela
+/*! O passo h2 é ímpar, então com um tamanho potência de dois os
+ *  deslocamentos de um balde passam por todas as posições.
+ *  \param uint64_t hash da palavra
+ *  \param uint32_t deslocamento do balde
+ *  \param size_t tamanho da tabela, potência de dois
+ *  \return size_t posição
+ */
+size_t PerfectHash::slot(const uint64_t hash, const uint32_t displacement,
+                         const size_t size) {
+  uint64_t h1 = hash & 0xffffffffu,
+           h2 = (hash >> 32) | 1u;
+  return (h1 + displacement * h2) & (size - 1);
+}
+
+}  //  namespace structures
+
+#endif
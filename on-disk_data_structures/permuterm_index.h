@@ -0,0 +1,305 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_PERMUTERM_INDEX_H
+#define STRUCTURES_PERMUTERM_INDEX_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_set>
+
+#include "./page_cache.h"
+#include "./superblock.h"
+#include "./b_plus_tree_on_disk.h"
+#include "./posting_list_on_disk.h"
+
+using namespace std;
+
+namespace structures {
+
+//! Classe PermutermIndex
+/*! Índice permuterm das chaves secundárias, permuterm.dat, para
+ *  consultas com curinga no começo ou no meio da palavra.
+ *  Cada palavra ganha um '$' no fim e todas as suas rotações entram em
+ *  uma árvore B+, apontando para a lista da palavra: "sock" gera
+ *  "sock$", "ock$s", "ck$so" e "k$soc". Um curinga vira uma busca por
+ *  prefixo nas rotações: "*printf" procura "printf$", "*print*" procura
+ *  "print" e "s*et" procura "et$s". A rotação "$sock" fica de fora,
+ *  "sock*" é atendido pelo próprio dicionário.
+ *  Palavras novas de uma atualização entram com insert(); as listas
+ *  guardadas aqui podem ficar velhas, quem usa relê cada palavra achada
+ *  no dicionário.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class PermutermIndex {
+ public:
+  typedef PostingListOnDisk::Term Term;
+  typedef vector<pair<string, Term>> Terms;
+
+  PermutermIndex();  // Construtor
+  explicit PermutermIndex(const uint64_t fingerprint);  // Reabre índice
+  ~PermutermIndex();  // Destrutor
+
+  static const uint64_t MAGIC = 0x3154554d5245504dull;  //!< "MPERMUT1"
+  static const uint32_t VERSION = 3u;  //!< Versão do formato
+  static const char END = '$';  //!< Marca de fim da palavra
+  static const size_t MAX_WORD = 64u;  //!< Maior palavra com rotações
+
+  void build(const Terms& terms);  // Monta índice
+  void insert(const string& word, const Term& term);  // Acrescenta palavra
+  void find(const string& pattern, Terms* out) const;  // Palavras do curinga
+  static bool matches(const char* pattern, const char* word);  // Casa curinga
+
+  void commit(const uint64_t fingerprint);  // Grava superbloco
+  void share();  // Leitura por várias threads
+
+  bool reopened() const;  // Índice reaproveitado
+  size_t size() const;  // Quantidade de rotações
+  size_t file_size() const;  // Tamanho do arquivo
+
+ private:
+  static const size_t CACHE_PAGES = 64u;  //!< Páginas em memória
+
+  void create();  // Recria arquivo vazio
+
+  PageCache *file_{nullptr};  //!< Arquivo do índice
+  BPlusTreeOnDisk<Term> *rotations_{nullptr};  //!< Rotação -> lista
+  bool reopened_{false};  //!< Índice lido do disco
+};
+
+//! Construtor
+/*! Sem parâmetros, limpa o arquivo do índice.
+ *  \sa PermutermIndex(const uint64_t fingerprint), ~PermutermIndex()
+ */
+PermutermIndex::PermutermIndex() {
+  file_ = new PageCache("./permuterm.dat", CACHE_PAGES);
+  rotations_ = new BPlusTreeOnDisk<Term>(file_);
+  create();
+}
+
+//! Construtor
+/*! Reabre o índice gravado em disco se o superbloco corresponder às
+ *  entradas, senão limpa o arquivo como o construtor padrão.
+ *  \param uint64_t impressão digital das entradas
+ *  \sa PermutermIndex(), reopened()
+ */
+PermutermIndex::PermutermIndex(const uint64_t fingerprint) {
+  file_ = new PageCache("./permuterm.dat", CACHE_PAGES);
+  rotations_ = new BPlusTreeOnDisk<Term>(file_);
+
+  Superblock block;
+  if (block.load(file_) && block.matches(MAGIC, VERSION, fingerprint)) {
+    rotations_->restore(block.root_, block.depth_, block.size_);
+    reopened_ = true;
+  } else {
+    create();
+  }
+}
+
+//! Destrutor
+/*! Fecha o arquivo, escrevendo o que estiver pendente.
+ *  \sa PermutermIndex()
+ */
+PermutermIndex::~PermutermIndex() {
+  delete rotations_;
+  delete file_;
+}
+
+//! Recria arquivo
+/*! Esvazia o arquivo, deixando apenas um superbloco ainda não
+ *  confirmado.
+ *  \sa commit()
+ */
+void PermutermIndex::create() {
+  file_->truncate();
+  Superblock(MAGIC, VERSION).store(file_);
+  rotations_->clear();
+  reopened_ = false;
+}
+
+//! Confirma índice
+/*! Grava o superbloco com a impressão digital das entradas e escreve
+ *  as páginas pendentes.
+ *  \param uint64_t impressão digital das entradas
+ *  \sa PermutermIndex(const uint64_t fingerprint)
+ */
+void PermutermIndex::commit(const uint64_t fingerprint) {
+  Superblock block(MAGIC, VERSION);
+  block.fingerprint_ = fingerprint;
+  block.root_ = rotations_->root();
+  block.size_ = rotations_->size();
+  block.depth_ = rotations_->depth();
+  block.store(file_);
+  file_->flush();
+}
+
+//! Leitura por várias threads
+/*! Depois de confirmado o índice pode ser lido por várias threads,
+ *  cada uma com o seu cache do arquivo.
+ *  \sa commit(), PageCache::share()
+ */
+void PermutermIndex::share() {
+  file_->share();
+}
+
+//! Monta índice
+/*! Recria o arquivo com as rotações de todas as palavras. As rotações
+ *  são ordenadas como pares (palavra, deslocamento), sem montar as
+ *  strings, e carregadas em ordem na árvore. Uma palavra de tamanho n
+ *  gera n rotações de n+1 caracteres, então palavras maiores que
+ *  MAX_WORD ficam de fora; essas só são achadas por prefixo.
+ *  \param Terms palavras do dicionário e suas listas
+ */
+void PermutermIndex::build(const Terms& terms) {
+  create();
+
+  // Caractere k da rotação s da palavra w: (w + END)[(s + k) % tamanho]
+  auto at = [&terms](uint32_t word, size_t shift, size_t k) {
+    const string& text = terms[word].first;
+    size_t position = (shift + k) % (text.size() + 1);
+    return position == text.size()? END : text[position];
+  };
+
+  vector<pair<uint32_t, uint8_t>> order;
+  for (size_t i = 0; i < terms.size(); ++i) {
+    size_t length = terms[i].first.size() + 1;
+    if (length - 1 > MAX_WORD)
+      continue;
+    for (size_t shift = 0; shift + 1 < length; ++shift)
+      order.push_back(make_pair(i, shift));
+  }
+
+  sort(order.begin(), order.end(),
+       [&terms, &at](const pair<uint32_t, uint8_t>& a,
+                     const pair<uint32_t, uint8_t>& b) {
+    size_t length = min(terms[a.first].first.size(),
+                        terms[b.first].first.size()) + 1;
+    for (size_t k = 0; k < length; ++k) {
+      char x = at(a.first, a.second, k), y = at(b.first, b.second, k);
+      if (x != y)
+        return static_cast<unsigned char>(x) < static_cast<unsigned char>(y);
+    }
+    return terms[a.first].first.size() < terms[b.first].first.size();
+  });
+
+  string key;
+  for (const pair<uint32_t, uint8_t>& rotation : order) {
+    key.resize(terms[rotation.first].first.size() + 1);
+    for (size_t k = 0; k < key.size(); ++k)
+      key[k] = at(rotation.first, rotation.second, k);
+    rotations_->bulk_insert(key.c_str(), terms[rotation.first].second);
+  }
+  rotations_->bulk_finish();
+}
+
+//! Acrescenta palavra
+/*! Insere as rotações de uma palavra nova, uma a uma, sem reconstruir
+ *  o índice. Como em build(), palavras grandes demais ficam de fora.
+ *  \param string palavra
+ *  \param Term lista da palavra
+ *  \sa build()
+ */
+void PermutermIndex::insert(const string& word, const Term& term) {
+  if (word.size() > MAX_WORD)
+    return;
+
+  size_t length = word.size() + 1;
+
+  string rotation = word + END;
+  for (size_t shift = 0; shift + 1 < length; ++shift) {
+    rotations_->insert(rotation.c_str(), term);
+    rotation = rotation.substr(1) + rotation[0];
+  }
+}
+
+//! Palavras do curinga
+/*! Gira o padrão até o último '*' ficar no fim e procura as rotações
+ *  com o que vem antes dele como prefixo: "a*b" vira "b$a", "*a*" vira
+ *  "a". Com mais de um '*' o prefixo usa só as pontas e o resto é
+ *  conferido em cada palavra achada.
+ *  \param string padrão com pelo menos um '*' que não seja só no fim
+ *  \param Terms* palavras que casam com o padrão, sem repetir
+ *  \sa matches()
+ */
+void PermutermIndex::find(const string& pattern, Terms* out) const {
+  size_t first = pattern.find('*'), last = pattern.rfind('*');
+  if (first == string::npos)
+    return;
+
+  string prefix = pattern.substr(last + 1) + END + pattern.substr(0, first);
+  if (last == pattern.size() - 1 && first == 0u)
+    prefix = pattern.substr(1, pattern.size() - 2);  // *a* e *a*b*
+  if (prefix.find('*') != string::npos)
+    prefix = prefix.substr(0, prefix.find('*'));
+
+  Terms rotations;
+  rotations_->scan(prefix.c_str(), &rotations);
+
+  unordered_set<string> seen;
+  for (const pair<string, Term>& rotation : rotations) {
+    size_t end = rotation.first.find(END);
+    string word = rotation.first.substr(end + 1) +
+                  rotation.first.substr(0, end);
+    if (matches(pattern.c_str(), word.c_str()) && seen.insert(word).second)
+      out->push_back(make_pair(word, rotation.second));
+  }
+}
+
+//! Casa curinga
+/*! Cada '*' do padrão casa com qualquer sequência, inclusive vazia.
+ *  Guloso, volta só até o último '*' visto.
+ *  \param char* padrão
+ *  \param char* palavra
+ *  \return bool se a palavra casa com o padrão inteiro
+ */
+bool PermutermIndex::matches(const char* pattern, const char* word) {
+  const char *star = nullptr, *retry = nullptr;
+  while (*word != '\0') {
+    if (*pattern == '*') {
+      star = pattern++;
+      retry = word;
+    } else if (*pattern == *word) {
+      ++pattern;
+      ++word;
+    } else if (star != nullptr) {
+      pattern = star + 1;
+      word = ++retry;
+    } else {
+      return false;
+    }
+  }
+  while (*pattern == '*')
+    ++pattern;
+  return *pattern == '\0';
+}
+
+//! Índice reaproveitado
+/*! Retorna se o índice foi reaberto do disco em vez de recriado.
+ *  \return bool teste
+ */
+bool PermutermIndex::reopened() const {
+  return reopened_;
+}
+
+//! Quantidade de rotações
+/*! \return size_t rotações no índice
+ */
+size_t PermutermIndex::size() const {
+  return rotations_->size();
+}
+
+//! Tamanho do arquivo
+/*! \return size_t tamanho em bytes
+ */
+size_t PermutermIndex::file_size() const {
+  return file_->size();
+}
+
+}  //  namespace structures
+
+#endif
@@ -0,0 +1,190 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_POSITIONS_ON_DISK_H
+#define STRUCTURES_POSITIONS_ON_DISK_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "./page_cache.h"
+#include "./superblock.h"
+#include "./varint.h"
+
+using namespace std;
+
+namespace structures {
+
+//! Classe PositionsOnDisk
+/*! Índice posicional opcional, positions.dat. Para cada palavra de
+ *  cada manpage guarda as posições em que ela aparece no texto, contando
+ *  todas as palavras, inclusive as ignoradas. As posições são gravadas
+ *  na indexação, manpage por manpage, como diferenças em Varint; a
+ *  lista da chave secundária guarda só onde começam as de cada
+ *  documento. A quantidade de posições é a frequência que já está na
+ *  lista, então nenhum tamanho é gravado aqui.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class PositionsOnDisk {
+ public:
+  PositionsOnDisk();  // Construtor
+  explicit PositionsOnDisk(const uint64_t fingerprint);  // Reabre índice
+  ~PositionsOnDisk();  // Destrutor
+
+  static const uint64_t MAGIC = 0x314e5449534f504dull;  //!< "MPOSITN1"
+  static const uint32_t VERSION = 1u;  //!< Versão do formato
+
+  size_t write(const vector<uint32_t>& positions);  // Grava posições
+  void read(const size_t offset, const size_t count,
+            vector<uint32_t>* positions) const;  // Lê posições
+
+  void clear();  // Recria arquivo vazio
+  void commit(const uint64_t fingerprint);  // Grava superbloco
+  void share();  // Leitura por várias threads
+
+  bool reopened() const;  // Índice reaproveitado
+  size_t file_size() const;  // Tamanho do arquivo
+
+ private:
+  static const size_t CACHE_PAGES = 64u;  //!< Páginas em memória
+
+  PageCache *file_{nullptr};  //!< Arquivo das posições
+  vector<char> buffer_;  //!< Codificação da última escrita
+  bool reopened_{false};  //!< Índice lido do disco
+};
+
+//! Construtor
+/*! Sem parâmetros, limpa o arquivo das posições.
+ *  \sa PositionsOnDisk(const uint64_t fingerprint), ~PositionsOnDisk()
+ */
+PositionsOnDisk::PositionsOnDisk() {
+  file_ = new PageCache("./positions.dat", CACHE_PAGES);
+  clear();
+}
+
+//! Construtor
+/*! Reabre as posições gravadas em disco se o superbloco corresponder
+ *  às entradas, senão limpa o arquivo como o construtor padrão.
+ *  \param uint64_t impressão digital das entradas
+ *  \sa PositionsOnDisk(), reopened()
+ */
+PositionsOnDisk::PositionsOnDisk(const uint64_t fingerprint) {
+  file_ = new PageCache("./positions.dat", CACHE_PAGES);
+
+  Superblock block;
+  if (block.load(file_) && block.matches(MAGIC, VERSION, fingerprint))
+    reopened_ = true;
+  else
+    clear();
+}
+
+//! Destrutor
+/*! Fecha o arquivo, escrevendo o que estiver pendente.
+ *  \sa PositionsOnDisk()
+ */
+PositionsOnDisk::~PositionsOnDisk() {
+  delete file_;
+}
+
+//! Recria arquivo
+/*! Esvazia o arquivo, deixando apenas um superbloco ainda não
+ *  confirmado. As posições começam depois dele, então o deslocamento
+ *  zero fica livre para dizer que um documento não tem posições.
+ *  \sa commit()
+ */
+void PositionsOnDisk::clear() {
+  file_->truncate();
+  Superblock(MAGIC, VERSION).store(file_);
+  reopened_ = false;
+}
+
+//! Confirma índice
+/*! Grava o superbloco com a impressão digital das entradas e escreve
+ *  as páginas pendentes.
+ *  \param uint64_t impressão digital das entradas
+ *  \sa PositionsOnDisk(const uint64_t fingerprint)
+ */
+void PositionsOnDisk::commit(const uint64_t fingerprint) {
+  Superblock block(MAGIC, VERSION);
+  block.fingerprint_ = fingerprint;
+  block.size_ = file_->size();
+  block.store(file_);
+  file_->flush();
+}
+
+//! Leitura por várias threads
+/*! Depois de confirmadas as posições podem ser lidas por várias
+ *  threads, cada uma com o seu cache do arquivo.
+ *  \sa commit(), PageCache::share()
+ */
+void PositionsOnDisk::share() {
+  file_->share();
+}
+
+//! Grava posições
+/*! Acrescenta as posições de uma palavra em um documento no fim do
+ *  arquivo.
+ *  \param vector<uint32_t> posições em ordem crescente
+ *  \return size_t deslocamento, para a lista da chave secundária
+ *  \sa read()
+ */
+size_t PositionsOnDisk::write(const vector<uint32_t>& positions) {
+  buffer_.resize(positions.size() * Varint::MAX_SIZE);
+  size_t length = 0u;
+  uint32_t last = 0u;
+  for (uint32_t position : positions) {
+    length += Varint::encode(position - last, buffer_.data() + length);
+    last = position;
+  }
+  return file_->append(buffer_.data(), length);
+}
+
+//! Lê posições
+/*! \param size_t deslocamento devolvido por write(), zero se não houver
+ *  \param size_t quantidade de posições, a frequência na lista
+ *  \param vector<uint32_t>* posições em ordem crescente
+ *  \sa write()
+ */
+void PositionsOnDisk::read(const size_t offset, const size_t count,
+                           vector<uint32_t>* positions) const {
+  positions->clear();
+  if (count == 0u || offset == 0u || offset >= file_->size())
+    return;
+
+  size_t length = count * Varint::size(UINT32_MAX);
+  if (length > file_->size() - offset)
+    length = file_->size() - offset;
+
+  vector<char> data(length + Varint::MAX_SIZE, '\0');
+  file_->read(offset, data.data(), length);
+
+  uint64_t delta, position = 0u;
+  size_t done = 0u;
+  positions->reserve(count);
+  for (size_t i = 0; i < count && done < length; ++i) {
+    done += Varint::decode(data.data() + done, &delta);
+    position += delta;
+    positions->push_back(position);
+  }
+}
+
+//! Índice reaproveitado
+/*! Retorna se as posições foram reabertas do disco em vez de recriadas.
+ *  \return bool teste
+ */
+bool PositionsOnDisk::reopened() const {
+  return reopened_;
+}
+
+//! Tamanho do arquivo
+/*! \return size_t tamanho em bytes
+ */
+size_t PositionsOnDisk::file_size() const {
+  return file_->size();
+}
+
+}  //  namespace structures
+
+#endif
@@ -0,0 +1,628 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_POSTING_LIST_ON_DISK_H
+#define STRUCTURES_POSTING_LIST_ON_DISK_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "./page_cache.h"
+#include "./varint.h"
+
+using namespace std;
+
+namespace structures {
+
+//! Classe PostingListOnDisk
+/*! Listas de documentos das chaves secundárias, gravadas em blocos
+ *  contíguos. Dentro de um bloco os documentos ficam ordenados e cada
+ *  um é guardado como a diferença para o anterior seguida de quantas
+ *  vezes a palavra aparece no documento, as duas em Varint. Os
+ *  documentos são docids da tabela de documentos, densos e de 32 bits,
+ *  então as diferenças são pequenas e o cabeçalho do bloco é curto.
+ *  Com o índice posicional ligado vem ainda a diferença para o
+ *  deslocamento das posições do documento anterior em PositionsOnDisk.
+ *  Quando um bloco enche a lista continua em um bloco novo, duas vezes
+ *  maior, encadeado ao anterior; assim listas curtas ocupam poucos bytes
+ *  e listas longas são lidas em poucas leituras sequenciais. Listas de
+ *  um único documento, a maioria das palavras, nem chegam a ter bloco:
+ *  o documento fica no próprio Term.
+ *
+ *  Cada bloco, e cada Term para a lista inteira, guarda a maior
+ *  frequência e a menor razão entre tamanho do documento e frequência
+ *  que contém. Com as duas a busca ranqueada calcula um limite para a
+ *  pontuação de qualquer documento do bloco sem ler o conteúdo dele.
+ *
+ *  Blocos menores que uma página são recortados de páginas reservadas
+ *  para isso, os maiores ocupam páginas inteiras. O fim do arquivo fica
+ *  sempre alinhado em página para conviver com os nodes da árvore B+.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class PostingListOnDisk {
+ public:
+  //! Classe Term
+  /*! Valor guardado no dicionário para cada chave secundária.
+   *
+   *  \author João Vicente Souto.
+   *  \since 20/06/17
+   *  \version 1.0
+   */
+  class Term {
+   public:
+    uint64_t head_{0u},  //!< Primeiro bloco, ou o documento se count_ == 1
+             tail_{0u},  //!< Último bloco, ou as posições se count_ == 1
+             count_{0u};  //!< Quantidade de documentos
+    uint32_t frequency_{0u},  //!< Maior frequência na lista
+             ratio_{0u};  //!< Menor tamanho / frequência na lista
+  };
+
+  class Cursor;
+
+  explicit PostingListOnDisk(PageCache* file,
+                             const bool positional = false);  // Construtor
+  ~PostingListOnDisk();  // Destrutor
+
+  void append(Term* term, const size_t doc, const size_t frequency = 1u,
+              const size_t words = 0u,
+              const size_t positions = 0u);  // Acrescenta documento
+  void assign(Term* term, const vector<size_t>& docs,
+              const vector<size_t>& frequencies,
+              const vector<size_t>& words,
+              const vector<size_t>& positions);  // Grava lista inteira
+  bool positional() const;  // Guarda posições
+  void read(const Term& term, vector<size_t>* docs) const;  // Lê lista
+  void reset();  // Esquece página parcial
+
+ private:
+  static const size_t MIN_BLOCK = 64u;  //!< Primeiro bloco de uma lista
+  static const size_t MAX_BLOCK = 16u * PageCache::PAGE_SIZE;  //!< Maior bloco
+  static const size_t GROWTH = 2u;  //!< Fator de crescimento
+  static const size_t BULK_DOCS = 128u;  //!< Documentos por bloco na carga
+
+  //! Classe Block
+  /*! Cabeçalho de um bloco, seguido pelas diferenças codificadas.
+   *
+   *  \author João Vicente Souto.
+   *  \since 20/06/17
+   *  \version 1.0
+   */
+  class Block {
+   public:
+    uint64_t next_{0u};  //!< Próximo bloco
+    uint32_t first_{0u},  //!< Primeiro documento
+             last_{0u},  //!< Último documento
+             size_{0u};  //!< Tamanho total do bloco
+    uint16_t used_{0u},  //!< Bytes usados depois do cabeçalho
+             count_{0u};  //!< Quantidade de documentos
+    uint32_t frequency_{0u},  //!< Maior frequência no bloco
+             ratio_{0u};  //!< Menor tamanho / frequência no bloco
+    uint64_t positions_{0u};  //!< Posições do último documento
+  };
+
+  size_t start(const size_t size, const size_t doc, const size_t frequency,
+               const size_t words, const size_t positions);  // Novo bloco
+  size_t encode(const size_t doc, const size_t frequency,
+                const size_t positions, char* out) const;  // Codifica documento
+  static void widen(const size_t count, const size_t frequency,
+                    const size_t words, uint32_t* max_frequency,
+                    uint32_t* min_ratio);  // Atualiza limites
+  size_t allocate(const size_t size);  // Reserva espaço
+
+  PageCache *file_;  //!< Arquivo das listas
+  bool positional_;  //!< Cada documento aponta para suas posições
+  size_t extent_{0u},  //!< Próximo byte livre da página parcial
+         extent_end_{0u};  //!< Fim da página parcial
+};
+
+//! Classe Cursor
+/*! Percorre uma lista em ordem crescente sem carregá-la inteira.
+ *  O cabeçalho de cada bloco guarda o último documento do bloco e
+ *  funciona como ponteiro de salto: seek() pula blocos inteiros sem
+ *  ler nem decodificar o conteúdo deles.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class PostingListOnDisk::Cursor {
+ public:
+  Cursor(const PostingListOnDisk* list, const Term& term);  // Construtor
+  ~Cursor();  // Destrutor
+
+  bool valid() const;  // Ainda há documento
+  size_t doc() const;  // Documento atual
+  size_t frequency();  // Frequência no documento atual
+  size_t positions();  // Posições do documento atual
+  size_t count() const;  // Tamanho da lista
+  size_t block_last() const;  // Último documento do bloco atual
+  size_t block_frequency() const;  // Maior frequência do bloco atual
+  size_t block_ratio() const;  // Menor razão do bloco atual
+  void next();  // Avança um documento
+  void seek(const size_t target);  // Avança até documento >= target
+
+ private:
+  void enter(const size_t offset);  // Entra em um bloco
+  void decode();  // Lê conteúdo do bloco atual
+
+  PageCache *file_;  //!< Arquivo das listas
+  bool positional_;  //!< Lista aponta para posições
+  Block block_;  //!< Cabeçalho do bloco atual
+  vector<char> payload_;  //!< Conteúdo do bloco atual
+  size_t offset_{0u},  //!< Deslocamento do bloco atual
+         position_{0u},  //!< Próximo byte a decodificar
+         count_{0u};  //!< Tamanho da lista
+  uint64_t doc_{0u},  //!< Documento atual
+           frequency_{0u},  //!< Frequência no documento atual
+           positions_{0u};  //!< Posições do documento atual
+  bool valid_{false},  //!< Ainda há documento
+       loaded_{false};  //!< Conteúdo do bloco já foi lido
+};
+
+//! Construtor
+/*! Listas sobre o arquivo recebido.
+ *  \param PageCache* arquivo, continua pertencendo a quem chamou
+ *  \param bool se cada documento guarda onde estão suas posições
+ *  \sa ~PostingListOnDisk()
+ */
+PostingListOnDisk::PostingListOnDisk(PageCache* file, const bool positional) :
+file_{file},
+positional_{positional}
+{}
+
+//! Destrutor
+/*! Destrutor padrão, o arquivo pertence a quem criou as listas.
+ *  \sa PostingListOnDisk()
+ */
+PostingListOnDisk::~PostingListOnDisk() {}
+
+//! Guarda posições
+/*! \return bool se os documentos apontam para PositionsOnDisk
+ */
+bool PostingListOnDisk::positional() const {
+  return positional_;
+}
+
+//! Acrescenta documento
+/*! Os documentos devem chegar em ordem crescente, como acontece na
+ *  indexação, repetições do último documento são ignoradas.
+ *  \param Term* termo, atualizado com o novo último bloco e quantidade
+ *  \param size_t documento
+ *  \param size_t vezes que a palavra aparece no documento
+ *  \param size_t tamanho do documento em palavras, 0 se desconhecido
+ *  \param size_t deslocamento das posições, crescente como os documentos
+ *  \sa read()
+ */
+void PostingListOnDisk::append(Term* term, const size_t doc,
+                               const size_t frequency, const size_t words,
+                               const size_t positions) {
+  if (term->count_ == 0u) {  // documento fica no próprio termo
+    widen(0u, frequency, words, &term->frequency_, &term->ratio_);
+    term->head_ = doc;
+    term->tail_ = positions;
+    term->count_ = 1u;
+    return;
+  }
+
+  if (term->count_ == 1u) {  // segundo documento, cria o primeiro bloco
+    if (doc == term->head_)
+      return;
+    if (doc < term->head_)
+      throw std::out_of_range("Documento fora de ordem na lista.");
+    term->head_ = term->tail_ = start(MIN_BLOCK, term->head_, term->frequency_,
+                                      term->ratio_ * term->frequency_,
+                                      term->tail_);
+  }
+
+  Block block;
+  file_->read(term->tail_, &block, sizeof(Block));
+  if (doc == block.last_)
+    return;
+  if (doc < block.last_)
+    throw std::out_of_range("Documento fora de ordem na lista.");
+
+  char code[3 * Varint::MAX_SIZE];
+  size_t length = encode(doc - block.last_, frequency,
+                         positions - block.positions_, code),
+         tail = term->tail_;
+
+  if (sizeof(Block) + block.used_ + length <= block.size_) {
+    file_->write(tail + sizeof(Block) + block.used_, code, length);
+    widen(block.count_, frequency, words, &block.frequency_, &block.ratio_);
+    block.used_ += length;
+    ++block.count_;
+    block.last_ = doc;
+    block.positions_ = positions;
+  } else {  // bloco cheio, a lista continua em um bloco maior
+    size_t size = block.size_ * GROWTH < MAX_BLOCK?
+                  block.size_ * GROWTH : MAX_BLOCK;
+    block.next_ = term->tail_ = start(size, doc, frequency, words, positions);
+  }
+
+  file_->write(tail, &block, sizeof(Block));
+  widen(term->count_, frequency, words, &term->frequency_, &term->ratio_);
+  ++term->count_;
+}
+
+//! Grava lista inteira
+/*! Usado na carga em ordem, quando a lista inteira já é conhecida.
+ *  Os documentos são divididos em blocos de até BULK_DOCS, cada bloco
+ *  com o tamanho exato do seu conteúdo e escrito uma única vez, em
+ *  sequência no arquivo. Blocos pequenos ajudam o seek() a pular.
+ *  \param Term* termo vazio, recebe a lista
+ *  \param vector<size_t> documentos em ordem crescente, sem repetição
+ *  \param vector<size_t> frequência em cada documento
+ *  \param vector<size_t> tamanho de cada documento, em palavras
+ *  \param vector<size_t> deslocamento das posições de cada documento
+ *  \sa append()
+ */
+void PostingListOnDisk::assign(Term* term, const vector<size_t>& docs,
+                               const vector<size_t>& frequencies,
+                               const vector<size_t>& words,
+                               const vector<size_t>& positions) {
+  *term = Term();
+  if (docs.empty())
+    return;
+
+  for (size_t i = 0; i < docs.size(); ++i)
+    widen(i, frequencies[i], words[i], &term->frequency_, &term->ratio_);
+
+  term->count_ = docs.size();
+  if (docs.size() == 1u) {  // documento fica no próprio termo
+    term->head_ = docs[0];
+    term->tail_ = positions[0];
+    return;
+  }
+
+  vector<char> data;
+  size_t previous = 0u;
+  for (size_t begin = 0u; begin < docs.size(); begin += BULK_DOCS) {
+    size_t end = begin + BULK_DOCS < docs.size()? begin + BULK_DOCS : docs.size();
+    Block block;
+    data.resize(sizeof(Block) + (end - begin) * 3 * Varint::MAX_SIZE);
+
+    for (size_t i = begin; i < end; ++i) {
+      block.used_ += encode(docs[i] - block.last_, frequencies[i],
+                            positions[i] - block.positions_,
+                            data.data() + sizeof(Block) + block.used_);
+      widen(i - begin, frequencies[i], words[i], &block.frequency_,
+            &block.ratio_);
+      block.last_ = docs[i];
+      block.positions_ = positions[i];
+    }
+    block.first_ = docs[begin];
+    block.count_ = end - begin;
+    block.size_ = sizeof(Block) + block.used_;
+
+    size_t offset = allocate(block.size_);
+    memcpy(data.data(), &block, sizeof(Block));
+    file_->write(offset, data.data(), block.size_);
+
+    if (previous == 0u)
+      term->head_ = offset;
+    else
+      file_->write(previous, &offset, sizeof(uint64_t));  // next_ do anterior
+    previous = term->tail_ = offset;
+  }
+}
+
+//! Lê lista
+/*! Decodifica todos os blocos da lista, em ordem crescente, sem as
+ *  frequências nem as posições.
+ *  \param Term termo
+ *  \param vector<size_t>* destino dos documentos
+ *  \sa append()
+ */
+void PostingListOnDisk::read(const Term& term, vector<size_t>* docs) const {
+  Block block;
+  vector<char> payload;
+  size_t offset = term.count_ < 2u? 0u : term.head_;
+  docs->reserve(docs->size() + term.count_);
+  if (term.count_ == 1u)
+    docs->push_back(term.head_);
+
+  while (offset != 0u) {
+    file_->read(offset, &block, sizeof(Block));
+    payload.resize(block.used_);
+    file_->read(offset + sizeof(Block), payload.data(), block.used_);
+
+    uint64_t doc = 0u, delta, skipped;
+    size_t position = 0u;
+    while (position < block.used_) {
+      position += Varint::decode(payload.data() + position, &delta);
+      position += Varint::decode(payload.data() + position, &skipped);
+      if (positional_)
+        position += Varint::decode(payload.data() + position, &skipped);
+      doc += delta;
+      docs->push_back(doc);
+    }
+    offset = block.next_;
+  }
+}
+
+//! Esquece página parcial
+/*! Usado quando o arquivo é truncado.
+ */
+void PostingListOnDisk::reset() {
+  extent_ = extent_end_ = 0u;
+}
+
+//! Novo bloco
+/*! Reserva e grava um bloco com um único documento.
+ *  \param size_t tamanho total do bloco
+ *  \param size_t documento
+ *  \param size_t frequência no documento
+ *  \param size_t tamanho do documento
+ *  \param size_t deslocamento das posições do documento
+ *  \return size_t deslocamento do bloco
+ */
+size_t PostingListOnDisk::start(const size_t size, const size_t doc,
+                                const size_t frequency, const size_t words,
+                                const size_t positions) {
+  Block block;
+  char code[3 * Varint::MAX_SIZE];
+  size_t offset = allocate(size);
+
+  widen(0u, frequency, words, &block.frequency_, &block.ratio_);
+  block.first_ = block.last_ = doc;
+  block.positions_ = positions;
+  block.size_ = size;
+  block.count_ = 1u;
+  block.used_ = encode(doc, frequency, positions, code);
+  file_->write(offset, &block, sizeof(Block));
+  file_->write(offset + sizeof(Block), code, block.used_);
+  return offset;
+}
+
+//! Codifica documento
+/*! Diferença para o documento anterior, frequência e, no índice
+ *  posicional, diferença para as posições do documento anterior. O
+ *  primeiro documento de um bloco é codificado contra zero.
+ *  \param size_t diferença do documento
+ *  \param size_t frequência
+ *  \param size_t diferença das posições
+ *  \param char* destino, com pelo menos 3 * Varint::MAX_SIZE bytes
+ *  \return size_t bytes escritos
+ */
+size_t PostingListOnDisk::encode(const size_t doc, const size_t frequency,
+                                 const size_t positions, char* out) const {
+  size_t length = Varint::encode(doc, out);
+  length += Varint::encode(frequency, out + length);
+  if (positional_)
+    length += Varint::encode(positions, out + length);
+  return length;
+}
+
+//! Atualiza limites
+/*! Inclui um documento na maior frequência e na menor razão entre
+ *  tamanho e frequência de um bloco ou lista. A razão é arredondada
+ *  para baixo, o limite calculado com ela nunca fica abaixo da
+ *  pontuação real.
+ *  \param size_t documentos já incluídos, 0 sobrescreve os limites
+ *  \param size_t frequência no documento
+ *  \param size_t tamanho do documento
+ *  \param uint32_t* maior frequência
+ *  \param uint32_t* menor razão
+ */
+void PostingListOnDisk::widen(const size_t count, const size_t frequency,
+                              const size_t words, uint32_t* max_frequency,
+                              uint32_t* min_ratio) {
+  size_t ratio = words / (frequency != 0u? frequency : 1u);
+  uint32_t f = frequency < UINT32_MAX? frequency : UINT32_MAX,
+           r = ratio < UINT32_MAX? ratio : UINT32_MAX;
+  if (count == 0u) {
+    *max_frequency = f;
+    *min_ratio = r;
+  } else {
+    *max_frequency = f > *max_frequency? f : *max_frequency;
+    *min_ratio = r < *min_ratio? r : *min_ratio;
+  }
+}
+
+//! Reserva espaço
+/*! Blocos pequenos vêm da página parcial, blocos de uma página ou mais
+ *  ocupam páginas inteiras no fim do arquivo.
+ *  \param size_t tamanho
+ *  \return size_t deslocamento
+ */
+size_t PostingListOnDisk::allocate(const size_t size) {
+  if (size <= extent_end_ - extent_) {
+    size_t offset = extent_;
+    extent_ += size;
+    return offset;
+  }
+
+  size_t page = (file_->size() + PageCache::PAGE_SIZE - 1) /
+                PageCache::PAGE_SIZE,
+         pages = (size + PageCache::PAGE_SIZE - 1) / PageCache::PAGE_SIZE;
+  for (size_t i = 0; i < pages; ++i) {
+    memset(file_->pin(page + i), 0, PageCache::PAGE_SIZE);
+    file_->unpin(page + i, true);
+  }
+
+  size_t offset = page * PageCache::PAGE_SIZE;
+  if (size < PageCache::PAGE_SIZE) {
+    extent_ = offset + size;
+    extent_end_ = offset + PageCache::PAGE_SIZE;
+  }
+  return offset;
+}
+
+//! Construtor
+/*! Posiciona o cursor no primeiro documento da lista.
+ *  \param PostingListOnDisk* listas
+ *  \param Term termo
+ *  \sa ~Cursor()
+ */
+PostingListOnDisk::Cursor::Cursor(const PostingListOnDisk* list,
+                                  const Term& term) :
+file_{list->file_},
+positional_{list->positional_},
+count_{term.count_}
+{
+  if (count_ == 1u) {  // documento guardado no termo
+    doc_ = block_.first_ = block_.last_ = term.head_;
+    positions_ = block_.positions_ = term.tail_;
+    frequency_ = block_.frequency_ = term.frequency_;
+    block_.ratio_ = term.ratio_;
+    valid_ = true;
+  } else if (count_ > 1u) {
+    enter(term.head_);
+  }
+}
+
+//! Destrutor
+/*! Destrutor padrão.
+ *  \sa Cursor()
+ */
+PostingListOnDisk::Cursor::~Cursor() {}
+
+//! Ainda há documento
+/*! \return bool se doc() é válido */
+bool PostingListOnDisk::Cursor::valid() const {
+  return valid_;
+}
+
+//! Documento atual
+/*! \return size_t documento */
+size_t PostingListOnDisk::Cursor::doc() const {
+  return doc_;
+}
+
+//! Frequência no documento atual
+/*! O primeiro documento de um bloco vem do cabeçalho, a frequência
+ *  dele faz o conteúdo do bloco ser lido.
+ *  \return size_t vezes que a palavra aparece em doc()
+ */
+size_t PostingListOnDisk::Cursor::frequency() {
+  if (offset_ != 0u && !loaded_)
+    decode();
+  return frequency_;
+}
+
+//! Posições do documento atual
+/*! Como frequency(), faz o conteúdo do bloco ser lido.
+ *  \return size_t deslocamento das posições em PositionsOnDisk, 0 se a
+ *          lista não é posicional
+ */
+size_t PostingListOnDisk::Cursor::positions() {
+  if (offset_ != 0u && !loaded_)
+    decode();
+  return positions_;
+}
+
+//! Tamanho da lista
+/*! \return size_t quantidade de documentos da lista */
+size_t PostingListOnDisk::Cursor::count() const {
+  return count_;
+}
+
+//! Último documento do bloco atual
+/*! Todo documento entre doc() e este está no bloco atual.
+ *  \return size_t documento */
+size_t PostingListOnDisk::Cursor::block_last() const {
+  return block_.last_;
+}
+
+//! Maior frequência do bloco atual
+/*! Lida do cabeçalho, sem ler o conteúdo do bloco.
+ *  \return size_t frequência */
+size_t PostingListOnDisk::Cursor::block_frequency() const {
+  return block_.frequency_;
+}
+
+//! Menor razão do bloco atual
+/*! Lida do cabeçalho, sem ler o conteúdo do bloco.
+ *  \return size_t menor tamanho / frequência */
+size_t PostingListOnDisk::Cursor::block_ratio() const {
+  return block_.ratio_;
+}
+
+//! Avança
+/*! Vai para o próximo documento, ou invalida o cursor no fim.
+ *  \sa seek()
+ */
+void PostingListOnDisk::Cursor::next() {
+  if (!valid_)
+    return;
+
+  if (offset_ == 0u) {  // lista de um documento
+    valid_ = false;
+    return;
+  }
+
+  if (!loaded_)
+    decode();
+
+  if (position_ < payload_.size()) {
+    uint64_t delta, moved;
+    position_ += Varint::decode(payload_.data() + position_, &delta);
+    position_ += Varint::decode(payload_.data() + position_, &frequency_);
+    if (positional_) {
+      position_ += Varint::decode(payload_.data() + position_, &moved);
+      positions_ += moved;
+    }
+    doc_ += delta;
+  } else if (block_.next_ != 0u) {
+    enter(block_.next_);
+  } else {
+    valid_ = false;
+  }
+}
+
+//! Avança até
+/*! Vai para o primeiro documento maior ou igual ao alvo. Blocos cujo
+ *  último documento é menor que o alvo são pulados pelo cabeçalho.
+ *  \param size_t documento alvo
+ *  \sa next()
+ */
+void PostingListOnDisk::Cursor::seek(const size_t target) {
+  if (!valid_ || doc_ >= target)
+    return;
+
+  if (offset_ != 0u) {
+    while (block_.last_ < target && block_.next_ != 0u)
+      enter(block_.next_);
+    if (block_.last_ < target) {  // alvo depois do fim da lista
+      valid_ = false;
+      return;
+    }
+  }
+
+  while (valid_ && doc_ < target)
+    next();
+}
+
+//! Entra em um bloco
+/*! Lê só o cabeçalho, o conteúdo fica para quando for preciso.
+ *  \param size_t deslocamento do bloco
+ */
+void PostingListOnDisk::Cursor::enter(const size_t offset) {
+  offset_ = offset;
+  file_->read(offset_, &block_, sizeof(Block));
+  doc_ = block_.first_;
+  valid_ = true;
+  loaded_ = false;
+}
+
+//! Lê conteúdo
+/*! Lê o bloco atual e pula o primeiro documento, que já é doc_,
+ *  guardando a frequência e as posições dele.
+ */
+void PostingListOnDisk::Cursor::decode() {
+  uint64_t first;
+  payload_.resize(block_.used_);
+  file_->read(offset_ + sizeof(Block), payload_.data(), block_.used_);
+  position_ = Varint::decode(payload_.data(), &first);
+  position_ += Varint::decode(payload_.data() + position_, &frequency_);
+  if (positional_)
+    position_ += Varint::decode(payload_.data() + position_, &positions_);
+  loaded_ = true;
+}
+
+}  //  namespace structures
+
+#endif
@@ -0,0 +1,284 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_QUERY_EVALUATOR_H
+#define STRUCTURES_QUERY_EVALUATOR_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <unordered_set>
+
+#include "./posting_list_on_disk.h"
+
+using namespace std;
+
+namespace structures {
+
+//! Classe QueryEvaluator
+/*! Operações de conjunto sobre listas de documentos.
+ *  As listas ordenadas são percorridas por cursores, sem carregá-las
+ *  inteiras: a união é uma intercalação linear e a interseção avança
+ *  sempre a partir da lista mais curta, pulando blocos das outras pelo
+ *  seek() dos cursores. Para listas fora de ordem fica a pesquisa de
+ *  co-ocorrência com tabela hash. Dentro de um documento as listas de
+ *  posições são intercaladas para frases e NEAR.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class QueryEvaluator {
+ public:
+  typedef PostingListOnDisk::Cursor Cursor;
+
+  static void unite(vector<Cursor*>& cursors, vector<size_t>* out);  // União
+  static void intersect(vector<Cursor*>& cursors, vector<size_t>* out);  // Interseção
+  static void filter(const vector<size_t>& docs, Cursor* cursor,
+                     vector<size_t>* out);  // Interseção com candidatos
+  static void filter(const vector<size_t>& docs, vector<Cursor*>& cursors,
+                     vector<size_t>* out);  // Candidatos em alguma lista
+  static void merge(const vector<size_t>& first, const vector<size_t>& second,
+                    vector<size_t>* out);  // União de duas listas
+  static void subtract(const vector<size_t>& docs, const vector<size_t>& removed,
+                       vector<size_t>* out);  // Diferença
+  static void co_occurrence(const vector<size_t>& first,
+                            const vector<size_t>& second,
+                            vector<size_t>* out);  // Interseção fora de ordem
+  static bool phrase(const vector<vector<uint32_t>>& positions,
+                     const vector<size_t>& offsets);  // Palavras em sequência
+  static bool near(const vector<uint32_t>& first,
+                   const vector<uint32_t>& second,
+                   const size_t distance);  // Palavras próximas
+};
+
+//! União
+/*! Intercalação de k listas ordenadas com um heap dos cursores, cada
+ *  documento sai uma única vez. O(n log k) para n documentos no total.
+ *  \param vector<Cursor*> cursores, consumidos
+ *  \param vector<size_t>* documentos em ordem crescente
+ *  \sa intersect()
+ */
+void QueryEvaluator::unite(vector<Cursor*>& cursors, vector<size_t>* out) {
+  auto later = [](const Cursor* a, const Cursor* b) {
+    return a->doc() > b->doc();
+  };
+
+  vector<Cursor*> heap;
+  for (Cursor* cursor : cursors)
+    if (cursor->valid())
+      heap.push_back(cursor);
+  make_heap(heap.begin(), heap.end(), later);
+
+  while (!heap.empty()) {
+    pop_heap(heap.begin(), heap.end(), later);
+    Cursor *cursor = heap.back();
+
+    if (out->empty() || out->back() != cursor->doc())
+      out->push_back(cursor->doc());
+
+    cursor->next();
+    if (cursor->valid())
+      push_heap(heap.begin(), heap.end(), later);
+    else
+      heap.pop_back();
+  }
+}
+
+//! Interseção
+/*! A lista mais curta conduz: seu documento é procurado nas outras com
+ *  seek(), e quando uma delas passa do candidato a mais curta salta para
+ *  lá. Só são lidos os blocos que podem conter o candidato.
+ *  \param vector<Cursor*> cursores, consumidos
+ *  \param vector<size_t>* documentos em ordem crescente
+ *  \sa unite()
+ */
+void QueryEvaluator::intersect(vector<Cursor*>& cursors, vector<size_t>* out) {
+  if (cursors.empty())
+    return;
+
+  sort(cursors.begin(), cursors.end(), [](const Cursor* a, const Cursor* b) {
+    return a->count() < b->count();
+  });
+
+  Cursor *lead = cursors[0];
+  while (lead->valid()) {
+    size_t candidate = lead->doc();
+    bool all = true;
+
+    for (size_t i = 1; i < cursors.size(); ++i) {
+      cursors[i]->seek(candidate);
+      if (!cursors[i]->valid())
+        return;
+      if (cursors[i]->doc() != candidate) {
+        lead->seek(cursors[i]->doc());
+        all = false;
+        break;
+      }
+    }
+
+    if (all) {
+      out->push_back(candidate);
+      lead->next();
+    }
+  }
+}
+
+//! Interseção com candidatos
+/*! Mantém os candidatos presentes na lista do cursor. Cada candidato é
+ *  procurado com seek(), então blocos sem candidatos nem são lidos.
+ *  \param vector<size_t> candidatos em ordem crescente
+ *  \param Cursor* cursor da lista, consumido
+ *  \param vector<size_t>* candidatos presentes na lista
+ *  \sa intersect()
+ */
+void QueryEvaluator::filter(const vector<size_t>& docs, Cursor* cursor,
+                            vector<size_t>* out) {
+  for (size_t doc : docs) {
+    cursor->seek(doc);
+    if (!cursor->valid())
+      return;
+    if (cursor->doc() == doc)
+      out->push_back(doc);
+  }
+}
+
+//! Candidatos em alguma lista
+/*! Mantém os candidatos presentes em pelo menos uma das listas, a
+ *  interseção dos candidatos com a união das listas sem montar a união.
+ *  Cursores que acabam saem da procura.
+ *  \param vector<size_t> candidatos em ordem crescente
+ *  \param vector<Cursor*> cursores das listas, consumidos
+ *  \param vector<size_t>* candidatos presentes em alguma lista
+ *  \sa filter(const vector<size_t>& docs, Cursor* cursor, vector<size_t>* out)
+ */
+void QueryEvaluator::filter(const vector<size_t>& docs,
+                            vector<Cursor*>& cursors, vector<size_t>* out) {
+  vector<Cursor*> active(cursors);
+  for (size_t doc : docs) {
+    for (size_t i = 0; i < active.size();) {
+      active[i]->seek(doc);
+      if (!active[i]->valid()) {
+        active[i] = active.back();
+        active.pop_back();
+        continue;
+      }
+      if (active[i]->doc() == doc) {
+        out->push_back(doc);
+        break;
+      }
+      ++i;
+    }
+    if (active.empty())
+      return;
+  }
+}
+
+//! União de duas listas
+/*! Intercalação linear de duas listas já em memória.
+ *  \param vector<size_t> primeira lista, em ordem crescente
+ *  \param vector<size_t> segunda lista, em ordem crescente
+ *  \param vector<size_t>* documentos de qualquer uma das duas
+ *  \sa unite()
+ */
+void QueryEvaluator::merge(const vector<size_t>& first,
+                           const vector<size_t>& second,
+                           vector<size_t>* out) {
+  set_union(first.begin(), first.end(), second.begin(), second.end(),
+            back_inserter(*out));
+}
+
+//! Diferença
+/*! Documentos da primeira lista que não estão na segunda, usada pelo NOT.
+ *  \param vector<size_t> documentos, em ordem crescente
+ *  \param vector<size_t> documentos removidos, em ordem crescente
+ *  \param vector<size_t>* resultado
+ */
+void QueryEvaluator::subtract(const vector<size_t>& docs,
+                              const vector<size_t>& removed,
+                              vector<size_t>* out) {
+  set_difference(docs.begin(), docs.end(), removed.begin(), removed.end(),
+                 back_inserter(*out));
+}
+
+//! Pesquisa de co-ocorrência em duas listas não ordenadas
+/*! A menor lista vai para uma tabela hash e a maior é percorrida uma
+ *  vez consultando a tabela, O(n + m). A saída segue a ordem da maior.
+ *  \param vector<size_t> primeira lista
+ *  \param vector<size_t> segunda lista
+ *  \param vector<size_t>* documentos presentes nas duas
+ */
+void QueryEvaluator::co_occurrence(const vector<size_t>& first,
+                                   const vector<size_t>& second,
+                                   vector<size_t>* out) {
+  const vector<size_t>& small = first.size() <= second.size()? first : second;
+  const vector<size_t>& large = first.size() <= second.size()? second : first;
+
+  unordered_set<size_t> table(small.begin(), small.end());
+  for (size_t doc : large)
+    if (table.erase(doc) != 0u)
+      out->push_back(doc);
+}
+
+//! Palavras em sequência
+/*! Procura um início p tal que a palavra i esteja na posição
+ *  p + offsets[i], para todo i. A primeira lista propõe os inícios e as
+ *  outras só avançam, então cada lista é percorrida uma única vez.
+ *  \param vector<vector<uint32_t>> posições de cada palavra, crescentes
+ *  \param vector<size_t> posição de cada palavra na frase
+ *  \return bool se a frase aparece
+ *  \sa near()
+ */
+bool QueryEvaluator::phrase(const vector<vector<uint32_t>>& positions,
+                            const vector<size_t>& offsets) {
+  vector<size_t> next(positions.size(), 0u);
+
+  for (uint32_t first : positions[0]) {
+    if (first < offsets[0])
+      continue;
+    size_t start = first - offsets[0];
+    bool all = true;
+
+    for (size_t i = 1; i < positions.size() && all; ++i) {
+      const vector<uint32_t>& list = positions[i];
+      size_t wanted = start + offsets[i];
+      while (next[i] < list.size() && list[next[i]] < wanted)
+        ++next[i];
+      if (next[i] == list.size())
+        return false;
+      all = list[next[i]] == wanted;
+    }
+    if (all)
+      return true;
+  }
+  return false;
+}
+
+//! Palavras próximas
+/*! Intercala as duas listas procurando o par mais próximo, parando no
+ *  primeiro a no máximo distance palavras, em qualquer ordem.
+ *  \param vector<uint32_t> posições da primeira palavra, crescentes
+ *  \param vector<uint32_t> posições da segunda palavra, crescentes
+ *  \param size_t distância máxima
+ *  \return bool se há um par próximo
+ *  \sa phrase()
+ */
+bool QueryEvaluator::near(const vector<uint32_t>& first,
+                          const vector<uint32_t>& second,
+                          const size_t distance) {
+  size_t i = 0u, j = 0u;
+  while (i < first.size() && j < second.size()) {
+    size_t a = first[i], b = second[j];
+    if ((a < b? b - a : a - b) <= distance)
+      return true;
+    if (a < b)
+      ++i;
+    else
+      ++j;
+  }
+  return false;
+}
+
+}  //  namespace structures
+
+#endif
@@ -0,0 +1,403 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_QUERY_PARSER_H
+#define STRUCTURES_QUERY_PARSER_H
+
+#include <cstdint>
+#include <cctype>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <utility>
+
+#include "./word_handler.h"
+
+using namespace std;
+
+namespace structures {
+
+//! Classe QueryNode
+/*! Node da árvore de uma consulta booleana. Folhas são termos e os
+ *  nodes internos são AND, OR, NOT, PHRASE ou NEAR. Os termos de uma
+ *  frase guardam a sua posição nela e um NEAR guarda a distância
+ *  máxima. O planejador preenche a frequência de cada termo e o custo
+ *  estimado de cada node.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class QueryNode {
+ public:
+  enum Type { TERM, AND, OR, NOT, PHRASE, NEAR };  //!< Tipo do node
+
+  QueryNode(const Type type, const string& term = "");  // Construtor
+  ~QueryNode();  // Destrutor
+
+  string to_string() const;  // Consulta normalizada
+
+  Type type_;  //!< Tipo do node
+  string term_;  //!< Termo, só nas folhas
+  size_t frequency_{0u},  //!< Documentos com o termo
+         cost_{0u},  //!< Estimativa de documentos lidos
+         position_{0u},  //!< Posição do termo na frase
+         distance_{0u};  //!< Distância máxima do NEAR
+  vector<QueryNode*> children_;  //!< Operandos
+};
+
+//! Classe QueryParser
+/*! Analisador de consultas booleanas com AND, OR, NOT e parênteses.
+ *  Termos vizinhos sem operador são ligados por AND e "a NOT b" é lido
+ *  como "a AND NOT b", assim
+ *  "socket AND (bind OR connect) NOT deprecated" funciona como esperado.
+ *  Precedência: NEAR, depois NOT, depois AND, depois OR. Os termos são
+ *  convertidos para minúsculas como no índice e podem ter '*' como
+ *  curinga. Um texto entre aspas é uma frase, separada pelo
+ *  WordHandler como na indexação, e "a NEAR/k b" pede as duas palavras
+ *  a no máximo k palavras uma da outra.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class QueryParser {
+ public:
+  explicit QueryParser(WordHandler* handler = nullptr);  // Construtor
+  ~QueryParser();  // Destrutor
+
+  QueryNode* parse(const string& query);  // Monta árvore da consulta
+
+ private:
+  void tokenize(const string& query);  // Separa símbolos
+  QueryNode* parse_or();  // Expressão OR
+  QueryNode* parse_and();  // Expressão AND
+  QueryNode* parse_not();  // Expressão NOT
+  QueryNode* parse_near();  // Expressão NEAR
+  QueryNode* parse_primary();  // Termo, frase ou parênteses
+  QueryNode* parse_phrase(const string& text);  // Frase entre aspas
+  bool accept(const string& symbol);  // Consome símbolo esperado
+  bool operand() const;  // Próximo símbolo começa operando
+
+  WordHandler *handler_;  //!< Separa as frases, pode ser nulo
+  vector<string> tokens_;  //!< Símbolos da consulta
+  size_t position_{0u};  //!< Próximo símbolo
+};
+
+//! Construtor
+/*! Com parâmetros, tipo e termo.
+ *  \param Type tipo do node
+ *  \param string termo, para folhas
+ *  \sa ~QueryNode()
+ */
+QueryNode::QueryNode(const Type type, const string& term) :
+type_{type},
+term_{term}
+{}
+
+//! Destrutor
+/*! Destrói os operandos.
+ *  \sa QueryNode()
+ */
+QueryNode::~QueryNode() {
+  for (QueryNode* child : children_)
+    delete child;
+}
+
+//! Consulta normalizada
+/*! Reescreve a consulta com parênteses explícitos.
+ *  \return string consulta
+ */
+string QueryNode::to_string() const {
+  if (type_ == TERM)
+    return term_;
+  if (type_ == NOT)
+    return "NOT " + children_[0]->to_string();
+  if (type_ == PHRASE) {
+    string out = "\"";
+    for (size_t i = 0; i < children_.size(); ++i)
+      out += (i != 0? " " : "") + children_[i]->to_string();
+    return out + "\"";
+  }
+  if (type_ == NEAR)
+    return "(" + children_[0]->to_string() + " NEAR/" +
+           std::to_string(distance_) + " " + children_[1]->to_string() + ")";
+
+  string out = "(";
+  for (size_t i = 0; i < children_.size(); ++i) {
+    if (i != 0)
+      out += type_ == AND? " AND " : " OR ";
+    out += children_[i]->to_string();
+  }
+  return out + ")";
+}
+
+//! Construtor
+/*! Com parâmetros, tratador que separa as frases como na indexação.
+ *  Sem ele as frases são separadas só por espaços.
+ *  \param WordHandler* tratador, continua pertencendo a quem chamou
+ *  \sa ~QueryParser()
+ */
+QueryParser::QueryParser(WordHandler* handler) :
+handler_{handler}
+{}
+
+//! Destrutor
+/*! Destrutor padrão, não tem nada alocado dinâmicamente.
+ *  \sa QueryParser()
+ */
+QueryParser::~QueryParser() {}
+
+//! Monta árvore
+/*! Analisa a consulta inteira.
+ *  \param string consulta
+ *  \return QueryNode* raiz, pertence a quem chamou
+ *  \throw std::invalid_argument consulta mal formada
+ */
+QueryNode* QueryParser::parse(const string& query) {
+  tokenize(query);
+  position_ = 0u;
+
+  if (tokens_.empty())
+    throw std::invalid_argument("Consulta vazia.");
+
+  QueryNode *root = parse_or();
+  if (position_ != tokens_.size()) {
+    string symbol = tokens_[position_];
+    delete root;
+    throw std::invalid_argument("Símbolo inesperado: " + symbol);
+  }
+  return root;
+}
+
+//! Separa símbolos
+/*! Parênteses são símbolos próprios, uma frase entre aspas vira um
+ *  único símbolo começando por '"' e o resto é separado por espaços.
+ *  Operadores só são reconhecidos em maiúsculas, os termos vão para
+ *  minúsculas.
+ *  \param string consulta
+ *  \throw std::invalid_argument aspas sem fechar
+ */
+void QueryParser::tokenize(const string& query) {
+  tokens_.clear();
+  string current;
+
+  for (size_t i = 0; i <= query.size(); ++i) {
+    char c = i < query.size()? query[i] : ' ';
+    if (isspace(static_cast<unsigned char>(c)) || c == '(' || c == ')' ||
+        c == '"') {
+      if (!current.empty()) {
+        if (current != "AND" && current != "OR" && current != "NOT" &&
+            current.compare(0, 5, "NEAR/") != 0)
+          for (char& letter : current)
+            letter = tolower(static_cast<unsigned char>(letter));
+        tokens_.push_back(current);
+        current.clear();
+      }
+      if (c == '(' || c == ')')
+        tokens_.push_back(string(1, c));
+      if (c == '"') {
+        size_t end = query.find('"', i + 1);
+        if (end == string::npos)
+          throw std::invalid_argument("Falta fechar aspas.");
+        tokens_.push_back(query.substr(i, end - i));
+        i = end;
+      }
+    } else {
+      current += c;
+    }
+  }
+}
+
+//! Expressão OR
+/*! or := and ("OR" and)*
+ *  \return QueryNode* subárvore
+ */
+QueryNode* QueryParser::parse_or() {
+  QueryNode *left = parse_and();
+  if (position_ >= tokens_.size() || tokens_[position_] != "OR")
+    return left;
+
+  QueryNode *node = new QueryNode(QueryNode::OR);
+  node->children_.push_back(left);
+  while (accept("OR")) {
+    try {
+      node->children_.push_back(parse_and());
+    } catch (std::invalid_argument& error) {
+      delete node;
+      throw;
+    }
+  }
+  return node;
+}
+
+//! Expressão AND
+/*! and := not (["AND"] not)*
+ *  \return QueryNode* subárvore
+ */
+QueryNode* QueryParser::parse_and() {
+  QueryNode *left = parse_not();
+  QueryNode *node = nullptr;
+
+  while (true) {
+    bool explicit_and = accept("AND");
+    if (!explicit_and && !operand())
+      break;
+
+    if (node == nullptr) {
+      node = new QueryNode(QueryNode::AND);
+      node->children_.push_back(left);
+    }
+    try {
+      node->children_.push_back(parse_not());
+    } catch (std::invalid_argument& error) {
+      delete node;
+      throw;
+    }
+  }
+
+  return node == nullptr? left : node;
+}
+
+//! Expressão NOT
+/*! not := "NOT" not | near
+ *  \return QueryNode* subárvore
+ */
+QueryNode* QueryParser::parse_not() {
+  if (!accept("NOT"))
+    return parse_near();
+
+  QueryNode *node = new QueryNode(QueryNode::NOT);
+  try {
+    node->children_.push_back(parse_not());
+  } catch (std::invalid_argument& error) {
+    delete node;
+    throw;
+  }
+  return node;
+}
+
+//! Expressão NEAR
+/*! near := primary ["NEAR/k" primary], os dois lados palavras sem curinga
+ *  \return QueryNode* subárvore
+ *  \throw std::invalid_argument distância ou operandos inválidos
+ */
+QueryNode* QueryParser::parse_near() {
+  QueryNode *left = parse_primary();
+  if (position_ >= tokens_.size() ||
+      tokens_[position_].compare(0, 5, "NEAR/") != 0)
+    return left;
+
+  QueryNode *node = new QueryNode(QueryNode::NEAR);
+  node->children_.push_back(left);
+  string distance = tokens_[position_++].substr(5);
+  try {
+    if (distance.empty() ||
+        distance.find_first_not_of("0123456789") != string::npos ||
+        distance.size() > 9)
+      throw std::invalid_argument("Distância do NEAR inválida: " + distance);
+    node->distance_ = stoul(distance);
+    node->children_.push_back(parse_primary());
+
+    for (const QueryNode* child : node->children_)
+      if (child->type_ != QueryNode::TERM ||
+          child->term_.find('*') != string::npos)
+        throw std::invalid_argument("NEAR liga duas palavras sem curinga.");
+    if (position_ < tokens_.size() &&
+        tokens_[position_].compare(0, 5, "NEAR/") == 0)
+      throw std::invalid_argument("NEAR liga duas palavras sem curinga.");
+  } catch (std::invalid_argument& error) {
+    delete node;
+    throw;
+  }
+  return node;
+}
+
+//! Termo ou parênteses
+/*! primary := termo | frase | "(" or ")"
+ *  \return QueryNode* subárvore
+ */
+QueryNode* QueryParser::parse_primary() {
+  if (position_ >= tokens_.size())
+    throw std::invalid_argument("Consulta incompleta.");
+
+  if (accept("(")) {
+    QueryNode *node = parse_or();
+    if (!accept(")")) {
+      delete node;
+      throw std::invalid_argument("Falta fechar parênteses.");
+    }
+    return node;
+  }
+
+  if (!operand())
+    throw std::invalid_argument("Símbolo inesperado: " + tokens_[position_]);
+
+  if (tokens_[position_][0] == '"')
+    return parse_phrase(tokens_[position_++].substr(1));
+  return new QueryNode(QueryNode::TERM, tokens_[position_++]);
+}
+
+//! Frase entre aspas
+/*! As palavras são separadas como na indexação e as ignoradas só
+ *  contam para as posições das outras. Sobrando uma palavra a frase é
+ *  um termo comum.
+ *  \param string texto da frase, sem as aspas
+ *  \return QueryNode* termo ou frase
+ *  \throw std::invalid_argument frase sem palavras indexadas
+ */
+QueryNode* QueryParser::parse_phrase(const string& text) {
+  vector<pair<string, size_t>> words;
+  if (handler_ != nullptr) {
+    handler_->phrase(text, &words);
+  } else {
+    string lower(text), word;
+    for (char& letter : lower)
+      letter = tolower(static_cast<unsigned char>(letter));
+    istringstream stream(lower);
+    while (stream >> word)
+      words.push_back(make_pair(word, words.size()));
+  }
+  for (const pair<string, size_t>& word : words)
+    if (word.first.find('*') != string::npos)
+      throw std::invalid_argument("Frase não aceita curinga.");
+
+  if (words.empty())
+    throw std::invalid_argument("Frase sem palavras indexadas: \"" + text +
+                                "\"");
+  if (words.size() == 1u)
+    return new QueryNode(QueryNode::TERM, words[0].first);
+
+  QueryNode *node = new QueryNode(QueryNode::PHRASE);
+  for (const pair<string, size_t>& word : words) {
+    node->children_.push_back(new QueryNode(QueryNode::TERM, word.first));
+    node->children_.back()->position_ = word.second;
+  }
+  return node;
+}
+
+//! Consome símbolo
+/*! \param string símbolo esperado
+ *  \return bool se o próximo símbolo era o esperado
+ */
+bool QueryParser::accept(const string& symbol) {
+  if (position_ < tokens_.size() && tokens_[position_] == symbol) {
+    ++position_;
+    return true;
+  }
+  return false;
+}
+
+//! Começa operando
+/*! \return bool se o próximo símbolo é termo, NOT ou "("
+ */
+bool QueryParser::operand() const {
+  if (position_ >= tokens_.size())
+    return false;
+  const string& symbol = tokens_[position_];
+  return symbol != "AND" && symbol != "OR" && symbol != ")" &&
+         symbol.compare(0, 5, "NEAR/") != 0;
+}
+
+}  //  namespace structures
+
+#endif
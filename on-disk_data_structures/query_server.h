@@ -0,0 +1,336 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_QUERY_SERVER_H
+#define STRUCTURES_QUERY_SERVER_H
+
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "./bounded_queue.h"
+
+using namespace std;
+
+namespace structures {
+
+//! Classe QueryServer
+/*! Servidor de consultas em um socket Unix local.
+ *  O protocolo é por linhas: cada linha recebida é uma consulta e
+ *  recebe exatamente uma linha de resposta, na mesma ordem, então um
+ *  cliente pode mandar várias consultas sem esperar as respostas.
+ *  A thread que chama run() aceita conexões e espera, com poll(), que
+ *  alguma delas tenha dados; a conexão pronta vai para uma fila e um
+ *  conjunto fixo de threads responde as linhas que chegaram e a devolve
+ *  para a espera. Assim há mais conexões que threads sem nenhuma ficar
+ *  parada. Quem responde é a função recebida, chamada por várias
+ *  threads ao mesmo tempo.
+ *  SIGINT e SIGTERM param o servidor e fecham as conexões abertas.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class QueryServer {
+ public:
+  typedef function<string(const string&)> Handler;  //!< Consulta -> resposta
+
+  static const size_t QUEUE_SIZE = 64u;  //!< Conexões prontas na fila
+  static const size_t BUFFER_SIZE = 64u << 10;  //!< Bytes por leitura
+  static const size_t MAX_LINE = 1u << 20;  //!< Maior consulta aceita
+
+  QueryServer(const string& path, const size_t workers,
+              Handler handler);  // Construtor
+  ~QueryServer();  // Destrutor
+
+  void run();  // Atende até receber sinal
+  static void stop();  // Pede parada
+
+ private:
+  //! Classe Client
+  /*! Conexão aberta.
+   *
+   *  \author João Vicente Souto.
+   *  \since 20/06/17
+   *  \version 1.0
+   */
+  class Client {
+   public:
+    string pending_;  //!< Começo de linha ainda sem '\n'
+    bool busy_{false};  //!< Com uma thread de atendimento
+  };
+
+  void work();  // Thread de atendimento
+  bool serve(const int client, string* pending);  // Responde o que chegou
+  void release(const int client, const bool open);  // Devolve conexão
+  static bool send_all(const int client, const string& data);  // Escreve tudo
+  static void signal_handler(int);  // Trata SIGINT e SIGTERM
+
+  static atomic<bool> stopping_;  //!< Parada pedida
+
+  string path_;  //!< Caminho do socket
+  size_t workers_;  //!< Threads de atendimento
+  Handler handler_;  //!< Responde uma consulta
+  int listener_{-1},  //!< Socket que aceita conexões
+      wake_[2]{-1, -1};  //!< Pipe que acorda o poll() ao devolver conexão
+  BoundedQueue<int> ready_;  //!< Conexões com dados
+  mutex clients_mutex_;  //!< Protege clients_
+  unordered_map<int, Client> clients_;  //!< Conexões abertas
+};
+
+atomic<bool> QueryServer::stopping_{false};
+
+//! Construtor
+/*! Cria o socket no caminho, apagando um socket antigo que tenha
+ *  ficado lá, e começa a escutar.
+ *  \param string caminho do socket
+ *  \param size_t threads de atendimento, 0 usa uma por núcleo
+ *  \param Handler responde uma consulta, chamada em paralelo
+ *  \throw std::out_of_range se não conseguir criar o socket
+ *  \sa ~QueryServer()
+ */
+QueryServer::QueryServer(const string& path, const size_t workers,
+                         Handler handler) :
+path_{path},
+workers_{workers},
+handler_{handler},
+ready_{QUEUE_SIZE}
+{
+  if (workers_ == 0u)
+    workers_ = thread::hardware_concurrency();
+  if (workers_ == 0u)
+    workers_ = 1u;
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path_.size() >= sizeof(address.sun_path))
+    throw std::out_of_range("Caminho do socket muito longo.");
+  strncpy(address.sun_path, path_.c_str(), sizeof(address.sun_path) - 1);
+
+  if (pipe(wake_) != 0)
+    throw std::out_of_range("Erro ao criar socket.");
+  fcntl(wake_[0], F_SETFL, O_NONBLOCK);
+  fcntl(wake_[1], F_SETFL, O_NONBLOCK);
+
+  listener_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener_ < 0) {
+    close(wake_[0]);
+    close(wake_[1]);
+    throw std::out_of_range("Erro ao criar socket.");
+  }
+  unlink(path_.c_str());
+  if (bind(listener_, reinterpret_cast<struct sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(listener_, SOMAXCONN) != 0) {
+    close(listener_);
+    close(wake_[0]);
+    close(wake_[1]);
+    throw std::out_of_range("Erro ao escutar no socket.");
+  }
+}
+
+//! Destrutor
+/*! Fecha o socket e apaga o caminho.
+ *  \sa QueryServer()
+ */
+QueryServer::~QueryServer() {
+  close(listener_);
+  close(wake_[0]);
+  close(wake_[1]);
+  unlink(path_.c_str());
+}
+
+//! Atende até receber sinal
+/*! Dispara as threads de atendimento e espera por conexões novas e por
+ *  dados nas conexões que não estão com nenhuma thread. Na parada fecha
+ *  a fila, derruba as conexões em atendimento, espera as threads e
+ *  fecha o resto.
+ *  \sa stop()
+ */
+void QueryServer::run() {
+  stopping_ = false;
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, signal_handler);
+  signal(SIGTERM, signal_handler);
+
+  vector<thread> threads;
+  for (size_t i = 0; i < workers_; ++i)
+    threads.emplace_back(&QueryServer::work, this);
+
+  vector<struct pollfd> waiting;
+  while (!stopping_) {
+    waiting.assign(2u, pollfd());
+    waiting[0].fd = listener_;
+    waiting[1].fd = wake_[0];
+    {
+      lock_guard<mutex> lock(clients_mutex_);
+      for (auto& entry : clients_)
+        if (!entry.second.busy_)
+          waiting.push_back(pollfd{entry.first, 0, 0});
+    }
+    for (struct pollfd& entry : waiting)
+      entry.events = POLLIN;
+
+    if (poll(waiting.data(), waiting.size(), 200) <= 0)
+      continue;  // sem evento ou interrompido, confere a parada
+
+    if (waiting[1].revents != 0) {
+      char drain[64];
+      while (read(wake_[0], drain, sizeof(drain)) > 0) {}
+    }
+    if (waiting[0].revents != 0) {
+      int client = accept(listener_, nullptr, nullptr);
+      if (client >= 0) {
+        lock_guard<mutex> lock(clients_mutex_);
+        clients_[client];
+      }
+    }
+    for (size_t i = 2u; i < waiting.size(); ++i) {
+      if (waiting[i].revents == 0)
+        continue;
+      {
+        lock_guard<mutex> lock(clients_mutex_);
+        clients_[waiting[i].fd].busy_ = true;
+      }
+      int client = waiting[i].fd;
+      ready_.push(std::move(client));
+    }
+  }
+
+  ready_.close();
+  {
+    lock_guard<mutex> lock(clients_mutex_);
+    for (auto& entry : clients_)
+      if (entry.second.busy_)
+        shutdown(entry.first, SHUT_RDWR);  // solta quem espera o cliente
+  }
+  for (thread& worker : threads)
+    worker.join();
+
+  lock_guard<mutex> lock(clients_mutex_);
+  for (auto& entry : clients_)
+    close(entry.first);
+  clients_.clear();
+}
+
+//! Pede parada
+/*! Pode ser chamado de um tratador de sinal.
+ *  \sa run()
+ */
+void QueryServer::stop() {
+  stopping_ = true;
+}
+
+//! Trata SIGINT e SIGTERM
+/*! \param int sinal recebido
+ */
+void QueryServer::signal_handler(int) {
+  stop();
+}
+
+//! Thread de atendimento
+/*! Pega a próxima conexão com dados, responde e a devolve.
+ */
+void QueryServer::work() {
+  int client;
+  while (ready_.pop(&client)) {
+    string *pending;
+    {
+      lock_guard<mutex> lock(clients_mutex_);
+      pending = &clients_[client].pending_;  // estável, só esta thread usa
+    }
+    release(client, !stopping_ && serve(client, pending));
+  }
+}
+
+//! Responde o que chegou
+/*! Lê uma vez, sem esperar, separa as linhas completas e responde cada
+ *  uma. As respostas saem juntas, em uma escrita. O resto de linha fica
+ *  para a próxima leitura; uma linha maior que MAX_LINE derruba a
+ *  conexão.
+ *  \param int socket do cliente
+ *  \param string* começo de linha da leitura anterior
+ *  \return bool se a conexão continua aberta
+ */
+bool QueryServer::serve(const int client, string* pending) {
+  char buffer[BUFFER_SIZE];
+  ssize_t count = recv(client, buffer, sizeof(buffer), MSG_DONTWAIT);
+  if (count < 0)
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  if (count == 0)
+    return false;
+  pending->append(buffer, count);
+
+  string responses;
+  size_t begin = 0u, end;
+  while ((end = pending->find('\n', begin)) != string::npos) {
+    string line = pending->substr(begin, end - begin);
+    begin = end + 1;
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (line.empty())
+      continue;
+    responses += handler_(line);
+    responses += '\n';
+  }
+  pending->erase(0, begin);
+
+  return pending->size() <= MAX_LINE && send_all(client, responses);
+}
+
+//! Devolve conexão
+/*! Volta a conexão para a espera do poll(), ou a fecha.
+ *  \param int socket do cliente
+ *  \param bool se a conexão continua aberta
+ */
+void QueryServer::release(const int client, const bool open) {
+  {
+    lock_guard<mutex> lock(clients_mutex_);
+    if (open) {
+      clients_[client].busy_ = false;
+    } else {
+      clients_.erase(client);
+      close(client);
+    }
+  }
+  if (open) {
+    char signal = 0;
+    if (write(wake_[1], &signal, 1) < 0) {}  // pipe cheio já acorda
+  }
+}
+
+//! Escreve tudo
+/*! \param int socket do cliente
+ *  \param string dados
+ *  \return bool se todos os bytes foram escritos
+ */
+bool QueryServer::send_all(const int client, const string& data) {
+  size_t done = 0u;
+  while (done < data.size()) {
+    ssize_t count = send(client, data.data() + done, data.size() - done,
+                         MSG_NOSIGNAL);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count <= 0)
+      return false;
+    done += count;
+  }
+  return true;
+}
+
+}  //  namespace structures
+
+#endif
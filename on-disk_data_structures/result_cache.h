@@ -0,0 +1,230 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_RESULT_CACHE_H
+#define STRUCTURES_RESULT_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <list>
+#include <utility>
+#include <mutex>
+#include <unordered_map>
+
+using namespace std;
+
+namespace structures {
+
+//! Classe ResultCache
+/*! Cache LRU dos resultados finais das buscas, já com os nomes das
+ *  manpages, para que uma consulta repetida não leia nada do disco.
+ *  A chave é a consulta normalizada, com o número da opção na frente.
+ *  O limite é em bytes, somando chaves e nomes guardados; passando
+ *  dele saem as consultas usadas há mais tempo.
+ *
+ *  Cada resultado vale para uma geração do índice. Quem altera as
+ *  árvores muda a geração e na próxima consulta o cache é esvaziado.
+ *  Pode ser usado por várias threads; um acerto devolve uma cópia.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class ResultCache {
+ public:
+  static const size_t DEFAULT_BYTES = 4u << 20;  //!< Limite padrão
+
+  //! Classe Result
+  /*! Resultado de uma busca, na ordem em que é mostrado.
+   *
+   *  \author João Vicente Souto.
+   *  \since 20/06/17
+   *  \version 1.0
+   */
+  class Result {
+   public:
+    vector<string> names_;  //!< Manpages encontradas
+    vector<double> scores_;  //!< Pontuações, só na busca ranqueada
+  };
+
+  explicit ResultCache(const size_t bytes = DEFAULT_BYTES);  // Construtor
+  ~ResultCache();  // Destrutor
+
+  bool find(const string& key, const uint64_t generation,
+            Result* out);  // Procura consulta
+  void insert(const string& key, const Result& result,
+              const uint64_t generation);  // Guarda consulta
+  void clear();  // Esvazia cache
+
+  size_t hits() const;  // Consultas respondidas pelo cache
+  size_t misses() const;  // Consultas que foram ao índice
+  size_t size() const;  // Consultas guardadas
+  size_t bytes() const;  // Memória usada
+
+ private:
+  typedef pair<string, Result> Entry;  //!< Consulta e resultado
+
+  static size_t cost(const Entry& entry);  // Memória de uma consulta
+  void renew(const uint64_t generation);  // Confere geração
+  void drop();  // Descarta entradas
+
+  size_t limit_,  //!< Limite em bytes
+         bytes_{0u},  //!< Memória usada
+         hits_{0u},  //!< Acertos
+         misses_{0u};  //!< Faltas
+  uint64_t generation_{0u};  //!< Geração dos resultados guardados
+  mutable mutex mutex_;  //!< Exclusão mútua
+  list<Entry> order_;  //!< Mais recente na frente
+  unordered_map<string, list<Entry>::iterator> table_;  //!< Consulta -> entrada
+};
+
+//! Construtor
+/*! Com parâmetros, limite de memória.
+ *  \param size_t limite em bytes
+ *  \sa ~ResultCache()
+ */
+ResultCache::ResultCache(const size_t bytes) :
+limit_{bytes}
+{}
+
+//! Destrutor
+/*! Destrutor padrão, as entradas são liberadas pelos contêineres.
+ *  \sa ResultCache()
+ */
+ResultCache::~ResultCache() {}
+
+//! Procura consulta
+/*! Um acerto passa a consulta para a frente da fila.
+ *  \param string consulta normalizada
+ *  \param uint64_t geração atual do índice
+ *  \param Result* cópia do resultado guardado, se houver
+ *  \return bool se a consulta estava no cache
+ *  \sa insert()
+ */
+bool ResultCache::find(const string& key, const uint64_t generation,
+                       Result* out) {
+  lock_guard<mutex> lock(mutex_);
+  renew(generation);
+  auto it = table_.find(key);
+  if (it == table_.end()) {
+    ++misses_;
+    return false;
+  }
+
+  ++hits_;
+  order_.splice(order_.begin(), order_, it->second);
+  *out = it->second->second;
+  return true;
+}
+
+//! Guarda consulta
+/*! Coloca o resultado na frente da fila e tira do fim até caber no
+ *  limite. Um resultado maior que o limite inteiro não é guardado.
+ *  \param string consulta normalizada
+ *  \param Result resultado
+ *  \param uint64_t geração do índice que gerou o resultado
+ *  \sa find()
+ */
+void ResultCache::insert(const string& key, const Result& result,
+                         const uint64_t generation) {
+  lock_guard<mutex> lock(mutex_);
+  renew(generation);
+  auto it = table_.find(key);
+  if (it != table_.end()) {
+    bytes_ -= cost(*it->second);
+    order_.erase(it->second);
+    table_.erase(it);
+  }
+
+  Entry entry(key, result);
+  size_t size = cost(entry);
+  if (size > limit_)
+    return;
+
+  while (bytes_ + size > limit_) {
+    bytes_ -= cost(order_.back());
+    table_.erase(order_.back().first);
+    order_.pop_back();
+  }
+
+  order_.push_front(std::move(entry));
+  table_[key] = order_.begin();
+  bytes_ += size;
+}
+
+//! Esvazia cache
+/*! Os contadores de acertos e faltas continuam.
+ */
+void ResultCache::clear() {
+  lock_guard<mutex> lock(mutex_);
+  drop();
+}
+
+//! Descarta entradas
+/*! Chamado com a exclusão mútua já obtida.
+ */
+void ResultCache::drop() {
+  order_.clear();
+  table_.clear();
+  bytes_ = 0u;
+}
+
+//! Confere geração
+/*! \param uint64_t geração atual, se mudou nada guardado vale mais
+ */
+void ResultCache::renew(const uint64_t generation) {
+  if (generation == generation_)
+    return;
+  drop();
+  generation_ = generation;
+}
+
+//! Memória de uma consulta
+/*! Aproximada: textos, vetores e o custo fixo da entrada na lista e
+ *  na tabela.
+ *  \param Entry consulta e resultado
+ *  \return size_t bytes
+ */
+size_t ResultCache::cost(const Entry& entry) {
+  size_t size = sizeof(Entry) + 2u * entry.first.size() +
+                sizeof(list<Entry>::iterator) + 4u * sizeof(void*) +
+                entry.second.scores_.size() * sizeof(double);
+  for (const string& name : entry.second.names_)
+    size += sizeof(string) + name.size();
+  return size;
+}
+
+//! Acertos
+/*! \return size_t consultas respondidas pelo cache
+ */
+size_t ResultCache::hits() const {
+  lock_guard<mutex> lock(mutex_);
+  return hits_;
+}
+
+//! Faltas
+/*! \return size_t consultas que foram ao índice
+ */
+size_t ResultCache::misses() const {
+  lock_guard<mutex> lock(mutex_);
+  return misses_;
+}
+
+//! Consultas guardadas
+/*! \return size_t quantidade de consultas no cache
+ */
+size_t ResultCache::size() const {
+  lock_guard<mutex> lock(mutex_);
+  return order_.size();
+}
+
+//! Memória usada
+/*! \return size_t bytes, aproximado
+ */
+size_t ResultCache::bytes() const {
+  lock_guard<mutex> lock(mutex_);
+  return bytes_;
+}
+
+}  //  namespace structures
+
+#endif
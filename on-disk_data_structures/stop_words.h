@@ -0,0 +1,122 @@
+//!  Copyright [2017] <João Vicente Souto>
+//   Gerado por stop_words_generator.cpp a partir de ignored_words.txt, não editar.
+#ifndef STRUCTURES_STOP_WORDS_H
+#define STRUCTURES_STOP_WORDS_H
+
+#include <cstdint>
+#include <cstring>
+
+#include "./perfect_hash.h"
+
+namespace structures {
+
+//! Classe StopWords
+/*! Palavras ignoradas em uma tabela de hash perfeito montada em
+ *  tempo de compilação. Cada consulta custa um hash e uma comparação.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class StopWords {
+ public:
+  static const size_t COUNT = 196u;  //!< Palavras na tabela
+  static const size_t SIZE = 256u;  //!< Posições da tabela
+  static const size_t BUCKETS = 50u;  //!< Baldes
+  static const uint64_t SOURCE = 0x2c874dc8d6fc6e5dull;  //!< Identifica a lista
+
+  static bool contains(const char* word, const size_t length);  // Consulta
+
+ private:
+  static constexpr uint32_t DISPLACEMENTS[BUCKETS] = {
+    4u, 8u, 3u, 6u, 6u, 2u, 1u, 15u, 35u, 35u, 0u, 0u,
+    10u, 4u, 0u, 0u, 1u, 4u, 18u, 11u, 2u, 0u, 33u, 28u,
+    5u, 13u, 27u, 1u, 54u, 2u, 47u, 0u, 56u, 10u, 5u, 9u,
+    4u, 0u, 71u, 47u, 12u, 1u, 5u, 17u, 2u, 1u, 0u, 9u,
+    98u, 2u,
+  };  //!< Deslocamento de cada balde
+  static constexpr uint8_t LENGTHS[SIZE] = {
+    7u, 7u, 6u, 4u, 6u, 9u, 3u, 5u, 0u, 7u, 7u, 1u, 6u, 1u, 3u, 1u,
+    0u, 1u, 0u, 3u, 0u, 0u, 2u, 7u, 8u, 0u, 10u, 5u, 0u, 7u, 2u, 7u,
+    0u, 3u, 4u, 5u, 6u, 4u, 1u, 7u, 1u, 3u, 1u, 3u, 6u, 0u, 0u, 4u,
+    6u, 3u, 2u, 0u, 4u, 0u, 0u, 0u, 0u, 0u, 3u, 5u, 9u, 3u, 0u, 1u,
+    2u, 8u, 2u, 1u, 5u, 3u, 5u, 7u, 4u, 2u, 3u, 10u, 5u, 0u, 5u, 2u,
+    4u, 0u, 5u, 10u, 6u, 6u, 5u, 4u, 1u, 0u, 1u, 4u, 2u, 4u, 4u, 5u,
+    2u, 3u, 0u, 0u, 5u, 7u, 0u, 2u, 4u, 4u, 6u, 0u, 4u, 7u, 10u, 1u,
+    8u, 1u, 0u, 1u, 4u, 4u, 2u, 5u, 8u, 0u, 3u, 4u, 3u, 2u, 0u, 0u,
+    0u, 0u, 7u, 0u, 0u, 0u, 0u, 0u, 9u, 0u, 0u, 5u, 1u, 5u, 0u, 0u,
+    0u, 5u, 5u, 6u, 1u, 3u, 4u, 0u, 7u, 6u, 0u, 5u, 10u, 7u, 2u, 0u,
+    0u, 9u, 4u, 1u, 0u, 6u, 4u, 4u, 4u, 7u, 0u, 2u, 4u, 4u, 0u, 1u,
+    4u, 9u, 3u, 6u, 6u, 4u, 9u, 0u, 0u, 0u, 1u, 4u, 4u, 9u, 6u, 6u,
+    1u, 8u, 1u, 4u, 0u, 3u, 3u, 3u, 7u, 2u, 5u, 0u, 0u, 5u, 0u, 10u,
+    4u, 3u, 4u, 2u, 7u, 0u, 4u, 1u, 3u, 1u, 6u, 6u, 4u, 4u, 4u, 1u,
+    3u, 2u, 0u, 2u, 7u, 3u, 2u, 0u, 7u, 3u, 3u, 7u, 0u, 0u, 5u, 8u,
+    1u, 4u, 2u, 6u, 2u, 4u, 6u, 0u, 2u, 7u, 1u, 3u, 5u, 9u, 6u, 3u,
+  };  //!< Tamanho da palavra de cada posição
+  static constexpr const char* WORDS[SIZE] = {
+    "against", "someone", "rather", "some", "inside", "whichever",
+    "how", "circa", "", "athwart", "nothing", "k",
+    "around", "f", "non", "u", "", "i",
+    "", "few", "", "", "so", "despite",
+    "everyone", "", "yourselves", "their", "", "instead",
+    "or", "because", "", "she", "this", "whose",
+    "across", "near", "j", "himself", "g", "can",
+    "x", "his", "during", "", "", "upon",
+    "except", "yet", "no", "", "onto", "",
+    "", "", "", "", "him", "these",
+    "ourselves", "has", "", "c", "be", "anything",
+    "as", "h", "ahead", "one", "which", "barring",
+    "many", "if", "any", "underneath", "means", "",
+    "below", "an", "most", "", "those", "regardless",
+    "either", "anyone", "along", "atop", "o", "",
+    "l", "down", "of", "they", "such", "about",
+    "my", "off", "", "", "every", "whoever",
+    "", "up", "into", "will", "itself", "",
+    "till", "herself", "themselves", "p", "whomever", "n",
+    "", "d", "whom", "have", "he", "since",
+    "opposite", "", "our", "none", "nor", "at",
+    "", "", "", "", "between", "",
+    "", "", "", "", "excluding", "",
+    "", "among", "a", "yours", "", "",
+    "", "minus", "above", "beyond", "w", "you",
+    "mine", "", "beneath", "theirs", "", "aside",
+    "concerning", "anybody", "it", "", "", "regarding",
+    "both", "v", "", "beside", "that", "from",
+    "each", "through", "", "to", "what", "over",
+    "", "y", "amid", "everybody", "its", "toward",
+    "aboard", "plus", "following", "", "", "",
+    "z", "your", "with", "including", "before", "behind",
+    "e", "yourself", "m", "been", "", "are",
+    "but", "not", "neither", "by", "after", "",
+    "", "until", "", "everything", "does", "who",
+    "them", "do", "towards", "", "like", "r",
+    "tan", "b", "amidst", "myself", "ours", "past",
+    "also", "q", "the", "in", "", "is",
+    "outside", "her", "me", "", "besides", "all",
+    "and", "several", "", "", "under", "somebody",
+    "t", "must", "we", "nobody", "us", "hers",
+    "within", "", "on", "without", "s", "for",
+    "prior", "something", "unlike", "out",
+  };  //!< Palavra de cada posição
+};
+
+constexpr uint32_t StopWords::DISPLACEMENTS[StopWords::BUCKETS];
+constexpr uint8_t StopWords::LENGTHS[StopWords::SIZE];
+constexpr const char* StopWords::WORDS[StopWords::SIZE];
+
+//! Consulta
+/*! \param char* palavra, não precisa terminar em '\0'
+ *  \param size_t tamanho da palavra
+ *  \return bool se a palavra é ignorada
+ */
+bool StopWords::contains(const char* word, const size_t length) {
+  uint64_t hash = PerfectHash::hash(word, length);
+  size_t slot = PerfectHash::slot(
+      hash, DISPLACEMENTS[PerfectHash::bucket(hash, BUCKETS)], SIZE);
+  return LENGTHS[slot] == length &&
+         memcmp(WORDS[slot], word, length) == 0;
+}
+
+}  //  namespace structures
+
+#endif
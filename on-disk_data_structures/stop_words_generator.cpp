@@ -0,0 +1,219 @@
+//!  Copyright [2017] <João Vicente Souto>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "./perfect_hash.h"
+
+using namespace std;
+using namespace structures;
+
+//! Separa palavras
+/*! Mesmos separadores do WordHandler, para a lista gerada ser igual à
+ *  lida em tempo de execução.
+ *  \param string linha
+ *  \param set<string>* palavras distintas
+ */
+void split(const string& line, set<string>* words) {
+  const string separations{" '`^,.-+:;=<>[](){}|/_%*&$#@!?0123456789\"\f\n\r\t\v\\"};
+  string word;
+  for (size_t i = 0; i <= line.size(); ++i) {
+    if (i == line.size() || separations.find(line[i]) != string::npos) {
+      if (!word.empty())
+        words->insert(word);
+      word.clear();
+    } else {
+      word += line[i];
+    }
+  }
+}
+
+//! Procura deslocamentos
+/*! Hash e deslocamento: os baldes maiores escolhem primeiro o menor
+ *  deslocamento que leva todas as suas palavras para posições livres.
+ *  \param vector<string> palavras
+ *  \param size_t tamanho da tabela, potência de dois
+ *  \param size_t quantidade de baldes
+ *  \param vector<uint32_t>* deslocamento de cada balde
+ *  \param vector<int>* palavra de cada posição, -1 se vazia
+ *  \return bool se achou deslocamentos para todos os baldes
+ */
+bool build(const vector<string>& words, const size_t size,
+           const size_t buckets, vector<uint32_t>* displacements,
+           vector<int>* slots) {
+  vector<vector<int>> members(buckets);
+  for (size_t i = 0; i < words.size(); ++i) {
+    uint64_t hash = PerfectHash::hash(words[i].data(), words[i].size());
+    members[PerfectHash::bucket(hash, buckets)].push_back(i);
+  }
+
+  vector<size_t> order(buckets);
+  for (size_t i = 0; i < buckets; ++i)
+    order[i] = i;
+  stable_sort(order.begin(), order.end(), [&members](size_t a, size_t b) {
+    return members[a].size() > members[b].size();
+  });
+
+  displacements->assign(buckets, 0u);
+  slots->assign(size, -1);
+
+  for (size_t bucket : order) {
+    if (members[bucket].empty())
+      break;
+
+    bool placed = false;
+    for (uint32_t d = 0; d < 65536u && !placed; ++d) {
+      vector<size_t> taken;
+      placed = true;
+      for (int word : members[bucket]) {
+        uint64_t hash = PerfectHash::hash(words[word].data(),
+                                          words[word].size());
+        size_t slot = PerfectHash::slot(hash, d, size);
+        if ((*slots)[slot] != -1 ||
+            find(taken.begin(), taken.end(), slot) != taken.end()) {
+          placed = false;
+          break;
+        }
+        taken.push_back(slot);
+      }
+
+      if (placed) {
+        (*displacements)[bucket] = d;
+        for (size_t i = 0; i < taken.size(); ++i)
+          (*slots)[taken[i]] = members[bucket][i];
+      }
+    }
+
+    if (!placed)
+      return false;
+  }
+  return true;
+}
+
+//! Função main
+/*! Gera stop_words.h a partir de uma lista de palavras ignoradas.
+ *  Uso:
+ *    g++ -std=c++11 -o stop_words_generator stop_words_generator.cpp
+ *    ./stop_words_generator ignored_words.txt > stop_words.h
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+int main(int argc, char const *argv[]) {
+  if (argc != 2) {
+    cerr << "Uso: " << argv[0] << " ignored_words.txt > stop_words.h" << endl;
+    return 1;
+  }
+
+  ifstream file(argv[1], ios::in);
+  if (!file) {
+    cerr << "Erro ao abrir " << argv[1] << endl;
+    return 1;
+  }
+
+  set<string> unique;
+  string line;
+  while (getline(file, line))
+    split(line, &unique);
+  vector<string> words(unique.begin(), unique.end());
+
+  size_t size = 1u;
+  while (size < words.size() + words.size() / 4)
+    size <<= 1;
+  size_t buckets = words.size() / 4 + 1;
+
+  vector<uint32_t> displacements;
+  vector<int> slots;
+  while (!build(words, size, buckets, &displacements, &slots))
+    size <<= 1;
+
+  // Confere a tabela antes de escrever
+  for (const string& word : words) {
+    uint64_t hash = PerfectHash::hash(word.data(), word.size());
+    size_t slot = PerfectHash::slot(
+        hash, displacements[PerfectHash::bucket(hash, buckets)], size);
+    if (slots[slot] < 0 || words[slots[slot]] != word) {
+      cerr << "Tabela inválida para " << word << endl;
+      return 1;
+    }
+  }
+
+  uint64_t source = PerfectHash::hash(nullptr, 0u);
+  for (const string& word : words)
+    source = PerfectHash::hash(word.c_str(), word.size() + 1) ^ (source * 31u);
+
+  cout << "//!  Copyright [2017] <João Vicente Souto>\n"
+       << "//   Gerado por stop_words_generator.cpp a partir de "
+       << argv[1] << ", não editar.\n"
+       << "#ifndef STRUCTURES_STOP_WORDS_H\n"
+       << "#define STRUCTURES_STOP_WORDS_H\n\n"
+       << "#include <cstdint>\n#include <cstring>\n\n"
+       << "#include \"./perfect_hash.h\"\n\n"
+       << "namespace structures {\n\n"
+       << "//! Classe StopWords\n"
+       << "/*! Palavras ignoradas em uma tabela de hash perfeito montada em\n"
+       << " *  tempo de compilação. Cada consulta custa um hash e uma comparação.\n"
+       << " *\n"
+       << " *  \\author João Vicente Souto.\n"
+       << " *  \\since 20/06/17\n"
+       << " *  \\version 1.0\n"
+       << " */\n"
+       << "class StopWords {\n"
+       << " public:\n"
+       << "  static const size_t COUNT = " << words.size()
+       << "u;  //!< Palavras na tabela\n"
+       << "  static const size_t SIZE = " << size
+       << "u;  //!< Posições da tabela\n"
+       << "  static const size_t BUCKETS = " << buckets
+       << "u;  //!< Baldes\n"
+       << "  static const uint64_t SOURCE = 0x" << hex << source << dec
+       << "ull;  //!< Identifica a lista\n\n"
+       << "  static bool contains(const char* word, const size_t length);"
+       << "  // Consulta\n\n"
+       << " private:\n"
+       << "  static constexpr uint32_t DISPLACEMENTS[BUCKETS] = {";
+  for (size_t i = 0; i < buckets; ++i)
+    cout << (i % 12 == 0? "\n    " : " ") << displacements[i] << "u,";
+  cout << "\n  };  //!< Deslocamento de cada balde\n"
+       << "  static constexpr uint8_t LENGTHS[SIZE] = {";
+  for (size_t i = 0; i < size; ++i)
+    cout << (i % 16 == 0? "\n    " : " ")
+         << (slots[i] < 0? 0u : words[slots[i]].size()) << "u,";
+  cout << "\n  };  //!< Tamanho da palavra de cada posição\n"
+       << "  static constexpr const char* WORDS[SIZE] = {";
+  for (size_t i = 0; i < size; ++i) {
+    cout << (i % 6 == 0? "\n    " : " ");
+    if (slots[i] < 0)
+      cout << "\"\",";
+    else
+      cout << "\"" << words[slots[i]] << "\",";
+  }
+  cout << "\n  };  //!< Palavra de cada posição\n"
+       << "};\n\n"
+       << "constexpr uint32_t StopWords::DISPLACEMENTS[StopWords::BUCKETS];\n"
+       << "constexpr uint8_t StopWords::LENGTHS[StopWords::SIZE];\n"
+       << "constexpr const char* StopWords::WORDS[StopWords::SIZE];\n\n"
+       << "//! Consulta\n"
+       << "/*! \\param char* palavra, não precisa terminar em '\\0'\n"
+       << " *  \\param size_t tamanho da palavra\n"
+       << " *  \\return bool se a palavra é ignorada\n"
+       << " */\n"
+       << "bool StopWords::contains(const char* word, const size_t length) {\n"
+       << "  uint64_t hash = PerfectHash::hash(word, length);\n"
+       << "  size_t slot = PerfectHash::slot(\n"
+       << "      hash, DISPLACEMENTS[PerfectHash::bucket(hash, BUCKETS)], SIZE);\n"
+       << "  return LENGTHS[slot] == length &&\n"
+       << "         memcmp(WORDS[slot], word, length) == 0;\n"
+       << "}\n\n"
+       << "}  //  namespace structures\n\n"
+       << "#endif\n";
+
+  return 0;
+}
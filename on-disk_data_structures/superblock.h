@@ -0,0 +1,132 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_SUPERBLOCK_H
+#define STRUCTURES_SUPERBLOCK_H
+
+#include <cstdint>
+#include <stdexcept>
+
+#include "./page_cache.h"
+
+using namespace std;
+
+namespace structures {
+
+//! Classe Superblock
+/*! Cabeçalho gravado no início de cada arquivo de índice. Guarda o
+ *  necessário para reabrir o índice sem reindexar as manpages: raiz,
+ *  quantidade de nodes, profundidade, versão do formato e a impressão
+ *  digital do conjunto de arquivos que gerou o índice. Quem guarda
+ *  documentos também grava a soma dos tamanhos deles, para o ranking,
+ *  e quantos foram removidos mas continuam ocupando espaço.
+ *
+ *  Enquanto o índice está sendo construído a impressão digital gravada
+ *  é zero, assim uma construção interrompida nunca é reaproveitada.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class Superblock {
+ public:
+  Superblock();  // Construtor
+  Superblock(const uint64_t magic, const uint32_t version);  // Construtor
+  ~Superblock();  // Destrutor
+
+  bool load(PageCache* file);  // Lê do início do arquivo
+  void store(PageCache* file) const;  // Grava no início do arquivo
+  bool matches(const uint64_t magic, const uint32_t version,
+               const uint64_t fingerprint) const;  // Confere índice
+
+  static uint64_t hash(const void* data, const size_t length,
+                       uint64_t seed = 14695981039346656037ull);  // FNV-1a
+
+  uint64_t magic_{0u};  //!< Identifica o tipo do arquivo
+  uint32_t version_{0u},  //!< Versão do formato
+           removed_{0u};  //!< Documentos removidos ainda no arquivo
+  uint64_t fingerprint_{0u},  //!< Impressão digital das entradas
+           root_{0u},  //!< Deslocamento da raiz
+           size_{0u},  //!< Quantidade de nodes
+           depth_{0u},  //!< Profundidade
+           total_{0u};  //!< Soma dos tamanhos dos documentos, em palavras
+};
+
+//! Construtor
+/*! Sem parâmetros, superbloco zerado.
+ *  \sa Superblock(const uint64_t magic, const uint32_t version)
+ */
+Superblock::Superblock() {}
+
+//! Construtor
+/*! Com parâmetros, tipo e versão do arquivo.
+ *  \param uint64_t número mágico do arquivo
+ *  \param uint32_t versão do formato
+ *  \sa Superblock()
+ */
+Superblock::Superblock(const uint64_t magic, const uint32_t version) :
+magic_{magic},
+version_{version}
+{}
+
+//! Destrutor
+/*! Destrutor padrão, não tem nada alocado dinâmicamente.
+ *  \sa Superblock()
+ */
+Superblock::~Superblock() {}
+
+//! Lê superbloco
+/*! Lê o superbloco do início do arquivo.
+ *  \param PageCache* arquivo
+ *  \return bool se o arquivo tem um superbloco completo
+ *  \sa store()
+ */
+bool Superblock::load(PageCache* file) {
+  if (file->size() < sizeof(Superblock))
+    return false;
+
+  file->read(0u, this, sizeof(Superblock));
+  return true;
+}
+
+//! Grava superbloco
+/*! Sobreescreve o superbloco no início do arquivo.
+ *  \param PageCache* arquivo
+ *  \sa load()
+ */
+void Superblock::store(PageCache* file) const {
+  file->write(0u, this, sizeof(Superblock));
+}
+
+//! Confere superbloco
+/*! Verifica se o arquivo é do tipo e versão esperados e se foi gerado
+ *  a partir das mesmas entradas.
+ *  \param uint64_t número mágico esperado
+ *  \param uint32_t versão esperada
+ *  \param uint64_t impressão digital das entradas
+ *  \return bool se o índice pode ser reaproveitado
+ */
+bool Superblock::matches(const uint64_t magic, const uint32_t version,
+                         const uint64_t fingerprint) const {
+  return magic_ == magic && version_ == version &&
+         fingerprint != 0u && fingerprint_ == fingerprint;
+}
+
+//! Hash FNV-1a
+/*! Hash de 64 bits, usado para a impressão digital das entradas.
+ *  \param void* dados
+ *  \param size_t tamanho dos dados
+ *  \param uint64_t semente, permite encadear chamadas
+ *  \return uint64_t hash
+ */
+uint64_t Superblock::hash(const void* data, const size_t length,
+                          uint64_t seed) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < length; ++i) {
+    seed ^= bytes[i];
+    seed *= 1099511628211ull;
+  }
+  return seed;
+}
+
+}  //  namespace structures
+
+#endif
@@ -3,15 +3,31 @@
 #define STRUCTURES_SYSTEM_H
 
 #include <cstdint>
+#include <cctype>
 #include <stdexcept>
 #include <fstream>
 #include <cstdio>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
 #include <sys/stat.h>
 
 #include "./structures/linked_list.h"
 
+#include "./superblock.h"
 #include "./kd_tree_on_disk.h"
 #include "./binary_tree_of_lists_on_disk.h"
+#include "./index_builder.h"
+#include "./ingestion_pipeline.h"
+#include "./manifest.h"
+#include "./result_cache.h"
+#include "./io_stats.h"
+#include "./query_server.h"
+#include "./query_parser.h"
 #include "./word_handler.h"
 #include "./user_interface.h"
 
@@ -21,7 +37,10 @@ namespace structures {
 
 //! Classe System
 /*! Sistema responsável por gerenciar todas as árvore e interface
- *  com o usuário.
+ *  com o usuário. Os resultados das buscas ficam em um ResultCache,
+ *  então uma consulta repetida é respondida sem ler os índices.
+ *  Com -b as consultas vêm de um arquivo, sem menu (batch()); com -s
+ *  várias threads atendem consultas em um socket Unix (serve()).
  *
  *  \author João Vicente Souto.
  *  \since 20/06/17
@@ -34,25 +53,53 @@ class System {
 
    void init(int argc, char const *argv[]);  // Iniciação
    void run();  // Roda sistema
+   void batch(istream& in, ostream& out,
+              ostream& summary);  // Roda consultas em lote
+   void serve(const string& path,
+              const size_t workers = 0u);  // Servidor de consultas
+   vector<pair<string, size_t>> sizes() const;  // Tamanho dos índices
 
  private:
+   static const size_t RANKED = 10u;  //!< Resultados da busca ranqueada
+   static const size_t COMPACT_PERCENT = 25u;  //!< Lixo que dispara compactação
+
+   uint64_t fingerprint(int argc, char const *argv[]) const;  // Impressão digital
+   void refresh(const vector<string>& paths, Manifest* manifest,
+                const uint64_t hash);  // Atualiza índices
+   uint64_t generation() const;  // Geração dos índices
+   const ResultCache::Result* resolve(const string& key,
+                                      LinkedList<size_t>* docs,
+                                      ResultCache::Result* fresh);  // Nomes
+   const ResultCache::Result* search(const size_t option,
+                                     vector<string>* words,
+                                     ResultCache::Result* fresh);  // Busca
+   const ResultCache::Result* search(const QueryNode* query,
+                                     ResultCache::Result* fresh);  // Booleana
+   void show(const ResultCache::Result& result) const;  // Imprime nomes
+   string answer(const string& text, QueryParser* parser);  // Responde linha
+
    WordHandler *handler_;                 //!< Tratador de palavras
-   KDTreeOnDisk *primary_tree_;           //!< Árvore primária
-   BinaryTreeOfListOnDisk *secondary_tree_;  //!< Árvore secundária
-   UserInterface *user_;                  //!< Interface usuário
+   KDTreeOnDisk *primary_tree_{nullptr};  //!< Árvore primária
+   BinaryTreeOfListOnDisk *secondary_tree_{nullptr};  //!< Árvore secundária
+   UserInterface *user_{nullptr};         //!< Interface usuário
+   ResultCache *cache_;                   //!< Resultados das buscas
    size_t counter_primary{0u},            //!< Contador de chaves primárias
           counter_secondary{0u};          //!< Contador de chaves secundárias
+   bool positional_{false};               //!< Índice posicional, opção -p
+   string batch_,                         //!< Consultas em lote, opção -b
+          socket_;                        //!< Socket do servidor, opção -s
+   size_t workers_{0u};                   //!< Threads do servidor, opção -t
+   IOStats::Counters last_;               //!< E/S da última opção do menu
 };
 
 //! Construtor
-/*! Sem parâmetros, carrega palavras ignoradas de arquivo em disco.
+/*! Sem parâmetros, aloca o tratador de palavras e o cache de
+ *  resultados. A interface só existe fora do modo em lote.
  *  \sa ~System()
  */
 System::System() {
   handler_ = new WordHandler();
-  primary_tree_ = new KDTreeOnDisk();
-  secondary_tree_ = new BinaryTreeOfListOnDisk();
-  user_ = new UserInterface();
+  cache_ = new ResultCache();
 }
 
 //! Destrutor
@@ -64,150 +111,680 @@ System::~System() {
   delete primary_tree_;
   delete secondary_tree_;
   delete user_;
+  delete cache_;
+}
+
+//! Impressão digital das entradas
+/*! Hash dos caminhos, tamanhos e datas de modificação dos arquivos
+ *  passados, na ordem em que foram passados, das palavras ignoradas:
+ *  a lista compilada (StopWords::SOURCE) ou o arquivo que a substitui,
+ *  e de o índice ser posicional ou não.
+ *  Se nada mudou desde a última indexação o índice em disco é válido.
+ *  \param int argc quantidade-1 de arquivos
+ *  \param char const *argv[] diretórios dos arquivos
+ *  \return uint64_t impressão digital
+ *  \sa init()
+ */
+uint64_t System::fingerprint(int argc, char const *argv[]) const {
+  uint64_t hash = Superblock::hash(nullptr, 0u);
+  struct stat st;
+
+  uint64_t source = StopWords::SOURCE;
+  hash = Superblock::hash(&source, sizeof(source), hash);
+  if (positional_)
+    hash = Superblock::hash("-p", 2u, hash);
+
+  for (int i = 0; i <= argc; ++i) {
+    const char* path = i < argc? argv[i] : WordHandler::OVERRIDE;
+    if (i == 0)
+      continue;  // nome do executável
+    if (stat(path, &st) != 0) {
+      if (i == argc)
+        break;  // sem lista substituta
+      throw std::out_of_range("Erro ao verificar tamanho do arquivo.");
+    }
+
+    uint64_t size = st.st_size, modified = st.st_mtime;
+    hash = Superblock::hash(path, strlen(path) + 1, hash);
+    hash = Superblock::hash(&size, sizeof(size), hash);
+    hash = Superblock::hash(&modified, sizeof(modified), hash);
+  }
+
+  return hash == 0u? 1u : hash;  // zero indica índice não confirmado
 }
 
 //! Inicialização
 /*! Recebe quantidade e arquivos a serem indexados.
+ *  Se os índices em disco foram gerados a partir dos mesmos arquivos
+ *  eles são reabertos e nada é reindexado. Se só alguns arquivos
+ *  entraram, saíram ou mudaram, o manifesto diz quais e só eles são
+ *  tratados (refresh()).
  *  Idéia: começar pegando os arquivos do meio do array argv e indo
  *  para as extremidades para aproveitar e deixar a árvore k-d o mais
  *  "balanceada" possível.
+ *  A leitura e a separação de palavras rodam em paralelo
+ *  (IngestionPipeline), a escrita segue essa mesma ordem.
+ *  Um primeiro argumento -p liga o índice posicional, para frases e
+ *  NEAR na busca booleana; -b arquivo lê as consultas do arquivo, ou
+ *  da entrada padrão com -b -, em vez de abrir o menu; -s caminho
+ *  atende consultas no socket Unix, com -t threads; -c bytes muda o
+ *  limite do cache de consultas, 0 desliga.
  *  \param int argc quantidade-1 de arquivos
  *  \param char const *argv[] diretórios dos arquivos
  *  \sa run()
  */
 void System::init(int argc, char const *argv[]) {
   size_t decrement, increment;
-  int offset = 0;
-  string dir, aux;
-  LinkedList<string> *words;
-  struct stat st;
+  vector<string> paths;
+  IndexBuilder builder;
+  IngestionPipeline pipeline;
+
+  while (argc > 1 && argv[1][0] == '-' && argv[1][1] != '\0') {
+    size_t shift = 1u;
+    if (string(argv[1]) == "-p") {
+      positional_ = true;
+    } else if (string(argv[1]) == "-b" && argc > 2) {
+      batch_ = argv[2];
+      shift = 2u;
+    } else if (string(argv[1]) == "-s" && argc > 2) {
+      socket_ = argv[2];
+      shift = 2u;
+    } else if (string(argv[1]) == "-t" && argc > 2) {
+      workers_ = strtoul(argv[2], nullptr, 10);
+      shift = 2u;
+    } else if (string(argv[1]) == "-c" && argc > 2) {
+      delete cache_;
+      cache_ = new ResultCache(strtoul(argv[2], nullptr, 10));
+      shift = 2u;
+    } else {
+      break;
+    }
+    argv[shift] = argv[0];
+    argv += shift;
+    argc -= shift;
+  }
+  uint64_t hash = fingerprint(argc, argv);
+  Manifest manifest(fingerprint(1, argv));
 
   increment = static_cast<size_t>(((int) ((argc-1) / 2)) + 1);
   decrement = increment-1;
 
-  for (size_t i = 1; i < argc; ++i) {
-    counter_primary++;
-    dir = i % 2 == 1? argv[increment++] : argv[decrement--];
+  for (size_t i = 1; i < argc; ++i)
+    paths.push_back(i % 2 == 1? argv[increment++] : argv[decrement--]);
+
+  if (manifest.valid()) {
+    primary_tree_ = new KDTreeOnDisk(manifest.fingerprint());
+    secondary_tree_ = new BinaryTreeOfListOnDisk(manifest.fingerprint(),
+                                                 positional_);
+    if (primary_tree_->reopened() && secondary_tree_->reopened()) {
+      if (manifest.fingerprint() != hash)
+        refresh(paths, &manifest, hash);
+      counter_primary = primary_tree_->size();
+      return;
+    }
 
-    // Chave primária e manpages
-    if (stat(dir.c_str(), &st) != 0)
-      throw std::out_of_range("Erro ao verificar tamanho do arquivo.");
+    // Um dos índices não serve, os dois são reconstruídos juntos
+    delete primary_tree_;
+    delete secondary_tree_;
+  }
+  manifest.invalidate();
+  primary_tree_ = new KDTreeOnDisk();
+  secondary_tree_ = new BinaryTreeOfListOnDisk(positional_);
+
+  vector<Manifest::Entry> entries;
+  for (const string& path : paths)
+    entries.push_back(Manifest::stat(path));
+
+  pipeline.run(paths, primary_tree_, &builder, secondary_tree_->positions());
+  counter_primary += pipeline.documents();
+  counter_secondary += pipeline.words();
+  for (size_t i = 0; i < entries.size(); ++i)
+    entries[i].doc_ = pipeline.docs()[i];
+
+  builder.finish(secondary_tree_);
+  primary_tree_->commit(hash);
+  secondary_tree_->commit(hash);
+  manifest.commit(entries, hash);
+}
+
+//! Atualiza índices
+/*! Compara os arquivos passados com os do manifesto pelo tamanho e
+ *  data de modificação. As manpages de arquivos que sumiram ou mudaram
+ *  são marcadas como removidas; os arquivos novos ou mudados passam
+ *  pela indexação e são acrescentados nas duas árvores. Se o lixo no
+ *  arquivo de dados passar de COMPACT_PERCENT as duas árvores são
+ *  compactadas antes de confirmar.
+ *  \param vector<string> caminhos passados agora
+ *  \param Manifest* manifesto da última confirmação
+ *  \param uint64_t impressão digital dos arquivos passados agora
+ *  \sa init()
+ */
+void System::refresh(const vector<string>& paths, Manifest* manifest,
+                     const uint64_t hash) {
+  unordered_map<string, Manifest::Entry> before;
+  vector<Manifest::Entry> entries;
+  vector<string> added;
+  vector<size_t> slots;
+  IndexBuilder builder;
+  IngestionPipeline pipeline;
+
+  for (const Manifest::Entry& entry : manifest->entries())
+    before[entry.path_] = entry;
+  manifest->invalidate();
+
+  for (const string& path : paths) {
+    Manifest::Entry entry = Manifest::stat(path);
+    auto old = before.find(path);
+    if (old != before.end()) {
+      if (old->second.size_ == entry.size_ &&
+          old->second.modified_ == entry.modified_ && old->second.doc_ != 0u) {
+        entry.doc_ = old->second.doc_;
+        before.erase(old);
+        entries.push_back(entry);
+        continue;
+      }
+      if (old->second.doc_ != 0u)
+        primary_tree_->remove(old->second.doc_);
+      before.erase(old);
+    }
+    slots.push_back(entries.size());
+    added.push_back(path);
+    entries.push_back(entry);
+  }
 
-    ifstream file(dir.c_str(), ios::in);
+  for (const auto& old : before)
+    if (old.second.doc_ != 0u)
+      primary_tree_->remove(old.second.doc_);
 
-    char manpage[st.st_size];
-    file.seekg(0);
-    file.read(manpage, st.st_size);
+  pipeline.run(added, primary_tree_, &builder, secondary_tree_->positions());
+  for (size_t i = 0; i < slots.size(); ++i)
+    entries[slots[i]].doc_ = pipeline.docs()[i];
+  counter_secondary += pipeline.words();
+  builder.update(secondary_tree_);
 
-    manpage[st.st_size-1] = '\0';
-    dir = handler_->clean_primary_key(dir);
-    offset = primary_tree_->insert(dir.c_str(), st.st_size, manpage);
+  if (primary_tree_->garbage() > COMPACT_PERCENT) {
+    primary_tree_->compact();
+    secondary_tree_->compact(primary_tree_);
+  }
+
+  primary_tree_->commit(hash);
+  secondary_tree_->commit(hash);
+  manifest->commit(entries, hash);
+}
 
-    words = handler_->treatment(file);
-    counter_secondary += words->size();
+//! Geração dos índices
+/*! \return uint64_t muda sempre que uma das árvores muda
+ *  \sa ResultCache
+ */
+uint64_t System::generation() const {
+  return primary_tree_->generation() + secondary_tree_->generation();
+}
 
-    while (!words->empty()) {
-      aux = words->pop_front();
-      secondary_tree_->insert(aux.c_str(), offset);
+//! Nomes das manpages
+/*! Troca os docids pelos nomes, em ordem, e guarda o resultado no
+ *  cache.
+ *  \param string consulta normalizada
+ *  \param LinkedList<size_t>* docids, é desalocada
+ *  \param Result* onde o resultado é montado
+ *  \return Result* o próprio fresh
+ */
+const ResultCache::Result* System::resolve(const string& key,
+                                           LinkedList<size_t>* docs,
+                                           ResultCache::Result* fresh) {
+  vector<size_t> wanted;
+  wanted.reserve(docs->size());
+  while (!docs->empty())
+    wanted.push_back(docs->pop_front());
+  delete docs;
+
+  fresh->names_ = primary_tree_->return_primary_key(wanted);
+  fresh->scores_.clear();
+  cache_->insert(key, *fresh, generation());
+  return fresh;
+}
+
+//! Busca por chaves secundárias
+/*! Opções 1, 2, 3 e 7 do menu, primeiro no cache. Na busca ranqueada
+ *  as chaves passam para minúsculas.
+ *  \param size_t opção do menu
+ *  \param vector<string>* chaves, uma para a opção 1 e duas para 2 e 3
+ *  \param Result* onde o resultado é montado se não estiver no cache
+ *  \return Result* resultado, do cache ou o próprio fresh
+ *  \throw std::invalid_argument chaves que a busca não aceita
+ */
+const ResultCache::Result* System::search(const size_t option,
+                                          vector<string>* words,
+                                          ResultCache::Result* fresh) {
+  string key = to_string(option);
+  if (option == 2u || option == 3u) {
+    if (words->size() != 2u)
+      throw std::invalid_argument("Informe duas chaves secundárias.");
+    key += " " + min((*words)[0], (*words)[1]) + " " +
+           max((*words)[0], (*words)[1]);
+  } else {
+    if (option == 1u && words->size() != 1u)
+      throw std::invalid_argument("Informe uma chave secundária.");
+    for (string& word : *words) {
+      if (option == 7u)
+        for (char& letter : word)
+          letter = tolower(static_cast<unsigned char>(letter));
+      key += " " + word;
     }
+  }
+
+  if (cache_->find(key, generation(), fresh))
+    return fresh;
+
+  switch (option) {
+    case 1:
+      return resolve(key, secondary_tree_->search((*words)[0].c_str()), fresh);
+    case 2:
+      return resolve(key, secondary_tree_->conjunctive_search(
+                              (*words)[0].c_str(), (*words)[1].c_str()),
+                     fresh);
+    case 3:
+      return resolve(key, secondary_tree_->disjunctive_search(
+                              (*words)[0].c_str(), (*words)[1].c_str()),
+                     fresh);
+    default:
+      break;
+  }
 
-    file.close();
-    delete words;
+  vector<TopK::Result> ranking;
+  secondary_tree_->top(*words, RANKED, primary_tree_, &ranking);
+  fresh->names_.clear();
+  fresh->scores_.clear();
+  for (const TopK::Result& ranked : ranking) {
+    fresh->names_.push_back(primary_tree_->return_primary_key(ranked.doc_));
+    fresh->scores_.push_back(ranked.score_);
   }
+  cache_->insert(key, *fresh, generation());
+  return fresh;
+}
+
+//! Busca booleana
+/*! Opção 6 do menu, primeiro no cache pela forma canônica da consulta.
+ *  \param QueryNode* consulta já montada
+ *  \param Result* onde o resultado é montado se não estiver no cache
+ *  \return Result* resultado, do cache ou o próprio fresh
+ *  \throw std::invalid_argument consulta que o índice não aceita
+ */
+const ResultCache::Result* System::search(const QueryNode* query,
+                                          ResultCache::Result* fresh) {
+  string key = "6 " + query->to_string();
+  if (cache_->find(key, generation(), fresh))
+    return fresh;
+  return resolve(key, secondary_tree_->query(const_cast<QueryNode*>(query)),
+                 fresh);
+}
+
+//! Imprime nomes
+/*! \param Result manpages encontradas, numeradas a partir de 1
+ */
+void System::show(const ResultCache::Result& result) const {
+  for (size_t i = 0; i < result.names_.size(); ++i)
+    cout << i + 1 << ". " << result.names_[i] << endl;
 }
 
 //! Roda sistema
 /*! Conversa com usuário e executa as opções que ele deseja.
- *  \sa init()
+ *  As buscas por chave secundária são procuradas primeiro no cache,
+ *  pela opção e consulta normalizada. A entrada e saída de cada opção
+ *  é medida e a opção 4 mostra a da última junto com os totais. Com -b
+ *  roda as consultas do arquivo em lote e com -s vira servidor.
+ *  \sa init(), batch(), serve()
  */
 void System::run() {
   string word_one, word_two;
-  char* manpage;
-  LinkedList<string> *manpages;
-  LinkedList<size_t> *offsets;
-  size_t option = 0, count;
+  istringstream words;
+  vector<string> names;
+  vector<ManpageHeap::View> views;
+  const ResultCache::Result *result;
+  ResultCache::Result fresh;
+  IOStats::Counters io;
+  QueryParser parser(handler_);
+  QueryNode *query;
+  size_t option = 0;
+
+  if (!socket_.empty()) {
+    serve(socket_, workers_);
+    return;
+  }
+
+  if (!batch_.empty()) {
+    if (batch_ == "-") {
+      batch(cin, cout, cerr);
+      return;
+    }
+    ifstream file(batch_.c_str());
+    if (!file)
+      throw std::out_of_range("Erro ao abrir arquivo de consultas.");
+    batch(file, cout, cerr);
+    return;
+  }
 
-  while (option != 5) {
+  user_ = new UserInterface();
+  while (option != UserInterface::EXIT) {
     option = user_->choose_option();
+    IOStats::Scope operation;
 
     switch (option) {
       case 0:
-        word_one = user_->ask_word("\nInforme a chave primária:");
-        manpage = primary_tree_->search_primary_key(word_one.c_str());
-        if (manpage != nullptr) {
-          cout << endl << word_one << endl << endl;
-          cout << manpage << endl;
-        } else {
-          cout << "\nArquivo \"" << word_one << "\" não encontrado." << endl;
+        word_one = user_->ask_line("\nInforme uma ou mais chaves primárias:");
+        names.clear();
+        words.clear();
+        words.str(word_one);
+        while (words >> word_two)
+          names.push_back(word_two);
+        views = primary_tree_->search_primary_key(names);
+
+        for (size_t i = 0; i < names.size(); ++i) {
+          if (views[i].data_ != nullptr) {
+            cout << endl << names[i] << endl << endl;
+            cout.write(views[i].data_, views[i].length_);
+            cout << endl;
+          } else {
+            cout << "\nArquivo \"" << names[i] << "\" não encontrado." << endl;
+          }
         }
-
-        delete manpage;
         break;
 
       case 1:
         word_one = user_->ask_word("\nInforme a chave secundária:");
-        offsets = secondary_tree_->search(word_one.c_str());
-        manpages = primary_tree_->return_primary_key(offsets);
+        names.assign(1, word_one);
+        result = search(option, &names, &fresh);
 
-        cout << endl << manpages->size() << " arquivos encontrados com \"";
+        cout << endl << result->names_.size() << " arquivos encontrados com \"";
         cout << word_one << "\":\n" << endl;
-        count = 1;
-        while (!manpages->empty()) {
-          cout << count++ << ". " << manpages->pop_front() << endl;
-        }
-
-        delete offsets;
-        delete manpages;
+        show(*result);
         break;
 
       case 2:
         word_one = user_->ask_word("\nInforme a chave 1ª secundária:");
         word_two = user_->ask_word("\nInforme a chave 2ª secundária:");
-        offsets = secondary_tree_->conjunctive_search(word_one.c_str(), word_two.c_str());
-        manpages = primary_tree_->return_primary_key(offsets);
+        names = {word_one, word_two};
+        result = search(option, &names, &fresh);
 
-        cout << endl << manpages->size() << " arquivos encontrados com \"";
+        cout << endl << result->names_.size() << " arquivos encontrados com \"";
         cout << word_one << "\" ou \"" << word_two << "\":\n" << endl;
-        count = 1;
-        while (!manpages->empty()) {
-          cout << count++ << ". " << manpages->pop_front() << endl;
-        }
-
-        delete offsets;
-        delete manpages;
+        show(*result);
         break;
 
       case 3:
         word_one = user_->ask_word("\nInforme a chave 1ª secundária:");
         word_two = user_->ask_word("\nInforme a chave 2ª secundária:");
-        offsets = secondary_tree_->disjunctive_search(word_one.c_str(), word_two.c_str());
-        manpages = primary_tree_->return_primary_key(offsets);
+        names = {word_one, word_two};
+        result = search(option, &names, &fresh);
 
-        cout << endl << manpages->size() << " arquivos encontrados com \"";
+        cout << endl << result->names_.size() << " arquivos encontrados com \"";
         cout << word_one << "\" e \"" << word_two << "\":\n" << endl;
-        count = 1;
-        while (!manpages->empty()) {
-          cout << count++ << ". " << manpages->pop_front() << endl;
-        }
-
-        delete offsets;
-        delete manpages;
+        show(*result);
         break;
 
       case 4:
         cout << "\nÁrvore primária\nQuantidade de nodes: ";
         cout << primary_tree_->size() << endl;
         cout << "Profundidade: " << primary_tree_->depth() << endl;
+        cout << "Profundidade do índice de nomes: ";
+        cout << primary_tree_->names_depth() << endl;
         cout << "\nÁrvore secundária\nQuantidade de nodes: ";
         cout << secondary_tree_->size() << endl;
         cout << "Profundidade: " << secondary_tree_->depth() << endl;
+        cout << "\nCache de consultas\nAcertos: " << cache_->hits() << endl;
+        cout << "Faltas: " << cache_->misses() << endl;
+        cout << "Consultas guardadas: " << cache_->size() << " (";
+        cout << cache_->bytes() << " bytes)" << endl;
+        io = IOStats::total();
+        cout << "\nEntrada e saída\nArquivos abertos: " << io.opens_ << endl;
+        cout << "Leituras: " << io.reads_ << " (" << io.bytes_read_;
+        cout << " bytes)" << endl;
+        cout << "Escritas: " << io.writes_ << " (" << io.bytes_written_;
+        cout << " bytes)" << endl;
+        cout << "Páginas acessadas: " << io.accesses_ << endl;
+        cout << "Última operação: " << last_.reads_ << " leituras (";
+        cout << last_.bytes_read_ << " bytes), " << last_.writes_;
+        cout << " escritas, " << last_.pages_ << " páginas distintas" << endl;
+        break;
+
+      case 6:
+        word_one = user_->ask_line("\nInforme a consulta:");
+        try {
+          query = parser.parse(word_one);
+        } catch (std::invalid_argument& error) {
+          cout << endl << error.what() << endl;
+          break;
+        }
+
+        try {
+          result = search(query, &fresh);
+        } catch (std::invalid_argument& error) {
+          cout << endl << error.what() << endl;
+          delete query;
+          break;
+        }
+
+        cout << endl << result->names_.size() << " arquivos encontrados com ";
+        cout << query->to_string() << ":\n" << endl;
+        show(*result);
+        delete query;
+        break;
+
+      case 7:
+        word_one = user_->ask_line("\nInforme as chaves secundárias:");
+        names.clear();
+        words.clear();
+        words.str(word_one);
+        while (words >> word_two)
+          names.push_back(word_two);
+
+        try {
+          result = search(option, &names, &fresh);
+        } catch (std::invalid_argument& error) {
+          cout << endl << error.what() << endl;
+          break;
+        }
+
+        cout << endl << result->names_.size() << " melhores arquivos para \"";
+        cout << word_one << "\":\n" << endl;
+        for (size_t i = 0; i < result->names_.size(); ++i) {
+          cout << i + 1 << ". " << result->names_[i];
+          cout << " (" << result->scores_[i] << ")" << endl;
+        }
         break;
 
       default:
         cout << "\nFIM" << endl;
         break;
     }
+    if (option != 4u)
+      last_ = operation.counters();
+  }
+}
+
+//! Responde uma consulta
+/*! Consulta em uma linha: o número da opção do menu seguido do que o
+ *  menu pediria, na mesma linha.
+ *
+ *      0 ls cat
+ *      1 sock*
+ *      2 file system
+ *      3 file system
+ *      6 socket AND (bind OR connect)
+ *      7 socket bind
+ *
+ *  A resposta tem dois campos separados por tabulação: a quantidade de
+ *  resultados e os nomes separados por espaço (na busca ranqueada
+ *  nome:pontuação), ou "erro" e a mensagem. A consulta é uma operação
+ *  para IOStats, com as suas páginas distintas. Pode ser chamada por
+ *  várias threads depois de share(), cada uma com o seu QueryParser.
+ *  \param string consulta, sem tabulações
+ *  \param QueryParser* tratador da busca booleana desta thread
+ *  \return string resposta, sem quebra de linha
+ *  \sa batch(), serve()
+ */
+string System::answer(const string& text, QueryParser* parser) {
+  IOStats::Scope operation;
+  istringstream words(text);
+  string line, word;
+  size_t option;
+  if (words >> option)
+    getline(words >> ws, line);
+  else
+    option = UserInterface::EXIT;  // linha sem opção
+
+  vector<string> names;
+  const ResultCache::Result *result;
+  ResultCache::Result fresh;
+  try {
+    if (option == 6u) {
+      QueryNode *query = parser->parse(line);
+      try {
+        result = search(query, &fresh);
+      } catch (...) {
+        delete query;
+        throw;
+      }
+      delete query;
+    } else if (option == 0u || option == 1u || option == 2u ||
+               option == 3u || option == 7u) {
+      istringstream keys(line);
+      while (keys >> word)
+        names.push_back(word);
+      if (option == 0u) {
+        vector<ManpageHeap::View> views =
+            primary_tree_->search_primary_key(names);
+        for (size_t i = 0; i < names.size(); ++i)
+          if (views[i].data_ != nullptr)
+            fresh.names_.push_back(names[i]);
+        result = &fresh;
+      } else {
+        result = search(option, &names, &fresh);
+      }
+    } else {
+      throw std::invalid_argument("Opção inválida.");
+    }
+  } catch (std::invalid_argument& failure) {
+    return string("erro\t") + failure.what();
+  }
+
+  ostringstream record;
+  record << result->names_.size() << '\t';
+  for (size_t i = 0; i < result->names_.size(); ++i) {
+    record << (i == 0? "" : " ") << result->names_[i];
+    if (!result->scores_.empty())
+      record << ':' << result->scores_[i];
+  }
+  return record.str();
+}
+
+//! Roda consultas em lote
+/*! Cada linha da entrada é uma consulta no formato de answer(); linhas
+ *  vazias ou começando com '#' são puladas. Cada consulta vira uma
+ *  linha de saída com campos separados por tabulação: número da
+ *  consulta, consulta, tempo em microssegundos e a resposta de
+ *  answer(). No fim o resumo vai para summary: quantidade de consultas,
+ *  tempo total, consultas por segundo, latências p50 e p99 e a média de
+ *  leituras, bytes lidos e páginas distintas por consulta.
+ *  \param istream entrada das consultas
+ *  \param ostream saída dos resultados
+ *  \param ostream saída do resumo
+ *  \sa run(), answer()
+ */
+void System::batch(istream& in, ostream& out, ostream& summary) {
+  typedef chrono::steady_clock Clock;
+  string text, response;
+  vector<double> latencies;
+  QueryParser parser(handler_);
+  size_t errors = 0u;
+  IOStats::Counters before = IOStats::total();
+  Clock::time_point begin = Clock::now();
+
+  while (getline(in, text)) {
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == string::npos || text[first] == '#')
+      continue;
+    text.erase(0, first);
+    text.erase(text.find_last_not_of(" \t\r") + 1);
+    replace(text.begin(), text.end(), '\t', ' ');
+
+    Clock::time_point start = Clock::now();
+    response = answer(text, &parser);
+    double elapsed = chrono::duration<double, micro>(Clock::now() -
+                                                     start).count();
+    latencies.push_back(elapsed);
+    if (response.compare(0, 5, "erro\t") == 0)
+      ++errors;
+
+    out << latencies.size() << '\t' << text << '\t';
+    out << fixed << setprecision(1) << elapsed << '\t';
+    out.unsetf(ios::floatfield);
+    out << setprecision(6) << response << '\n';
   }
+  out.flush();
+  double total = chrono::duration<double, micro>(Clock::now() -
+                                                 begin).count();
+
+  size_t count = latencies.size();
+  sort(latencies.begin(), latencies.end());
+  auto percentile = [&latencies, count](const size_t p) {
+    return count == 0u? 0.0 : latencies[(count * p + 99u) / 100u - 1u];
+  };
+
+  summary << "Consultas: " << count << " (" << errors << " com erro)" << endl;
+  summary << fixed << setprecision(1);
+  summary << "Tempo: " << total / 1000.0 << " ms" << endl;
+  summary << "QPS: " << (total == 0.0? 0.0 : count * 1e6 / total) << endl;
+  summary << "Latência p50: " << percentile(50u) << " us" << endl;
+  summary << "Latência p99: " << percentile(99u) << " us" << endl;
+  IOStats::Counters after = IOStats::total();
+  double queries = count == 0u? 1.0 : count;
+  summary << "E/S por consulta: ";
+  summary << (after.reads_ - before.reads_) / queries << " leituras, ";
+  summary << (after.bytes_read_ - before.bytes_read_) / queries;
+  summary << " bytes, " << (after.pages_ - before.pages_) / queries;
+  summary << " páginas distintas" << endl;
+  summary.unsetf(ios::floatfield);
+}
+
+//! Servidor de consultas
+/*! Passa os índices para leitura concorrente e atende no socket Unix
+ *  recebido, cada linha uma consulta no formato de answer(), até
+ *  receber SIGINT ou SIGTERM.
+ *  \param string caminho do socket
+ *  \param size_t threads de atendimento, 0 usa uma por núcleo
+ *  \sa QueryServer, answer()
+ */
+void System::serve(const string& path, const size_t workers) {
+  primary_tree_->share();
+  secondary_tree_->share();
+
+  QueryServer server(path, workers, [this](const string& line) {
+    thread_local QueryParser parser(handler_);
+    string text(line);
+    replace(text.begin(), text.end(), '\t', ' ');
+    return answer(text, &parser);
+  });
+  cerr << "Atendendo em " << path << endl;
+  server.run();
+}
+
+//! Tamanho dos índices
+/*! Para medir o espaço em disco de cada arquivo, na ordem em que são
+ *  montados. O índice posicional só aparece com -p.
+ *  \return vector<pair<string, size_t>> arquivo e tamanho em bytes
+ */
+vector<pair<string, size_t>> System::sizes() const {
+  vector<pair<string, size_t>> files = {
+      {"primary_tree.dat", primary_tree_->file_size()},
+      {"manpages.dat", primary_tree_->data_size()},
+      {"name_index.dat", primary_tree_->names_size()},
+      {"documents.dat", primary_tree_->documents_size()},
+      {"secondary_tree.dat", secondary_tree_->file_size()},
+      {"permuterm.dat", secondary_tree_->permuterm_size()}};
+  if (secondary_tree_->positions())
+    files.push_back({"positions.dat",
+                     secondary_tree_->positions()->file_size()});
+  return files;
 }
 
 }  //  namespace structures
@@ -0,0 +1,450 @@
+// Copyright [2017] <João Vicente Souto>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./b_plus_tree_on_disk.h"
+#include "./superblock.h"
+
+int main(int argc, char* argv[]) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace {
+
+const char* const PATH = "./tests_b_plus_tree_on_disk.dat";
+
+/**
+ * Chave de tamanho fixo, em ordem crescente com i.
+ */
+std::string key(size_t i) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "key%08zu", i);
+    return buffer;
+}
+
+}  // namespace
+
+class BPlusTreeOnDiskTest: public ::testing::Test {
+protected:
+    void SetUp() override {
+        open();
+        file->truncate();
+        structures::Superblock().store(file);  // como nos índices reais
+    }
+
+    void TearDown() override {
+        delete tree;
+        delete file;
+        std::remove(PATH);
+    }
+
+    void open() {
+        file = new structures::PageCache(PATH, 16u);
+        tree = new structures::BPlusTreeOnDisk<uint64_t>(file);
+    }
+
+    /**
+     * Confere a árvore contra o mapa: busca de cada chave, scan() de
+     * tudo em ordem e tamanho.
+     */
+    void check() {
+        ASSERT_EQ(reference.size(), tree->size());
+        uint64_t value;
+        for (const auto& entry : reference) {
+            ASSERT_TRUE(tree->find(entry.first.c_str(), &value)) << entry.first;
+            ASSERT_EQ(entry.second, value) << entry.first;
+        }
+
+        std::vector<std::pair<std::string, uint64_t>> all;
+        tree->scan("", &all);
+        ASSERT_EQ(reference.size(), all.size());
+        auto it = reference.begin();
+        for (size_t i = 0; i < all.size(); ++i, ++it) {
+            ASSERT_EQ(it->first, all[i].first);
+            ASSERT_EQ(it->second, all[i].second);
+        }
+    }
+
+    /**
+     * Insere até a árvore ganhar um nível, conferindo a cada divisão.
+     */
+    void insert_until(const size_t depth, const std::vector<size_t>& order) {
+        size_t before = tree->depth();
+        for (size_t i : order) {
+            reference[key(i)] = i;
+            tree->insert(key(i).c_str(), i);
+            if (tree->depth() != before) {
+                before = tree->depth();
+                check();
+                if (before == depth)
+                    return;
+            }
+        }
+        FAIL() << "a árvore não chegou a altura " << depth;
+    }
+
+    structures::PageCache *file{nullptr};
+    structures::BPlusTreeOnDisk<uint64_t> *tree{nullptr};
+    std::map<std::string, uint64_t> reference;
+};
+
+TEST_F(BPlusTreeOnDiskTest, EmptyTree) {
+    uint64_t value;
+    ASSERT_TRUE(tree->empty());
+    ASSERT_EQ(0u, tree->size());
+    ASSERT_FALSE(tree->find("key", &value));
+}
+
+TEST_F(BPlusTreeOnDiskTest, BasicInsert) {
+    uint64_t value;
+    tree->insert("cat", 1u);
+    tree->insert("ls", 2u);
+    tree->insert("awk", 3u);
+
+    ASSERT_EQ(3u, tree->size());
+    ASSERT_EQ(1u, tree->depth());
+    ASSERT_TRUE(tree->find("ls", &value));
+    ASSERT_EQ(2u, value);
+    ASSERT_TRUE(tree->find("awk", &value));
+    ASSERT_EQ(3u, value);
+    ASSERT_FALSE(tree->find("c", &value));
+    ASSERT_FALSE(tree->find("cats", &value));
+}
+
+TEST_F(BPlusTreeOnDiskTest, SplitAscending) {
+    std::vector<size_t> order;
+    for (size_t i = 0; i < 200000u; ++i)
+        order.push_back(i);
+    insert_until(3u, order);
+}
+
+TEST_F(BPlusTreeOnDiskTest, SplitDescending) {
+    std::vector<size_t> order;
+    for (size_t i = 200000u; i > 0; --i)
+        order.push_back(i);
+    insert_until(3u, order);
+}
+
+TEST_F(BPlusTreeOnDiskTest, SplitRandom) {
+    std::vector<size_t> order;
+    for (size_t i = 0; i < 200000u; ++i)
+        order.push_back(i);
+    std::shuffle(order.begin(), order.end(), std::mt19937(7u));
+    insert_until(3u, order);
+}
+
+TEST_F(BPlusTreeOnDiskTest, FindAroundSeparators) {
+    // A primeira e a última chave de cada folha são vizinhas de um
+    // separador: procurar cada uma e as ausentes logo antes e depois.
+    for (size_t i = 0; i < 20000u; i += 2) {
+        reference[key(i)] = i;
+        tree->insert(key(i).c_str(), i);
+    }
+    check();
+
+    uint64_t value;
+    for (size_t i = 1; i < 20000u; i += 2)
+        ASSERT_FALSE(tree->find(key(i).c_str(), &value)) << key(i);
+}
+
+TEST_F(BPlusTreeOnDiskTest, DuplicateInsertReplaces) {
+    uint64_t value;
+    tree->insert("ls", 1u);
+    tree->insert("ls", 2u);
+    ASSERT_EQ(1u, tree->size());
+    ASSERT_TRUE(tree->find("ls", &value));
+    ASSERT_EQ(2u, value);
+
+    for (size_t i = 0; i < 5000u; ++i)
+        tree->insert(key(i).c_str(), i);
+    for (size_t i = 0; i < 5000u; ++i) {
+        reference[key(i)] = i + 1u;
+        tree->insert(key(i).c_str(), i + 1u);
+    }
+    reference["ls"] = 2u;
+    check();
+}
+
+TEST_F(BPlusTreeOnDiskTest, DuplicateKeysInBatchFind) {
+    for (size_t i = 0; i < 5000u; ++i)
+        tree->insert(key(i).c_str(), i);
+
+    std::vector<std::string> keys = {key(7), "absent", key(7), key(4999),
+                                     key(0), key(7), "absent"};
+    std::vector<uint64_t> values;
+    std::vector<bool> found;
+    ASSERT_EQ(5u, tree->find(keys, &values, &found));
+    ASSERT_EQ(keys.size(), values.size());
+
+    std::vector<bool> expected = {true, false, true, true, true, true, false};
+    ASSERT_EQ(expected, found);
+    ASSERT_EQ(7u, values[0]);
+    ASSERT_EQ(7u, values[2]);
+    ASSERT_EQ(4999u, values[3]);
+    ASSERT_EQ(0u, values[4]);
+    ASSERT_EQ(7u, values[5]);
+}
+
+TEST_F(BPlusTreeOnDiskTest, BatchFindAcrossLeaves) {
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < 50000u; ++i) {
+        if (i % 3 != 0)
+            tree->insert(key(i).c_str(), i);
+        keys.push_back(key(i));
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(3u));
+
+    std::vector<uint64_t> values;
+    std::vector<bool> found;
+    tree->find(keys, &values, &found);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        size_t number = std::stoul(keys[i].substr(3));
+        ASSERT_EQ(number % 3 != 0, found[i]) << keys[i];
+        if (found[i]) {
+            ASSERT_EQ(number, values[i]);
+        }
+    }
+}
+
+TEST_F(BPlusTreeOnDiskTest, EmptyPrefixScan) {
+    std::vector<std::pair<std::string, uint64_t>> out;
+    tree->scan("", &out);
+    ASSERT_TRUE(out.empty());
+
+    tree->insert("cat", 1u);
+    tree->insert("cal", 2u);
+    tree->insert("ls", 3u);
+    tree->scan("", &out);  // prefixo vazio: todas as chaves
+    ASSERT_EQ(3u, out.size());
+    ASSERT_EQ("cal", out[0].first);
+    ASSERT_EQ("cat", out[1].first);
+    ASSERT_EQ("ls", out[2].first);
+
+    // scan() acrescenta em out, como na expansão de curingas
+    out.clear();
+    tree->scan("d", &out);
+    ASSERT_TRUE(out.empty());
+    tree->scan("lsx", &out);
+    ASSERT_TRUE(out.empty());
+    tree->scan("zzz", &out);
+    ASSERT_TRUE(out.empty());
+    tree->scan("ca", &out);
+    tree->scan("l", &out);
+    ASSERT_EQ(3u, out.size());
+}
+
+TEST_F(BPlusTreeOnDiskTest, PrefixScanAcrossLeaves) {
+    for (size_t i = 0; i < 30000u; ++i) {
+        reference[key(i)] = i;
+        tree->insert(key(i).c_str(), i);
+    }
+
+    std::vector<std::pair<std::string, uint64_t>> out;
+    tree->scan("key0001", &out);  // key00010000 a key00019999
+    ASSERT_EQ(10000u, out.size());
+    for (size_t i = 0; i < out.size(); ++i) {
+        ASSERT_EQ(key(10000u + i), out[i].first);
+        ASSERT_EQ(10000u + i, out[i].second);
+    }
+}
+
+TEST_F(BPlusTreeOnDiskTest, BulkLoad) {
+    for (size_t i = 0; i < 100000u; ++i) {
+        reference[key(i)] = i;
+        tree->bulk_insert(key(i).c_str(), i);
+    }
+    tree->bulk_finish();
+    ASSERT_LE(2u, tree->depth());
+    check();
+
+    // Depois da carga a árvore aceita inserções comuns
+    for (size_t i = 7u; i < 100000u; i += 7u) {
+        std::string middle = key(i) + "m";
+        reference[middle] = i;
+        tree->insert(middle.c_str(), i);
+    }
+    check();
+}
+
+TEST_F(BPlusTreeOnDiskTest, ReopenAfterRestore) {
+    for (size_t i = 0; i < 30000u; ++i) {
+        reference[key(i)] = i;
+        tree->insert(key(i).c_str(), i);
+    }
+    size_t root = tree->root(), depth = tree->depth(), size = tree->size();
+    file->flush();
+    delete tree;
+    delete file;
+
+    open();
+    tree->restore(root, depth, size);
+    ASSERT_EQ(depth, tree->depth());
+    check();
+
+    // E continua aceitando inserções depois de reaberta
+    for (size_t i = 30000u; i < 40000u; ++i) {
+        reference[key(i)] = i;
+        tree->insert(key(i).c_str(), i);
+    }
+    check();
+}
+
+TEST_F(BPlusTreeOnDiskTest, Clear) {
+    uint64_t value;
+    for (size_t i = 0; i < 1000u; ++i)
+        tree->insert(key(i).c_str(), i);
+    tree->clear();
+    ASSERT_TRUE(tree->empty());
+    ASSERT_FALSE(tree->find(key(10).c_str(), &value));
+
+    tree->insert("ls", 1u);
+    ASSERT_EQ(1u, tree->size());
+    ASSERT_TRUE(tree->find("ls", &value));
+}
+
+TEST(BPlusTreeOnDiskConstantsTest, MaxInlineDefined) {
+    // A árvore passa MAX_INLINE por referência (std::min); sem a
+    // definição fora da classe isso só falha no link em -O0.
+    const size_t* volatile limit =
+        &structures::BPlusTreeOnDisk<uint64_t>::MAX_INLINE;
+    ASSERT_EQ(128u, *limit);
+    ASSERT_EQ(4u, std::min(size_t(4u),
+                           structures::BPlusTreeOnDisk<uint64_t>::MAX_INLINE));
+}
+
+TEST_F(BPlusTreeOnDiskTest, LongKeysAroundInlineLimit) {
+    // Chaves longas só têm o começo na página: as que diferem depois
+    // de MAX_INLINE precisam ler a chave inteira para se separar.
+    const size_t limit = structures::BPlusTreeOnDisk<uint64_t>::MAX_INLINE;
+    std::string base(limit + 64u, 'x');
+    std::vector<std::string> keys;
+    for (size_t length : {limit - 1u, limit, limit + 1u, limit + 2u,
+                          2u * limit, 10u * limit}) {
+        for (size_t i = 0; i < 40u; ++i) {
+            std::string text = std::string(length, 'y');
+            text.replace(text.size() - 4u, 4u, key(i).substr(7u));
+            keys.push_back(text);
+            keys.push_back(base + key(i));
+            keys.push_back(std::string(limit, 'x') + key(i));
+        }
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(5u));
+    for (size_t i = 0; i < keys.size(); ++i) {
+        reference[keys[i]] = i;
+        tree->insert(keys[i].c_str(), i);
+    }
+    ASSERT_LE(2u, tree->depth());
+    check();
+
+    uint64_t value;
+    ASSERT_FALSE(tree->find(base.c_str(), &value));
+    ASSERT_FALSE(tree->find((base + key(40)).c_str(), &value));
+    ASSERT_FALSE(tree->find((base + key(1) + "z").c_str(), &value));
+    ASSERT_FALSE(tree->find(std::string(limit, 'x').c_str(), &value));
+
+    std::vector<std::pair<std::string, uint64_t>> out;
+    tree->scan(base.c_str(), &out);
+    ASSERT_EQ(40u, out.size());
+    for (size_t i = 0; i < out.size(); ++i)
+        ASSERT_EQ(base + key(i), out[i].first);
+}
+
+TEST_F(BPlusTreeOnDiskTest, LongKeysBulkLoad) {
+    std::string base(300u, 'b');
+    for (size_t i = 0; i < 20000u; ++i) {
+        std::string text = base + key(i);
+        reference[text] = i;
+        tree->bulk_insert(text.c_str(), i);
+    }
+    tree->bulk_finish();
+    ASSERT_LE(2u, tree->depth());
+    check();
+
+    std::vector<std::string> keys = {base + key(19999), base, base + key(0),
+                                     base + key(20000), base + key(12345)};
+    std::vector<uint64_t> values;
+    std::vector<bool> found;
+    ASSERT_EQ(3u, tree->find(keys, &values, &found));
+    ASSERT_EQ(std::vector<bool>({true, false, true, false, true}), found);
+    ASSERT_EQ(12345u, values[4]);
+}
+
+TEST_F(BPlusTreeOnDiskTest, KeysSharingWholeRestartGroups) {
+    // Grupos de chaves bem maiores que RESTART em que cada uma repete a
+    // anterior quase inteira: só a chave inteira de cada grupo tem o
+    // texto todo, as outras guardam uma letra.
+    std::string common(100u, 'c');
+    for (size_t group = 0; group < 50u; ++group) {
+        for (char letter = 'a'; letter <= 'z'; ++letter) {
+            for (char second = 'a'; second <= 'z'; ++second) {
+                std::string text = common + key(group) + letter + second;
+                reference[text] = group;
+                tree->insert(text.c_str(), group);
+            }
+        }
+    }
+    ASSERT_LE(2u, tree->depth());
+    check();
+
+    uint64_t value;
+    ASSERT_FALSE(tree->find((common + key(3) + "a").c_str(), &value));
+    ASSERT_FALSE(tree->find((common + key(3) + "zzz").c_str(), &value));
+
+    std::vector<std::pair<std::string, uint64_t>> out;
+    tree->scan((common + key(7) + "q").c_str(), &out);
+    ASSERT_EQ(26u, out.size());
+    ASSERT_EQ(common + key(7) + "qa", out.front().first);
+    ASSERT_EQ(common + key(7) + "qz", out.back().first);
+}
+
+TEST_F(BPlusTreeOnDiskTest, SeparatorBetweenKeyAndItsExtension) {
+    // Cada chave é prefixo da seguinte, então toda divisão cai entre
+    // uma chave e ela mesma estendida; passando de MAX_INLINE o
+    // separador não pode mais ser um prefixo curto.
+    for (size_t length = 1; length <= 1500u; ++length) {
+        std::string text(length, 'p');
+        reference[text] = length;
+        tree->insert(text.c_str(), length);
+    }
+    ASSERT_LE(2u, tree->depth());
+    check();
+
+    uint64_t value;
+    for (size_t length = 1; length <= 1500u; ++length) {
+        // entre p^n e p^(n+1)
+        std::string between = std::string(length, 'p') + "o";
+        ASSERT_FALSE(tree->find(between.c_str(), &value)) << length;
+    }
+
+    std::vector<std::pair<std::string, uint64_t>> out;
+    tree->scan(std::string(1400u, 'p').c_str(), &out);
+    ASSERT_EQ(101u, out.size());
+}
+
+TEST_F(BPlusTreeOnDiskTest, SeparatorBetweenKeyAndItsExtensionBulk) {
+    for (size_t i = 0; i < 30000u; ++i) {
+        for (const char* suffix : {"", "0", "00", "01"}) {
+            std::string text = key(i) + suffix;
+            reference[text] = i;
+            tree->bulk_insert(text.c_str(), i);
+        }
+    }
+    tree->bulk_finish();
+    ASSERT_LE(2u, tree->depth());
+    check();
+
+    uint64_t value;
+    for (size_t i = 0; i < 30000u; i += 37u) {
+        ASSERT_FALSE(tree->find((key(i) + "/").c_str(), &value));
+        ASSERT_FALSE(tree->find((key(i) + "000").c_str(), &value));
+        ASSERT_FALSE(tree->find((key(i) + "02").c_str(), &value));
+    }
+}
@@ -0,0 +1,288 @@
+// Copyright [2017] <João Vicente Souto>
+
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./posting_list_on_disk.h"
+#include "./superblock.h"
+#include "./varint.h"
+
+int main(int argc, char* argv[]) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace {
+
+const char* const PATH = "./tests_posting_list_on_disk.dat";
+
+/**
+ * Diferenças que cruzam os tamanhos de Varint: 1, 2 e 3 bytes.
+ */
+const auto gaps = std::vector<size_t>{1u, 127u, 128u, 3u, 16383u, 16384u, 2u};
+
+}  // namespace
+
+TEST(VarintTest, RoundTrip) {
+    const auto values = std::vector<uint64_t>{
+        0u, 1u, 127u, 128u, 255u, 16383u, 16384u, 2097151u, 2097152u,
+        UINT32_MAX, uint64_t(1u) << 35, uint64_t(1u) << 63, UINT64_MAX
+    };
+    char buffer[structures::Varint::MAX_SIZE];
+    for (uint64_t value : values) {
+        size_t length = structures::Varint::encode(value, buffer);
+        ASSERT_EQ(structures::Varint::size(value), length) << value;
+        ASSERT_LE(length, size_t(structures::Varint::MAX_SIZE));
+
+        uint64_t decoded = 0u;
+        ASSERT_EQ(length, structures::Varint::decode(buffer, &decoded));
+        ASSERT_EQ(value, decoded);
+    }
+}
+
+TEST(VarintTest, Sizes) {
+    ASSERT_EQ(1u, structures::Varint::size(0u));
+    ASSERT_EQ(1u, structures::Varint::size(127u));
+    ASSERT_EQ(2u, structures::Varint::size(128u));
+    ASSERT_EQ(2u, structures::Varint::size(16383u));
+    ASSERT_EQ(3u, structures::Varint::size(16384u));
+    ASSERT_EQ(size_t(structures::Varint::MAX_SIZE),
+              structures::Varint::size(UINT64_MAX));
+}
+
+TEST(VarintTest, Sequence) {
+    std::vector<char> buffer(1000u * structures::Varint::MAX_SIZE);
+    size_t length = 0u;
+    for (uint64_t i = 0; i < 1000u; ++i)
+        length += structures::Varint::encode(i * i * i, buffer.data() + length);
+
+    size_t position = 0u;
+    for (uint64_t i = 0; i < 1000u; ++i) {
+        uint64_t value;
+        position += structures::Varint::decode(buffer.data() + position, &value);
+        ASSERT_EQ(i * i * i, value);
+    }
+    ASSERT_EQ(length, position);
+}
+
+class PostingListOnDiskTest: public ::testing::TestWithParam<bool> {
+protected:
+    void SetUp() override {
+        file = new structures::PageCache(PATH, 16u);
+        file->truncate();
+        structures::Superblock().store(file);  // como nos índices reais
+        list = new structures::PostingListOnDisk(file, GetParam());
+    }
+
+    void TearDown() override {
+        delete list;
+        delete file;
+        std::remove(PATH);
+    }
+
+    /**
+     * Acrescenta n documentos com as diferenças de gaps, frequências e
+     * posições que também variam de tamanho.
+     */
+    void fill(const size_t n) {
+        size_t doc = 0u, positions = 0u;
+        for (size_t i = 0; i < n; ++i) {
+            doc += gaps[i % gaps.size()];
+            positions += 1u + (i % 300u) * 11u;
+            docs.push_back(doc);
+            frequencies.push_back(1u + i % 200u);
+            where.push_back(GetParam()? positions : 0u);
+            list->append(&term, doc, frequencies.back(), 100u, where.back());
+        }
+    }
+
+    /**
+     * Percorre a lista com next() conferindo tudo e guarda o primeiro e
+     * o último documento de cada bloco.
+     */
+    void walk() {
+        structures::PostingListOnDisk::Cursor cursor(list, term);
+        ASSERT_EQ(docs.size(), cursor.count());
+        size_t last = 0u;
+        for (size_t i = 0; i < docs.size(); ++i) {
+            ASSERT_TRUE(cursor.valid());
+            ASSERT_EQ(docs[i], cursor.doc());
+            ASSERT_EQ(frequencies[i], cursor.frequency());
+            ASSERT_EQ(where[i], cursor.positions());
+            if (i == 0 || cursor.block_last() != last) {
+                last = cursor.block_last();
+                firsts.push_back(docs[i]);
+                lasts.push_back(last);
+            }
+            cursor.next();
+        }
+        ASSERT_FALSE(cursor.valid());
+
+        std::vector<size_t> read;
+        list->read(term, &read);
+        ASSERT_EQ(docs, read);
+    }
+
+    structures::PageCache *file{nullptr};
+    structures::PostingListOnDisk *list{nullptr};
+    structures::PostingListOnDisk::Term term;
+    std::vector<size_t> docs, frequencies, where, firsts, lasts;
+};
+
+INSTANTIATE_TEST_CASE_P(Positional, PostingListOnDiskTest,
+                        ::testing::Values(false, true));
+
+TEST_P(PostingListOnDiskTest, SingleDocInline) {
+    size_t before = file->size();
+    list->append(&term, 42u, 3u, 90u, GetParam()? 777u : 0u);
+
+    ASSERT_EQ(1u, term.count_);
+    ASSERT_EQ(42u, term.head_);  // o documento fica no próprio termo
+    ASSERT_EQ(before, file->size());  // sem bloco
+    ASSERT_EQ(3u, term.frequency_);
+    ASSERT_EQ(30u, term.ratio_);
+
+    list->append(&term, 42u, 3u, 90u);  // repetição é ignorada
+    ASSERT_EQ(1u, term.count_);
+
+    structures::PostingListOnDisk::Cursor cursor(list, term);
+    ASSERT_TRUE(cursor.valid());
+    ASSERT_EQ(42u, cursor.doc());
+    ASSERT_EQ(3u, cursor.frequency());
+    ASSERT_EQ(GetParam()? 777u : 0u, cursor.positions());
+    cursor.seek(42u);
+    ASSERT_TRUE(cursor.valid());
+    cursor.seek(43u);
+    ASSERT_FALSE(cursor.valid());
+
+    std::vector<size_t> read;
+    list->read(term, &read);
+    ASSERT_EQ(std::vector<size_t>{42u}, read);
+}
+
+TEST_P(PostingListOnDiskTest, SecondDocMovesToBlock) {
+    list->append(&term, 5u, 2u, 10u, GetParam()? 100u : 0u);
+    list->append(&term, 9u, 4u, 20u, GetParam()? 200u : 0u);
+
+    ASSERT_EQ(2u, term.count_);
+    ASSERT_NE(5u, term.head_);  // agora é o deslocamento do bloco
+    docs = {5u, 9u};
+    frequencies = {2u, 4u};
+    where = {GetParam()? 100u : 0u, GetParam()? 200u : 0u};
+    walk();
+}
+
+TEST_P(PostingListOnDiskTest, EmptyList) {
+    structures::PostingListOnDisk::Cursor cursor(list, term);
+    ASSERT_FALSE(cursor.valid());
+    ASSERT_EQ(0u, cursor.count());
+
+    std::vector<size_t> read;
+    list->read(term, &read);
+    ASSERT_TRUE(read.empty());
+}
+
+TEST_P(PostingListOnDiskTest, AppendRoundTrip) {
+    // Blocos dobram de 64 B até 64 KB e continuam nesse tamanho
+    fill(150000u);
+    walk();
+    ASSERT_LE(12u, firsts.size());
+}
+
+TEST_P(PostingListOnDiskTest, AppendOutOfOrder) {
+    fill(100u);
+    ASSERT_THROW(list->append(&term, docs.back() - 1u), std::out_of_range);
+    list->append(&term, docs.back());  // repetição do último é ignorada
+    ASSERT_EQ(100u, term.count_);
+
+    structures::PostingListOnDisk::Term single;
+    list->append(&single, 10u);
+    ASSERT_THROW(list->append(&single, 9u), std::out_of_range);
+}
+
+TEST_P(PostingListOnDiskTest, AssignRoundTrip) {
+    size_t doc = 0u;
+    for (size_t i = 0; i < 1000u; ++i) {
+        doc += gaps[i % gaps.size()];
+        docs.push_back(doc);
+        frequencies.push_back(1u + i % 7u);
+        where.push_back(GetParam()? 10u * (i + 1u) : 0u);
+    }
+    std::vector<size_t> words(docs.size(), 50u);
+    list->assign(&term, docs, frequencies, words, where);
+
+    ASSERT_EQ(1000u, term.count_);
+    ASSERT_EQ(7u, term.frequency_);
+    walk();
+    ASSERT_LE(8u, firsts.size());  // blocos de até BULK_DOCS
+}
+
+TEST_P(PostingListOnDiskTest, AssignSingleDocInline) {
+    list->assign(&term, {77u}, {2u}, {10u}, {GetParam()? 5u : 0u});
+    ASSERT_EQ(1u, term.count_);
+    ASSERT_EQ(77u, term.head_);
+
+    docs = {77u};
+    frequencies = {2u};
+    where = {GetParam()? 5u : 0u};
+    walk();
+}
+
+TEST_P(PostingListOnDiskTest, SeekBlockBoundaries) {
+    fill(60000u);
+    walk();
+    ASSERT_LE(3u, firsts.size());
+
+    for (size_t b = 0; b < firsts.size(); ++b) {
+        structures::PostingListOnDisk::Cursor first(list, term);
+        first.seek(firsts[b]);
+        ASSERT_TRUE(first.valid());
+        ASSERT_EQ(firsts[b], first.doc());
+
+        structures::PostingListOnDisk::Cursor last(list, term);
+        last.seek(lasts[b]);
+        ASSERT_TRUE(last.valid());
+        ASSERT_EQ(lasts[b], last.doc());
+        ASSERT_EQ(lasts[b], last.block_last());
+
+        // logo depois do último documento do bloco vem o próximo bloco
+        last.seek(lasts[b] + 1u);
+        if (b + 1u < firsts.size()) {
+            ASSERT_TRUE(last.valid());
+            ASSERT_EQ(firsts[b + 1u], last.doc());
+        } else {
+            ASSERT_FALSE(last.valid());
+        }
+    }
+}
+
+TEST_P(PostingListOnDiskTest, SeekBetweenAndPastEnd) {
+    fill(20000u);
+
+    structures::PostingListOnDisk::Cursor cursor(list, term);
+    for (size_t i = 0; i + 1u < docs.size(); i += 97u) {
+        cursor.seek(docs[i] + 1u);  // entre dois documentos
+        ASSERT_TRUE(cursor.valid());
+        ASSERT_EQ(docs[i + 1u], cursor.doc());
+        ASSERT_EQ(frequencies[i + 1u], cursor.frequency());
+        ASSERT_EQ(where[i + 1u], cursor.positions());
+    }
+
+    cursor.seek(docs.front());  // alvo para trás não volta
+    ASSERT_TRUE(cursor.valid());
+    ASSERT_LT(docs.front(), cursor.doc());
+
+    cursor.seek(docs.back());
+    ASSERT_TRUE(cursor.valid());
+    ASSERT_EQ(docs.back(), cursor.doc());
+
+    cursor.seek(docs.back() + 1u);
+    ASSERT_FALSE(cursor.valid());
+
+    structures::PostingListOnDisk::Cursor past(list, term);
+    past.seek(UINT32_MAX);
+    ASSERT_FALSE(past.valid());
+}
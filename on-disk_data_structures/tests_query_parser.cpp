@@ -0,0 +1,154 @@
+// Copyright [2017] <João Vicente Souto>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "./query_parser.h"
+
+int main(int argc, char* argv[]) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+class QueryParserTest: public ::testing::Test {
+protected:
+    /**
+     * Consulta normalizada por QueryNode::to_string().
+     */
+    std::string parse(const std::string& query) {
+        std::unique_ptr<structures::QueryNode> root(parser.parse(query));
+        return root->to_string();
+    }
+
+    structures::QueryParser parser;
+};
+
+TEST_F(QueryParserTest, SingleTerm) {
+    std::unique_ptr<structures::QueryNode> root(parser.parse("socket"));
+    ASSERT_EQ(structures::QueryNode::TERM, root->type_);
+    ASSERT_EQ("socket", root->term_);
+    ASSERT_EQ("socket", root->to_string());
+}
+
+TEST_F(QueryParserTest, TermsToLowerCase) {
+    ASSERT_EQ("socket", parse("SoCkEt"));
+    ASSERT_EQ("(and AND or)", parse("and or"));  // operadores só maiúsculos
+}
+
+TEST_F(QueryParserTest, ImplicitAnd) {
+    std::unique_ptr<structures::QueryNode> root(parser.parse("a b c"));
+    ASSERT_EQ(structures::QueryNode::AND, root->type_);
+    ASSERT_EQ(3u, root->children_.size());
+    ASSERT_EQ("(a AND b AND c)", root->to_string());
+
+    ASSERT_EQ(parse("a AND b AND c"), parse("a b c"));
+    ASSERT_EQ("(a AND b AND c)", parse("a AND b c"));
+}
+
+TEST_F(QueryParserTest, NotAfterTermIsAndNot) {
+    std::unique_ptr<structures::QueryNode> root(parser.parse("a NOT b"));
+    ASSERT_EQ(structures::QueryNode::AND, root->type_);
+    ASSERT_EQ(2u, root->children_.size());
+    ASSERT_EQ(structures::QueryNode::TERM, root->children_[0]->type_);
+    ASSERT_EQ(structures::QueryNode::NOT, root->children_[1]->type_);
+    ASSERT_EQ("b", root->children_[1]->children_[0]->term_);
+    ASSERT_EQ("(a AND NOT b)", root->to_string());
+
+    ASSERT_EQ(parse("a AND NOT b"), parse("a NOT b"));
+    ASSERT_EQ("NOT a", parse("NOT a"));
+    ASSERT_EQ("NOT NOT a", parse("NOT NOT a"));
+}
+
+TEST_F(QueryParserTest, Precedence) {
+    // NOT antes de AND, AND antes de OR
+    ASSERT_EQ("((a AND b) OR c)", parse("a AND b OR c"));
+    ASSERT_EQ("(a OR (b AND c))", parse("a OR b AND c"));
+    ASSERT_EQ("(a OR (b AND c) OR d)", parse("a OR b c OR d"));
+    ASSERT_EQ("((NOT a AND b) OR NOT c)", parse("NOT a b OR NOT c"));
+    ASSERT_EQ("((a AND NOT b) OR c)", parse("a NOT b OR c"));
+}
+
+TEST_F(QueryParserTest, Parentheses) {
+    ASSERT_EQ("(a AND (b OR c))", parse("a AND (b OR c)"));
+    ASSERT_EQ("(a AND (b OR c))", parse("a(b OR c)"));
+    ASSERT_EQ("NOT (a OR b)", parse("NOT (a OR b)"));
+    ASSERT_EQ("a", parse("((a))"));
+    ASSERT_EQ("(socket AND (bind OR connect) AND NOT deprecated)",
+              parse("socket AND (bind OR connect) NOT deprecated"));
+}
+
+TEST_F(QueryParserTest, Phrase) {
+    std::unique_ptr<structures::QueryNode> root(
+        parser.parse("\"File System\""));
+    ASSERT_EQ(structures::QueryNode::PHRASE, root->type_);
+    ASSERT_EQ(2u, root->children_.size());
+    ASSERT_EQ(0u, root->children_[0]->position_);
+    ASSERT_EQ(1u, root->children_[1]->position_);
+    ASSERT_EQ("\"file system\"", root->to_string());
+
+    ASSERT_EQ("file", parse("\"file\""));  // uma palavra é termo comum
+    ASSERT_EQ("(\"file system\" AND NOT mount)",
+              parse("\"file system\" NOT mount"));
+}
+
+TEST_F(QueryParserTest, Near) {
+    std::unique_ptr<structures::QueryNode> root(parser.parse("a NEAR/3 b"));
+    ASSERT_EQ(structures::QueryNode::NEAR, root->type_);
+    ASSERT_EQ(3u, root->distance_);
+    ASSERT_EQ("(a NEAR/3 b)", root->to_string());
+
+    ASSERT_EQ("(NOT (a NEAR/0 b) OR c)", parse("NOT a NEAR/0 b OR c"));
+}
+
+TEST_F(QueryParserTest, Wildcard) {
+    ASSERT_EQ("(fil* AND NOT *sys)", parse("fil* NOT *sys"));
+}
+
+TEST_F(QueryParserTest, Empty) {
+    ASSERT_THROW(parser.parse(""), std::invalid_argument);
+    ASSERT_THROW(parser.parse("   "), std::invalid_argument);
+    ASSERT_THROW(parser.parse("()"), std::invalid_argument);
+}
+
+TEST_F(QueryParserTest, UnbalancedParentheses) {
+    ASSERT_THROW(parser.parse("(a"), std::invalid_argument);
+    ASSERT_THROW(parser.parse("(a OR b"), std::invalid_argument);
+    ASSERT_THROW(parser.parse("((a) AND b"), std::invalid_argument);
+    ASSERT_THROW(parser.parse("a)"), std::invalid_argument);
+    ASSERT_THROW(parser.parse("(a OR b))"), std::invalid_argument);
+    ASSERT_THROW(parser.parse(")a("), std::invalid_argument);
+}
+
+TEST_F(QueryParserTest, UnclosedQuotes) {
+    ASSERT_THROW(parser.parse("\"file system"), std::invalid_argument);
+    ASSERT_THROW(parser.parse("a AND \"b"), std::invalid_argument);
+    ASSERT_THROW(parser.parse("\"a\" \""), std::invalid_argument);
+}
+
+TEST_F(QueryParserTest, DanglingOperators) {
+    ASSERT_THROW(parser.parse("a AND"), std::invalid_argument);
+    ASSERT_THROW(parser.parse("a OR"), std::invalid_argument);
+    ASSERT_THROW(parser.parse("NOT"), std::invalid_argument);
+    ASSERT_THROW(parser.parse("AND a"), std::invalid_argument);
+    ASSERT_THROW(parser.parse("OR a"), std::invalid_argument);
+    ASSERT_THROW(parser.parse("a OR OR b"), std::invalid_argument);
+    ASSERT_THROW(parser.parse("a AND (OR b)"), std::invalid_argument);
+}
+
+TEST_F(QueryParserTest, InvalidPhraseAndNear) {
+    ASSERT_THROW(parser.parse("\"\""), std::invalid_argument);
+    ASSERT_THROW(parser.parse("\"fil* system\""), std::invalid_argument);
+    ASSERT_THROW(parser.parse("a NEAR/ b"), std::invalid_argument);
+    ASSERT_THROW(parser.parse("a NEAR/x b"), std::invalid_argument);
+    ASSERT_THROW(parser.parse("a NEAR/3"), std::invalid_argument);
+    ASSERT_THROW(parser.parse("a* NEAR/3 b"), std::invalid_argument);
+    ASSERT_THROW(parser.parse("(a OR b) NEAR/3 c"), std::invalid_argument);
+    ASSERT_THROW(parser.parse("a NEAR/3 b NEAR/3 c"), std::invalid_argument);
+}
+
+TEST_F(QueryParserTest, ReusedAfterError) {
+    ASSERT_THROW(parser.parse("(a"), std::invalid_argument);
+    ASSERT_EQ("(a OR b)", parse("a OR b"));
+}
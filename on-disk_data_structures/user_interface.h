@@ -4,6 +4,8 @@
 
 #include <cstdint>
 #include <stdexcept>
+#include <iostream>
+#include <string>
 
 using namespace std;
 
@@ -21,8 +23,12 @@ class UserInterface {
    UserInterface();  // Construtor
    ~UserInterface();  // Destrutor
 
+   static const size_t EXIT = 5u;  //!< Opção de saída
+   static const size_t LAST = 7u;  //!< Maior opção do menu
+
    size_t choose_option();  // Escolhe uma opção
    string ask_word(const char* complement);  // Pede chave
+   string ask_line(const char* complement);  // Pede linha inteira
 };
 
 //! Construtor
@@ -40,7 +46,8 @@ UserInterface::UserInterface() {
 UserInterface::~UserInterface() {}
 
 //! Escolhe opção
-/*! Imprime opções e espera o usuário passar uma opção válida.
+/*! Imprime opções e espera o usuário passar uma opção válida. No fim
+ *  da entrada a opção é sair.
  *  \return size_t opção
  *  \sa ask_word()
  */
@@ -53,22 +60,26 @@ size_t UserInterface::choose_option() {
     else
       cout << "\nOpção inválida, escolha novamente:" << endl;
 
-    cout << "0 : Busca por chave primária (Imprime manpage)." << endl;
-    cout << "1 : Busca por chave secundária." << endl;
+    cout << "0 : Busca por chave primária (Imprime manpages, ex: ls cat)." << endl;
+    cout << "1 : Busca por chave secundária (aceita curinga, ex: sock* ou *printf)." << endl;
     cout << "2 : Busca conjuntiva por chave secundária." << endl;
     cout << "3 : Busca disjuntiva por chave secundária." << endl;
     cout << "4 : Informações." << endl;
     cout << "5 : Sair." << endl;
+    cout << "6 : Busca booleana (ex: socket AND (bind OR connect) NOT deprecated," << endl;
+    cout << "    \"file descriptor\" ou read NEAR/5 write, estes com -p)." << endl;
+    cout << "7 : Busca ranqueada (BM25, as 10 melhores, ex: socket bind)." << endl;
     cout << ">> ";
-    cin >> aux;
+    if (!(cin >> aux))
+      return EXIT;
 
     try {
       option = stoi(aux);
     } catch (std::invalid_argument e) {
-      option = 6;
+      option = LAST + 1;
       continue;
     }
-  } while (option > 5);
+  } while (option > LAST);
 
   return option;
 }
@@ -87,6 +98,21 @@ string UserInterface::ask_word(const char* phrase) {
   return in;
 }
 
+//! Pede uma linha
+/*! Imprime frase e retorna a linha inteira que o usuário passar,
+ *  ignorando espaços antes dela.
+ *  \param char* frase
+ *  \return string linha
+ *  \sa ask_word()
+ */
+string UserInterface::ask_line(const char* phrase) {
+  string in;
+  cout << phrase << endl;
+  cout << ">> ";
+  getline(cin >> ws, in);
+  return in;
+}
+
 }  //  namespace structures
 
 #endif
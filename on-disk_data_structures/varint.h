@@ -0,0 +1,79 @@
+//!  Copyright [2017] <João Vicente Souto>
+#ifndef STRUCTURES_VARINT_H
+#define STRUCTURES_VARINT_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace structures {
+
+//! Classe Varint
+/*! Codificação de inteiros sem sinal em tamanho variável, 7 bits por
+ *  byte e o bit mais alto indicando que há mais bytes. Números pequenos,
+ *  como as diferenças entre documentos vizinhos de uma lista, ocupam
+ *  um ou dois bytes em vez de oito.
+ *
+ *  \author João Vicente Souto.
+ *  \since 20/06/17
+ *  \version 1.0
+ */
+class Varint {
+ public:
+  static const size_t MAX_SIZE = 10u;  //!< Maior codificação de 64 bits
+
+  static size_t size(uint64_t value);  // Bytes necessários
+  static size_t encode(uint64_t value, char* out);  // Codifica
+  static size_t decode(const char* in, uint64_t* value);  // Decodifica
+};
+
+//! Bytes necessários
+/*! \param uint64_t valor
+ *  \return size_t quantidade de bytes da codificação
+ */
+size_t Varint::size(uint64_t value) {
+  size_t bytes = 1u;
+  while (value >= 0x80u) {
+    value >>= 7;
+    ++bytes;
+  }
+  return bytes;
+}
+
+//! Codifica
+/*! \param uint64_t valor
+ *  \param char* destino, com pelo menos size(valor) bytes
+ *  \return size_t bytes escritos
+ *  \sa decode()
+ */
+size_t Varint::encode(uint64_t value, char* out) {
+  size_t bytes = 0u;
+  while (value >= 0x80u) {
+    out[bytes++] = static_cast<char>((value & 0x7fu) | 0x80u);
+    value >>= 7;
+  }
+  out[bytes++] = static_cast<char>(value);
+  return bytes;
+}
+
+//! Decodifica
+/*! \param char* origem
+ *  \param uint64_t* valor lido
+ *  \return size_t bytes lidos
+ *  \sa encode()
+ */
+size_t Varint::decode(const char* in, uint64_t* value) {
+  const unsigned char *bytes = reinterpret_cast<const unsigned char*>(in);
+  uint64_t result = 0u;
+  size_t count = 0u, shift = 0u;
+  while (bytes[count] & 0x80u) {
+    result |= static_cast<uint64_t>(bytes[count++] & 0x7fu) << shift;
+    shift += 7;
+  }
+  result |= static_cast<uint64_t>(bytes[count++]) << shift;
+  *value = result;
+  return count;
+}
+
+}  //  namespace structures
+
+#endif
@@ -3,12 +3,20 @@
 #define STRUCTURES_WORD_HANDLER_H
 
 #include <cstdint>
+#include <cstring>
 #include <stdexcept>
 #include <iostream>
+#include <fstream>
+#include <algorithm>
 #include <cstdio>
+#include <string>
+#include <vector>
+#include <utility>
+#include <unordered_set>
+#include <unordered_map>
 
 #include "./structures/linked_list.h"
-#include "./structures/array_list.h"
+#include "./stop_words.h"
 
 using namespace std;
 
@@ -16,6 +24,14 @@ namespace structures {
 
 //! Classe WordHandler
 /*! Tratador de palavras, uma ou um conjunto.
+ *  O texto é percorrido uma única vez com uma tabela de 256 posições
+ *  que diz se cada byte é separador. As palavras repetidas são
+ *  contadas em uma tabela hash de trechos do próprio texto, sem criar
+ *  strings para elas; cada palavra sai uma vez, com a sua frequência e,
+ *  se pedido, as posições em que aparece. As posições contam todas as
+ *  palavras do texto, inclusive as ignoradas.
+ *  Não guarda estado entre chamadas, então cada thread de indexação
+ *  pode usar a sua própria instância.
  *
  *  \author João Vicente Souto.
  *  \since 20/06/17
@@ -23,40 +39,122 @@ namespace structures {
  */
 class WordHandler {
  public:
+   static constexpr const char* OVERRIDE =
+       "./ignored_words_override.txt";  //!< Lista que substitui StopWords
+
    WordHandler();  // Construtor
    ~WordHandler();  // Destrutor
 
+   //! Classe Word
+   /*! Palavra de um texto, com frequência e posições.
+    *
+    *  \author João Vicente Souto.
+    *  \since 20/06/17
+    *  \version 1.0
+    */
+   class Word {
+    public:
+     string text_;  //!< Palavra em minúsculas
+     size_t frequency_{0u};  //!< Vezes que aparece
+     vector<uint32_t> positions_;  //!< Posições, só se pedidas
+   };
+
+   typedef LinkedList<Word> Words;  //!< Palavras de um texto
+
    string clean_primary_key(string key);  // Limpa chave primária
-   LinkedList<string>* treatment(ifstream &file);  // Limpa chaves secundárias
+   Words* treatment(ifstream &file);  // Limpa chaves secundárias
+   Words* treatment(const char* text, const size_t length,
+                    const bool positional = false);  // Limpa chaves de um texto
+   void phrase(const string& text,
+               vector<pair<string, size_t>>* words);  // Palavras de uma frase
 
  private:
-   ArrayList<string> ignored_words{250};  //!< Palavras ignoradas
+   //! Classe Span
+   /*! Trecho do texto em minúsculas, chave da tabela de repetidas.
+    *
+    *  \author João Vicente Souto.
+    *  \since 20/06/17
+    *  \version 1.0
+    */
+   class Span {
+    public:
+     const char *data_;  //!< Início da palavra
+     size_t length_;  //!< Tamanho da palavra
+
+     //! Igualdade
+     /*! \param Span outro trecho
+      *  \return bool mesmas letras
+      */
+     bool operator==(const Span& other) const {
+       return length_ == other.length_ &&
+              memcmp(data_, other.data_, length_) == 0;
+     }
+   };
+
+   //! Classe SpanHash
+   /*! Hash FNV-1a de um trecho.
+    *
+    *  \author João Vicente Souto.
+    *  \since 20/06/17
+    *  \version 1.0
+    */
+   class SpanHash {
+    public:
+     //! Hash
+     /*! \param Span trecho
+      *  \return size_t hash
+      */
+     size_t operator()(const Span& span) const {
+       uint64_t hash = 14695981039346656037ull;
+       for (size_t i = 0; i < span.length_; ++i) {
+         hash ^= static_cast<unsigned char>(span.data_[i]);
+         hash *= 1099511628211ull;
+       }
+       return hash;
+     }
+   };
+
+   void split(const char* text, const size_t length,
+              vector<Span>* words) const;  // Quebra texto em palavras
+   bool ignored(const Span& word) const;  // Palavra ignorada
+
+   bool override_{false};  //!< Usa OVERRIDE em vez de StopWords
+   unordered_set<string> ignored_words;  //!< Palavras de OVERRIDE
    string separations{" '`^,.-+:;=<>[](){}|/_%*&$#@!?0123456789\"\f\n\r\t\v\\"};  //!< Separadores
-   char *token{nullptr};  //!< Ponteiro auxiliar
+   bool separator_[256];  //!< Byte é separador
+   vector<char> buffer_;  //!< Texto em minúsculas
+   vector<Span> words_,  //!< Palavras do texto
+                unique_;  //!< Palavras distintas, na ordem do texto
+   unordered_map<Span, size_t, SpanHash> seen_;  //!< Índice em unique_
+   vector<size_t> counts_;  //!< Frequência de cada palavra distinta
+   vector<vector<uint32_t>> positions_;  //!< Posições de cada palavra distinta
 };
 
 //! Construtor
-/*! Sem parâmetros, carrega palavras ignoradas de arquivo em disco.
+/*! Sem parâmetros, monta a tabela de separadores. As palavras
+ *  ignoradas vêm de StopWords, gerada a partir de ignored_words.txt;
+ *  se existir o arquivo OVERRIDE, ele é lido e substitui a lista.
  *  \sa ~WordHandler()
  */
 WordHandler::WordHandler() {
-  ifstream file("./ignored_words.txt", ios::in);
+  memset(separator_, 0, sizeof(separator_));
+  separator_[0] = true;
+  for (char c : separations)
+    separator_[static_cast<unsigned char>(c)] = true;
+
+  ifstream file(OVERRIDE, ios::in);
   string word;
 
   if (!file)
-    throw std::out_of_range("Error: open ./ignored_words.txt");
+    return;
 
-  file.seekg(0);
+  override_ = true;
   while (file >> word) {
-    token = strtok(&word[0], separations.c_str());
-
-    while (token != NULL) {
-      string temp(token);
-      ignored_words.push_back(temp);
-      token = strtok(NULL, separations.c_str());
-    }
+    vector<Span> pieces;
+    split(word.data(), word.size(), &pieces);
+    for (const Span& piece : pieces)
+      ignored_words.insert(string(piece.data_, piece.length_));
   }
-
 }
 
 //! Destrutor
@@ -79,30 +177,141 @@ string WordHandler::clean_primary_key(string key) {
 /*! Recebe um arquivo, pega as palavras do arquivo, limpa e
  *  retorna uma lista das palavras, sem repeti-las.
  *  \param ifstream &file referencia de um arquivo aberto.
- *  \return LinkedList<string> Lista das chaves do arquivo
+ *  \return Words Lista das chaves do arquivo e suas frequências
  *  \sa clean_primary_key()
  */
-LinkedList<string>* WordHandler::treatment(ifstream &file) {
-  string word;
-  LinkedList<string> *list = new LinkedList<string>();
+WordHandler::Words* WordHandler::treatment(ifstream &file) {
+  vector<char> text;
 
+  file.clear();
+  file.seekg(0, ios::end);
+  text.resize(static_cast<size_t>(file.tellg()));
   file.seekg(0);
-  while (file >> word) {
-    token = strtok(&word[0], separations.c_str());
+  file.read(text.data(), text.size());
+
+  return treatment(text.data(), file.gcount());
+}
+
+//! Limpa chaves de um texto
+/*! Mesmo que treatment(ifstream&), para um texto já em memória.
+ *  A cópia do texto já sai em minúsculas, num laço sem desvios que o
+ *  compilador vetoriza; depois uma única passada pela tabela de
+ *  separadores acha as palavras.
+ *  \param char* texto, não é modificado
+ *  \param size_t tamanho do texto
+ *  \param bool se as posições de cada palavra também são guardadas
+ *  \return Words Lista das chaves do texto e suas frequências
+ *  \sa treatment(ifstream &file)
+ */
+WordHandler::Words* WordHandler::treatment(const char* text,
+                                           const size_t length,
+                                           const bool positional) {
+  Words *list = new Words();
 
-    while (token != NULL) {
-      string temp(token);
-      transform(temp.begin(), temp.end(), temp.begin(), ::tolower);
+  buffer_.resize(length);
+  const unsigned char *in = reinterpret_cast<const unsigned char*>(text);
+  unsigned char *out = reinterpret_cast<unsigned char*>(buffer_.data());
+  for (size_t i = 0; i < length; ++i) {
+    unsigned char c = in[i];
+    out[i] = c + (static_cast<unsigned char>(c - 'A') < 26u? 32u : 0u);
+  }
+
+  words_.clear();
+  unique_.clear();
+  seen_.clear();
+  counts_.clear();
+  split(buffer_.data(), length, &words_);
 
-      if (!ignored_words.contains(temp) && !list->contains(temp))
-        list->push_front(temp);
-      token = strtok(NULL, separations.c_str());
+  for (size_t i = 0; i < words_.size(); ++i) {
+    auto it = seen_.insert(make_pair(words_[i], unique_.size()));
+    if (it.second) {
+      unique_.push_back(words_[i]);
+      counts_.push_back(0u);
+      if (positional) {
+        if (positions_.size() < unique_.size())
+          positions_.emplace_back();
+        positions_[it.first->second].clear();
+      }
     }
+    ++counts_[it.first->second];
+    if (positional)
+      positions_[it.first->second].push_back(i);
+  }
+
+  for (size_t i = 0; i < unique_.size(); ++i) {
+    if (ignored(unique_[i]))
+      continue;
+    Word word;
+    word.text_.assign(unique_[i].data_, unique_[i].length_);
+    word.frequency_ = counts_[i];
+    if (positional)
+      word.positions_ = positions_[i];
+    list->push_front(word);
   }
 
   return list;
 }
 
+//! Palavras de uma frase
+/*! Separa a frase como um texto indexado, para uma busca por frase
+ *  casar com as posições gravadas: cada palavra não ignorada sai com a
+ *  sua posição na frase, contando também as ignoradas.
+ *  \param string frase
+ *  \param vector<pair<string, size_t>>* palavras e posições, em ordem
+ */
+void WordHandler::phrase(const string& text,
+                         vector<pair<string, size_t>>* words) {
+  string lower(text);
+  for (char& letter : lower)
+    letter = tolower(static_cast<unsigned char>(letter));
+
+  vector<Span> pieces;
+  split(lower.data(), lower.size(), &pieces);
+  for (size_t i = 0; i < pieces.size(); ++i)
+    if (!ignored(pieces[i]))
+      words->push_back(make_pair(string(pieces[i].data_, pieces[i].length_),
+                                 i));
+}
+
+//! Palavra ignorada
+/*! \param Span palavra em minúsculas
+ *  \return bool se a palavra não deve ser indexada
+ */
+bool WordHandler::ignored(const Span& word) const {
+  if (!override_)
+    return StopWords::contains(word.data_, word.length_);
+  return ignored_words.find(string(word.data_, word.length_)) !=
+         ignored_words.end();
+}
+
+//! Quebra texto em palavras
+/*! Uma palavra é uma sequência máxima de bytes que não são separadores.
+ *  \param char* texto
+ *  \param size_t tamanho do texto
+ *  \param vector<Span>* palavras, na ordem do texto
+ */
+void WordHandler::split(const char* text, const size_t length,
+                        vector<Span>* words) const {
+  const unsigned char *begin = reinterpret_cast<const unsigned char*>(text),
+                      *end = begin + length,
+                      *position = begin;
+
+  while (position < end) {
+    while (position < end && separator_[*position])
+      ++position;
+    const unsigned char *start = position;
+    while (position < end && !separator_[*position])
+      ++position;
+
+    if (position != start) {
+      Span span;
+      span.data_ = reinterpret_cast<const char*>(start);
+      span.length_ = position - start;
+      words->push_back(span);
+    }
+  }
+}
+
 }  //  namespace structures
 
 #endif